@@ -0,0 +1,191 @@
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+#include "AllocTracker.h"
+
+/**
+ * Interposes the C allocator and the global operator new/delete to maintain
+ * HomaRpcBench::AllocTracker::counters.  Only linked into the *_alloc build
+ * targets.  The real allocator is reached through glibc's __libc_* entry
+ * points, so no dlsym bootstrapping is needed.
+ */
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+namespace HomaRpcBench {
+namespace AllocTracker {
+
+Counters counters;
+
+namespace {
+
+/**
+ * Charges the cycles spent in the enclosing scope to the counters.
+ */
+struct CycleCharge {
+    uint64_t start;
+
+    CycleCharge()
+        : start(__builtin_ia32_rdtsc())
+    {}
+
+    ~CycleCharge()
+    {
+        counters.cycles += __builtin_ia32_rdtsc() - start;
+    }
+};
+
+void
+countAllocation(void* ptr, size_t size)
+{
+    if (ptr != nullptr) {
+        counters.allocations++;
+        counters.bytes += size;
+    }
+}
+
+void
+countFree(void* ptr)
+{
+    if (ptr != nullptr) {
+        counters.frees++;
+    }
+}
+
+}  // namespace
+}  // namespace AllocTracker
+}  // namespace HomaRpcBench
+
+using namespace HomaRpcBench::AllocTracker;
+
+extern "C" {
+
+void*
+malloc(size_t size)
+{
+    CycleCharge charge;
+    void* ptr = __libc_malloc(size);
+    countAllocation(ptr, size);
+    return ptr;
+}
+
+void*
+calloc(size_t count, size_t size)
+{
+    CycleCharge charge;
+    void* ptr = __libc_calloc(count, size);
+    countAllocation(ptr, count * size);
+    return ptr;
+}
+
+void*
+realloc(void* ptr, size_t size)
+{
+    CycleCharge charge;
+    void* newPtr = __libc_realloc(ptr, size);
+    if (newPtr != nullptr || size == 0) {
+        countFree(ptr);
+    }
+    countAllocation(newPtr, size);
+    return newPtr;
+}
+
+int
+posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    CycleCharge charge;
+    void* newPtr = __libc_memalign(alignment, size);
+    if (newPtr == nullptr) {
+        return ENOMEM;
+    }
+    countAllocation(newPtr, size);
+    *ptr = newPtr;
+    return 0;
+}
+
+void*
+aligned_alloc(size_t alignment, size_t size)
+{
+    CycleCharge charge;
+    void* ptr = __libc_memalign(alignment, size);
+    countAllocation(ptr, size);
+    return ptr;
+}
+
+void*
+memalign(size_t alignment, size_t size)
+{
+    CycleCharge charge;
+    void* ptr = __libc_memalign(alignment, size);
+    countAllocation(ptr, size);
+    return ptr;
+}
+
+void
+free(void* ptr)
+{
+    CycleCharge charge;
+    countFree(ptr);
+    __libc_free(ptr);
+}
+
+}  // extern "C"
+
+void*
+operator new(size_t size)
+{
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void*
+operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void*
+operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return malloc(size == 0 ? 1 : size);
+}
+
+void*
+operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return malloc(size == 0 ? 1 : size);
+}
+
+void
+operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
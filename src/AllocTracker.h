@@ -0,0 +1,101 @@
+#ifndef HOMARPCBENCH_ALLOCTRACKER_H
+#define HOMARPCBENCH_ALLOCTRACKER_H
+
+#include <algorithm>
+#include <cstdint>
+
+namespace HomaRpcBench {
+
+/**
+ * Counts heap allocations made by the process.
+ *
+ * Counting is only compiled in for the *_alloc build targets, which define
+ * HOMARPCBENCH_ALLOC_TRACKING and link AllocTracker.cc to interpose malloc,
+ * free and operator new.  In every other build snapshot() returns zeros and
+ * ENABLED is false, so callers can leave their bookkeeping in place at no
+ * cost.  The counters are not synchronized; they are exact only while a
+ * single thread allocates, as in the benchmark's polling loops.
+ */
+namespace AllocTracker {
+
+struct Counters {
+    uint64_t allocations;  // Calls that returned new memory.
+    uint64_t frees;        // Calls that released memory.
+    uint64_t bytes;        // Bytes requested by the allocations.
+    uint64_t cycles;       // Cycles spent inside the allocator.
+
+    Counters()
+        : allocations(0)
+        , frees(0)
+        , bytes(0)
+        , cycles(0)
+    {}
+
+    Counters operator-(const Counters& other) const
+    {
+        Counters delta;
+        delta.allocations = allocations - other.allocations;
+        delta.frees = frees - other.frees;
+        delta.bytes = bytes - other.bytes;
+        delta.cycles = cycles - other.cycles;
+        return delta;
+    }
+
+    Counters& operator+=(const Counters& other)
+    {
+        allocations += other.allocations;
+        frees += other.frees;
+        bytes += other.bytes;
+        cycles += other.cycles;
+        return *this;
+    }
+};
+
+/**
+ * Allocation counts accumulated over a number of ops.
+ */
+struct OpStats {
+    uint64_t ops;
+    Counters total;
+    /// Most allocations made by any single op.
+    uint64_t maxAllocations;
+
+    OpStats()
+        : ops(0)
+        , total()
+        , maxAllocations(0)
+    {}
+
+    void add(const Counters& op)
+    {
+        ops++;
+        total += op;
+        maxAllocations = std::max(maxAllocations, op.allocations);
+    }
+};
+
+#ifdef HOMARPCBENCH_ALLOC_TRACKING
+inline constexpr bool ENABLED = true;
+
+/// Running totals for the process; maintained by AllocTracker.cc.
+extern Counters counters;
+
+inline Counters
+snapshot()
+{
+    return counters;
+}
+#else
+inline constexpr bool ENABLED = false;
+
+inline Counters
+snapshot()
+{
+    return Counters();
+}
+#endif
+
+}  // namespace AllocTracker
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_ALLOCTRACKER_H
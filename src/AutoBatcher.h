@@ -0,0 +1,223 @@
+#ifndef HOMARPCBENCH_AUTOBATCHER_H
+#define HOMARPCBENCH_AUTOBATCHER_H
+
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "Clock.h"
+#include "Payload.h"
+#include "WireFormat.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Client-side coalescing of small echo ops into EchoBatchRpc messages, so
+ * that the per-message cost of the transport is paid once per batch.
+ *
+ * Submitted ops wait in a pending batch until it holds maxOps ops (the size
+ * window) or its oldest op has waited maxDelayCycles (the time window);
+ * the batch is then sent as one message and its ops complete together when
+ * the reply arrives.  The transport types are template parameters so that
+ * the same batcher runs over Homa and over Socket.
+ */
+template <typename Transport, typename RemoteOp, typename Address>
+class AutoBatcher {
+  public:
+    /**
+     * @param transport
+     *      Transport the batches are sent with; the batcher polls it.
+     * @param server
+     *      Server every batch is sent to.
+     * @param maxOps
+     *      Size window: a batch is sent as soon as it holds this many ops.
+     * @param maxDelayCycles
+     *      Time window: a batch is sent once its oldest op has waited this
+     *      long, even if it is not full.
+     */
+    AutoBatcher(Transport* transport, Address server, uint32_t maxOps,
+                uint64_t maxDelayCycles)
+        : transport(transport)
+        , server(server)
+        , maxOps(maxOps)
+        , maxDelayCycles(maxDelayCycles)
+        , pending()
+        , inFlight()
+        , batchesSent(0)
+        , opsSent(0)
+        , timedOutBatches(0)
+    {}
+
+    /**
+     * Queue an op.
+     *
+     * @param id
+     *      Passed back when the op completes.
+     * @param payload
+     *      Request payload; must stay valid until the op's batch is sent.
+     * @param sentBytes
+     *      Number of bytes in the request payload.
+     * @param responseBytes
+     *      Number of bytes the server should echo back.
+     */
+    void submit(uint64_t id, const char* payload, uint32_t sentBytes,
+                uint32_t responseBytes)
+    {
+        pending.push_back({id, payload, sentBytes, responseBytes,
+                           Clock::rdtsc()});
+        if (pending.size() >= maxOps) {
+            flush();
+        }
+    }
+
+    /**
+     * Send the pending batch if its time window has closed, poll the
+     * transport, and complete the ops of every batch whose reply arrived.
+     *
+     * @param receiveBuffer
+     *      Buffer the response payloads are read into.
+     * @param receiveCapacity
+     *      Size of receiveBuffer.
+     * @param done
+     *      Called as done(id, latencyCycles, responseBytes) for each
+     *      completed op; the latency counts from submit().
+     * @return
+     *      Number of ops completed.
+     */
+    template <typename Fn>
+    size_t poll(char* receiveBuffer, size_t receiveCapacity, Fn done)
+    {
+        uint64_t now = Clock::rdtsc();
+        if (!pending.empty() &&
+            now - pending.front().submitCycles >= maxDelayCycles) {
+            timedOutBatches++;
+            flush();
+        }
+        transport->poll();
+        now = Clock::rdtsc();
+
+        size_t completed = 0;
+        for (auto it = inFlight.begin(); it != inFlight.end();) {
+            if (!it->op->isReady()) {
+                ++it;
+                continue;
+            }
+            WireFormat::EchoBatchRpc::Response response;
+            it->op->response->get(0, &response, sizeof(response));
+            if (response.numOps != it->ops.size()) {
+                std::cerr << "Sent a batch of " << it->ops.size()
+                          << " ops but the reply has " << response.numOps
+                          << std::endl;
+            }
+            uint32_t offset = sizeof(response);
+            for (const Op& op : it->ops) {
+                WireFormat::EchoBatchRpc::SubResponse subResponse;
+                subResponse.responseBytes = 0;
+                if (it->op->response->get(offset, &subResponse,
+                                          sizeof(subResponse)) ==
+                    sizeof(subResponse)) {
+                    offset += sizeof(subResponse);
+                    if (!Payload::read(it->op->response, offset,
+                                       receiveBuffer,
+                                       subResponse.responseBytes,
+                                       receiveCapacity)) {
+                        std::cerr << "Sub-response payload of "
+                                  << subResponse.responseBytes
+                                  << " bytes is truncated or too large"
+                                  << std::endl;
+                    }
+                    offset += subResponse.responseBytes;
+                }
+                done(op.id, now - op.submitCycles, subResponse.responseBytes);
+                completed++;
+            }
+            it = inFlight.erase(it);
+        }
+        return completed;
+    }
+
+    /// Send the pending batch now, if it holds any ops.
+    void flush()
+    {
+        if (pending.empty()) {
+            return;
+        }
+        inFlight.emplace_back(transport);
+        Batch& batch = inFlight.back();
+        batch.ops.swap(pending);
+        WireFormat::EchoBatchRpc::Request request;
+        request.common.opcode = WireFormat::EchoBatchRpc::opcode;
+        request.numOps = batch.ops.size();
+        batch.op->request->append(&request, sizeof(request));
+        for (const Op& op : batch.ops) {
+            WireFormat::EchoBatchRpc::SubRequest subRequest;
+            subRequest.sentBytes = op.sentBytes;
+            subRequest.responseBytes = op.responseBytes;
+            batch.op->request->append(&subRequest, sizeof(subRequest));
+            batch.op->request->append(op.payload, op.sentBytes);
+        }
+        batch.op->send(server);
+        batchesSent++;
+        opsSent += batch.ops.size();
+    }
+
+    /// Number of ops submitted but not completed.
+    size_t outstanding() const
+    {
+        size_t ops = pending.size();
+        for (const Batch& batch : inFlight) {
+            ops += batch.ops.size();
+        }
+        return ops;
+    }
+
+    /// Mean number of ops in the batches sent so far.
+    double meanBatchOps() const
+    {
+        return batchesSent == 0 ? 0 : double(opsSent) / batchesSent;
+    }
+
+    /// Fraction of the batches sent before they were full.
+    double timedOutFraction() const
+    {
+        return batchesSent == 0 ? 0 : double(timedOutBatches) / batchesSent;
+    }
+
+  private:
+    struct Op {
+        uint64_t id;
+        const char* payload;
+        uint32_t sentBytes;
+        uint32_t responseBytes;
+        uint64_t submitCycles;
+    };
+
+    /// A batch that was sent and awaits its reply.
+    struct Batch {
+        std::unique_ptr<RemoteOp> op;
+        std::vector<Op> ops;
+
+        explicit Batch(Transport* transport)
+            : op(std::make_unique<RemoteOp>(transport))
+            , ops()
+        {}
+    };
+
+    Transport* transport;
+    Address server;
+    uint32_t maxOps;
+    uint64_t maxDelayCycles;
+    /// Ops of the batch being filled, oldest first.
+    std::vector<Op> pending;
+    std::list<Batch> inFlight;
+    uint64_t batchesSent;
+    uint64_t opsSent;
+    /// Batches sent by the time window rather than the size window.
+    uint64_t timedOutBatches;
+};
+
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_AUTOBATCHER_H
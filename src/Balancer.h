@@ -0,0 +1,294 @@
+#ifndef HOMARPCBENCH_BALANCER_H
+#define HOMARPCBENCH_BALANCER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Clock.h"
+#include "Output.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Client-side selection of the server that handles each op.
+ *
+ * A Selector only sees what the client observes: the ops it has
+ * outstanding at each server and the latencies of the ops that completed.
+ * Servers are identified by their index in the benchmark's server list.
+ */
+namespace Balancer {
+
+enum Policy {
+    /// Every op goes to the first server.
+    FIRST,
+    ROUND_ROBIN,
+    /// Uniformly random server.
+    RANDOM,
+    /// Zipf-distributed server; lower indices are more popular.
+    ZIPF,
+    /// Power of two choices: the one of two random servers with fewer
+    /// outstanding ops.
+    P2C_OUTSTANDING,
+    /// Power of two choices: the one of two random servers with the lower
+    /// latency EWMA.
+    P2C_LATENCY,
+};
+
+/**
+ * Parse a --policy name.  Returns false and prints a message if the name is
+ * unknown.
+ */
+inline bool
+parsePolicy(const std::string& name, Policy* policy)
+{
+    if (name == "first") {
+        *policy = FIRST;
+    } else if (name == "roundRobin") {
+        *policy = ROUND_ROBIN;
+    } else if (name == "random") {
+        *policy = RANDOM;
+    } else if (name == "zipf") {
+        *policy = ZIPF;
+    } else if (name == "p2c") {
+        *policy = P2C_OUTSTANDING;
+    } else if (name == "p2cLatency") {
+        *policy = P2C_LATENCY;
+    } else {
+        std::cerr << "Unknown server selection policy " << name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline const char*
+policyName(Policy policy)
+{
+    switch (policy) {
+        case FIRST:
+            return "first";
+        case ROUND_ROBIN:
+            return "roundRobin";
+        case RANDOM:
+            return "random";
+        case ZIPF:
+            return "zipf";
+        case P2C_OUTSTANDING:
+            return "p2c";
+        case P2C_LATENCY:
+            return "p2cLatency";
+    }
+    return "unknown";
+}
+
+/**
+ * Chooses the server of each op according to a Policy and keeps per-server
+ * statistics of the ops it placed.
+ */
+class Selector {
+  public:
+    /// Weight of the newest sample in the latency EWMA.
+    static constexpr double EWMA_WEIGHT = 0.1;
+
+    /**
+     * @param policy
+     *      How servers are chosen.
+     * @param numServers
+     *      Number of servers to choose from.
+     * @param seed
+     *      Seed of the random choices.
+     * @param zipfSkew
+     *      Exponent of the ZIPF policy.
+     * @throw std::invalid_argument
+     *      numServers is 0; every policy needs a server to pick.
+     */
+    Selector(Policy policy, size_t numServers, uint64_t seed, double zipfSkew)
+        : policy(policy)
+        , generator(seed)
+        , nextServer(0)
+        , zipfCdf()
+        , servers(numServers)
+    {
+        if (numServers == 0) {
+            throw std::invalid_argument("no servers to balance ops over");
+        }
+        if (policy == ZIPF) {
+            double sum = 0;
+            for (size_t i = 0; i < numServers; ++i) {
+                sum += 1.0 / std::pow(i + 1, zipfSkew);
+                zipfCdf.push_back(sum);
+            }
+            for (double& p : zipfCdf) {
+                p /= sum;
+            }
+        }
+    }
+
+    /**
+     * Return the index of the server that should handle the next op.
+     */
+    size_t pick()
+    {
+        switch (policy) {
+            case FIRST:
+                return 0;
+            case ROUND_ROBIN: {
+                size_t server = nextServer;
+                nextServer = (nextServer + 1) % servers.size();
+                return server;
+            }
+            case RANDOM:
+                return uniform();
+            case ZIPF: {
+                double p =
+                    std::uniform_real_distribution<double>(0, 1)(generator);
+                return std::min<size_t>(
+                    std::upper_bound(zipfCdf.begin(), zipfCdf.end(), p) -
+                        zipfCdf.begin(),
+                    servers.size() - 1);
+            }
+            case P2C_OUTSTANDING:
+            case P2C_LATENCY: {
+                if (servers.size() == 1) {
+                    return 0;
+                }
+                size_t a = uniform();
+                size_t b = std::uniform_int_distribution<size_t>(
+                    0, servers.size() - 2)(generator);
+                if (b >= a) {
+                    b++;
+                }
+                if (policy == P2C_OUTSTANDING) {
+                    return servers[b].outstanding < servers[a].outstanding
+                               ? b
+                               : a;
+                }
+                return servers[b].latencyEwma < servers[a].latencyEwma ? b
+                                                                       : a;
+            }
+        }
+        return 0;
+    }
+
+    /// Note that an op was sent to a server.
+    void started(size_t server)
+    {
+        servers[server].outstanding++;
+    }
+
+    /**
+     * Note that an op sent to a server completed.
+     *
+     * @param latencyCycles
+     *      Latency of the op as seen by the client.
+     */
+    void finished(size_t server, uint64_t latencyCycles)
+    {
+        Server& s = servers[server];
+        s.outstanding--;
+        double latency = Clock::toSeconds(latencyCycles);
+        // The first op to a server pays for connection setup and cold
+        // caches; counting it would keep P2C_LATENCY away from the server
+        // for good.
+        if (s.times.size() == 1) {
+            s.latencyEwma = latency;
+        } else if (s.times.size() > 1) {
+            s.latencyEwma =
+                EWMA_WEIGHT * latency + (1 - EWMA_WEIGHT) * s.latencyEwma;
+        }
+        s.times.emplace_back(latency);
+    }
+
+    /**
+     * Print the latency distribution and throughput of every server and how
+     * unevenly the ops were spread.
+     *
+     * @param names
+     *      Name of each server.
+     * @param elapsed
+     *      Seconds over which the ops completed.
+     * @param resultKey
+     *      Key of the result the ops belong to (see Output::record()); the
+     *      line of each server is recorded under it.
+     */
+    void print(const std::vector<std::string>& names, double elapsed,
+               const std::string& resultKey)
+    {
+        size_t total = 0;
+        size_t most = 0;
+        for (Server& s : servers) {
+            total += s.times.size();
+            most = std::max(most, s.times.size());
+        }
+        for (size_t i = 0; i < servers.size(); ++i) {
+            Server& s = servers[i];
+            if (s.times.empty()) {
+                std::cout << "  server " << names[i] << ": no ops"
+                          << std::endl;
+                continue;
+            }
+            Output::record(resultKey + " / server " + names[i], s.times,
+                           s.times.size() / elapsed);
+            std::cout << Output::basic(
+                             s.times,
+                             Output::format("  server %s: %.1f%% of ops, "
+                                            "%.0f ops/s",
+                                            names[i].c_str(),
+                                            100.0 * s.times.size() / total,
+                                            s.times.size() / elapsed))
+                      << std::endl;
+        }
+        if (total > 0) {
+            std::cout << Output::format(
+                             "%s over %lu servers: busiest server took %.2fx "
+                             "its fair share of ops",
+                             policyName(policy), servers.size(),
+                             double(most) * servers.size() / total)
+                      << std::endl;
+        }
+    }
+
+    Policy getPolicy() const
+    {
+        return policy;
+    }
+
+  private:
+    size_t uniform()
+    {
+        return std::uniform_int_distribution<size_t>(
+            0, servers.size() - 1)(generator);
+    }
+
+    /// What the client has observed of one server.
+    struct Server {
+        int outstanding;
+        /// Exponentially weighted moving average of op latency in seconds,
+        /// excluding the first op; 0 until then, so new servers get tried.
+        double latencyEwma;
+        std::vector<Output::Latency> times;
+
+        Server()
+            : outstanding(0)
+            , latencyEwma(0)
+            , times()
+        {}
+    };
+
+    Policy policy;
+    std::mt19937_64 generator;
+    size_t nextServer;
+    /// Cumulative probability of each server under the ZIPF policy.
+    std::vector<double> zipfCdf;
+    std::vector<Server> servers;
+};
+
+}  // namespace Balancer
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_BALANCER_H
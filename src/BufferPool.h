@@ -0,0 +1,192 @@
+#ifndef HOMARPCBENCH_BUFFERPOOL_H
+#define HOMARPCBENCH_BUFFERPOOL_H
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace HomaRpcBench {
+
+/**
+ * Pool of large payload buffers backed by hugepages.
+ *
+ * Buffers are handed out in power-of-two size classes and returned to a free
+ * list when released, so steady-state benchmark loops never touch the
+ * kernel.  Memory comes from MAP_HUGETLB mappings when hugepages are
+ * reserved, and otherwise from regular mappings advised to use transparent
+ * hugepages.  Not thread-safe.
+ */
+class BufferPool {
+  public:
+    /// Largest payload the benchmarks support in one message.
+    static constexpr size_t MAX_BUFFER_BYTES = 1024ul * 1024 * 1024;
+
+    /**
+     * A buffer borrowed from a BufferPool; returned to the pool when
+     * destroyed.
+     */
+    class Buffer {
+      public:
+        Buffer()
+            : pool(nullptr)
+            , data(nullptr)
+            , sizeClass(0)
+        {}
+
+        Buffer(Buffer&& other)
+            : pool(other.pool)
+            , data(other.data)
+            , sizeClass(other.sizeClass)
+        {
+            other.pool = nullptr;
+            other.data = nullptr;
+        }
+
+        Buffer& operator=(Buffer&& other)
+        {
+            release();
+            pool = other.pool;
+            data = other.data;
+            sizeClass = other.sizeClass;
+            other.pool = nullptr;
+            other.data = nullptr;
+            return *this;
+        }
+
+        ~Buffer()
+        {
+            release();
+        }
+
+        char* get() const
+        {
+            return data;
+        }
+
+        /// Number of usable bytes; at least the number requested.
+        size_t capacity() const
+        {
+            return data == nullptr ? 0 : BufferPool::classBytes(sizeClass);
+        }
+
+      private:
+        Buffer(BufferPool* pool, char* data, int sizeClass)
+            : pool(pool)
+            , data(data)
+            , sizeClass(sizeClass)
+        {}
+
+        void release()
+        {
+            if (pool != nullptr) {
+                pool->freeLists[sizeClass].push_back(data);
+                pool = nullptr;
+                data = nullptr;
+            }
+        }
+
+        BufferPool* pool;
+        char* data;
+        int sizeClass;
+
+        friend class BufferPool;
+    };
+
+    BufferPool()
+        : freeLists(NUM_CLASSES)
+        , mappings()
+    {}
+
+    ~BufferPool()
+    {
+        for (Mapping& mapping : mappings) {
+            munmap(mapping.address, mapping.bytes);
+        }
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /**
+     * Borrow a buffer of at least the given size.
+     *
+     * @throw std::bad_alloc
+     *      If bytes exceeds MAX_BUFFER_BYTES or memory cannot be mapped.
+     */
+    Buffer acquire(size_t bytes)
+    {
+        if (bytes > MAX_BUFFER_BYTES) {
+            throw std::bad_alloc();
+        }
+        int sizeClass = 0;
+        while (classBytes(sizeClass) < bytes) {
+            ++sizeClass;
+        }
+        std::vector<char*>& freeList = freeLists[sizeClass];
+        if (freeList.empty()) {
+            freeList.push_back(map(classBytes(sizeClass)));
+        }
+        char* data = freeList.back();
+        freeList.pop_back();
+        return Buffer(this, data, sizeClass);
+    }
+
+    /// Number of bytes mapped with MAP_HUGETLB.
+    size_t getHugepageBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mapping& mapping : mappings) {
+            bytes += mapping.hugetlb ? mapping.bytes : 0;
+        }
+        return bytes;
+    }
+
+  private:
+    /// Smallest size class (4 KB).
+    static constexpr int MIN_CLASS_SHIFT = 12;
+    static constexpr int NUM_CLASSES = 31 - MIN_CLASS_SHIFT;
+    static constexpr size_t HUGEPAGE_BYTES = 2 * 1024 * 1024;
+
+    static size_t classBytes(int sizeClass)
+    {
+        return size_t(1) << (sizeClass + MIN_CLASS_SHIFT);
+    }
+
+    struct Mapping {
+        void* address;
+        size_t bytes;
+        bool hugetlb;
+    };
+
+    char* map(size_t bytes)
+    {
+        size_t mapBytes =
+            (bytes + HUGEPAGE_BYTES - 1) / HUGEPAGE_BYTES * HUGEPAGE_BYTES;
+        bool hugetlb = true;
+        void* address = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (address == MAP_FAILED) {
+            hugetlb = false;
+            address = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (address == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            madvise(address, mapBytes, MADV_HUGEPAGE);
+        }
+        mappings.push_back({address, mapBytes, hugetlb});
+        return static_cast<char*>(address);
+    }
+
+    /// Free buffers, indexed by size class.
+    std::vector<std::vector<char*>> freeLists;
+    /// Every region mapped by this pool; unmapped on destruction.
+    std::vector<Mapping> mappings;
+};
+
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_BUFFERPOOL_H
@@ -1,10 +1,16 @@
 #include <chrono>
+#include <cmath>
 #include <cstdarg>
 #include <cstring>
 #include <functional>
 #include <iostream>
+#include <list>
 #include <map>
+#include <memory>
+#include <random>
+#include <sstream>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <signal.h>
@@ -12,18 +18,39 @@
 #include <Homa/Debug.h>
 #include <Homa/Drivers/DPDK/DpdkDriver.h>
 #include <Homa/Homa.h>
-#include <PerfUtils/Cycles.h>
 #include <PerfUtils/TimeTrace.h>
 #include <docopt.h>
 
+#include "AllocTracker.h"
+#include "AutoBatcher.h"
+#include "Balancer.h"
+#include "BufferPool.h"
+#include "Clock.h"
+#include "Coroutine.h"
+#include "Faults.h"
+#include "FlightRecorder.h"
+#include "HopStamps.h"
 #include "Output.h"
+#include "Payload.h"
+#include "PerfCounters.h"
 #include "Rpc.h"
+#include "Socket.h"
+#include "Trace.h"
+#include "Tracepoint.h"
 #include "WireFormat.h"
 
+#ifdef HOMARPCBENCH_SIMULATION
+#include "Coordinator.h"
+#include "Server.h"
+#include "Sim.h"
+#endif
+
 static const char USAGE[] = R"(HomaRpcBench Client.
 
     Usage:
         client [options] [-v | -vv | -vvv | -vvvv] <port> <coordinator_address> <bench>
+        client [options] [-v | -vv | -vvv | -vvvv] --servers=<list> <bench>
+        client [options] [-v | -vv | -vvv | -vvvv] --simulate=<spec> <bench>
 
     Options:
         -h --help           Show this screen.
@@ -34,191 +61,2826 @@ static const char USAGE[] = R"(HomaRpcBench Client.
         --receiveBytes=<n>  Number of bytes in the response [default: 100].
         --output=<type>     Format of the output [default: basic].
         --timetrace=<dir>   Enable TimeTrace output at provided location.
+        --tracepoints=<list>
+                            Comma separated tracepoint categories recorded
+                            with --timetrace: client, poll, echo, nested,
+                            all or none [default: all].
+        --results=<file>    Append the raw latency samples of every
+                            result to this file, for the compare tool,
+                            which takes one run per file.
+        --flightRecorder=<n>
+                            Keep the tracepoints of the n slowest nestedRpc
+                            and ringRpc ops, on the client and on every
+                            server of the chain, and print only those.
+        --slowOp=<us>       With --flightRecorder, also keep every op that
+                            takes longer than this many microseconds.
+        --hopStamps         Have every server of nestedRpc and ringRpc ops
+                            stamp them, and print the residence time of
+                            each hop and the latency of the links.
+        --duration=<s>      Seconds to run time-based benchmarks [default: 10].
+        --seed=<n>          Seed for randomized workloads [default: 1].
+        --policy=<p>        How nestedRpc and coroutineRpc pick the server
+                            of each op when --hops=1: first, roundRobin,
+                            random, zipf, p2c (power of two choices by
+                            outstanding ops) or p2cLatency (by latency
+                            EWMA) [default: first].
+        --zipf=<s>          Skew of the zipf policy [default: 0.99].
+        --sizes=<list>      Comma separated request sizes in bytes swept by
+                            largeRpc
+                            [default: 1048576,16777216,67108864,268435456].
+        --window=<n>        Messages kept in flight by goodput [default: 8].
+        --slo=<us>          p99 latency objective in microseconds that
+                            loadCurve searches the knee of [default: 100].
+        --startRate=<r>     First offered load of loadCurve in ops/s; it
+                            doubles until the load is not sustained
+                            [default: 10000].
+        --stepDuration=<s>  Seconds loadCurve offers each load and
+                            pollScaling measures each idle op count
+                            [default: 1].
+        --tracking=<f>      Fraction of the offered load that must be
+                            achieved for loadCurve to count it as
+                            sustained [default: 0.95].
+        --searchSteps=<n>   Binary search steps loadCurve takes between the
+                            last sustained and first unsustained load
+                            [default: 6].
+        --faults=<spec>     Inject packet drops, delays, duplicates and
+                            reordering between Homa and the NIC; see
+                            src/Faults.h, e.g. drop=0.01,rx.reorder=1/50.
+        --lossRates=<list>  Comma separated drop probabilities swept by
+                            lossRpc, applied to the client's packets in
+                            each direction in place of any drop rule given
+                            with --faults
+                            [default: 0,0.0001,0.001,0.01,0.05].
+        --clients=<n>       Logical clients multiplexed on this thread by
+                            coroutineRpc and batchRpc [default: 1000].
+        --readyChecks=<n>   Most waiting ops coroutineRpc checks for
+                            readiness after each poll, round-robin; 0
+                            checks them all [default: 0].
+        --idleOps=<list>    Comma separated numbers of idle ops, held open
+                            by the servers, that pollScaling sweeps
+                            [default: 0,1,10,100,1000,10000,100000].
+        --batchSizes=<list> Comma separated size windows swept by
+                            batchRpc: the most ops packed into one message
+                            [default: 1,2,4,8,16,32,64].
+        --batchDelayUs=<us> Time window of batchRpc: a batch that is not
+                            full is sent once its oldest op has waited
+                            this many microseconds; over sockets it only
+                            closes once the socket poll wakes up, within
+                            1 ms unless busy polling [default: 20].
+        --verify            Fill echo payloads with a seeded pattern and
+                            check their CRC32C at every hop.
+        --perfCounters      Sample hardware counters around each phase of
+                            nestedRpc and ringRpc ops (adds a read(2) per
+                            phase to the measured latency).
+        --servers=<list>    Run over kernel sockets instead of Homa, against
+                            this comma separated list of host:port
+                            socket_server addresses (every benchmark but
+                            noop, serverList and lossRpc).
+        --protocol=<p>      Socket protocol, tcp or udp [default: tcp].
+        --simulate=<spec>   Run the coordinator, the servers and this
+                            client in one process over a simulated network
+                            in virtual time (client_sim build only); see
+                            src/Sim.h, e.g. servers=200,gbps=25.  Runs
+                            with the same --seed give the same results
+                            unless Homa's timers fire, in which case the
+                            client exits with status 1.
+        --busyPoll          Spin on the sockets instead of sleeping in
+                            epoll_wait.
+        --trace=<file>      Binary trace replayed by the replay benchmark;
+                            see trace_convert.
+        --classes=<spec>    Traffic classes for the mixedRpc benchmark; a
+                            ';' separated list of classes, each a ','
+                            separated list of key=value fields: name, send,
+                            receive, rate (ops/s, 0 for closed-loop), window
+                            (max outstanding ops; 1 if closed-loop, 1024 if
+                            open-loop), server (server id; over sockets,
+                            the position in --servers counting from 0).
+                            [default: name=default,send=100,receive=100]
 )";
 
-using ServerMap = std::map<uint64_t, Homa::Driver::Address>;
+using ServerMap = std::map<uint64_t, Homa::Driver::Address>;
+
+struct Config {
+    Homa::Transport* transport;
+    HomaRpcBench::BufferPool* bufferPool;
+    int count;
+    ServerMap serverMap;
+    int hops;
+    int sendBytes;
+    int receiveBytes;
+    bool timetrace;
+    double duration;
+    uint64_t seed;
+    HomaRpcBench::Balancer::Policy policy;
+    double zipfSkew;
+    std::string classes;
+    bool verify;
+    bool perfCounters;
+    /// Number of slowest ops kept by the flight recorder; -1 if disabled.
+    int flightTopN;
+    /// Latency above which the flight recorder keeps an op; 0 for none.
+    double flightSlowOp;
+    bool hopStamps;
+    int clients;
+    /// See Coroutine::Scheduler; 0 checks every waiter.
+    int readyChecks;
+    std::string idleOps;
+    std::string batchSizes;
+    /// Time window of batchRpc in seconds.
+    double batchDelay;
+    std::string sizes;
+    int window;
+    std::string trace;
+    /// Wraps the driver of transport if --faults was given or the test
+    /// injects its own faults; nullptr otherwise.
+    HomaRpcBench::Faults::Driver* faultDriver;
+    std::string lossRates;
+    /// p99 objective of loadCurve in seconds.
+    double loadSlo;
+    double loadStartRate;
+    double loadStepDuration;
+    double loadTracking;
+    int loadSearchSteps;
+    /// Set when running over kernel sockets (--servers) instead of Homa;
+    /// transport and serverMap are unused then.
+    HomaRpcBench::Socket::Transport* socketTransport;
+    std::vector<HomaRpcBench::Socket::Address> socketServers;
+};
+
+struct TestCase {
+    const char* name;       // Name of the performance test; this is what gets
+                            // typed on the command line to run the test.
+    void (*func)(Config&);  // Function that implements the test.
+    bool sockets;           // Whether the test runs over the socket backend.
+    bool faults;            // Whether the test injects packet faults itself.
+};
+
+namespace Backends {
+
+/**
+ * Runs a benchmark over Homa, against the servers enlisted with the
+ * coordinator.
+ */
+struct HomaBackend {
+    using Transport = Homa::Transport;
+    using RemoteOp = Homa::RemoteOp;
+    using Address = Homa::Driver::Address;
+
+    explicit HomaBackend(Config& config)
+        : transport(config.transport)
+        , servers()
+        , ids()
+    {
+        for (auto entry : config.serverMap) {
+            servers.push_back(entry.second);
+            ids.push_back(entry.first);
+        }
+    }
+
+    /// Suffix of result descriptions; empty so that Homa results keep
+    /// their names.
+    const char* describe() const
+    {
+        return "";
+    }
+
+    bool fitsMessage(size_t bytes) const
+    {
+        return true;
+    }
+
+    bool checkMessageBytes(size_t bytes) const
+    {
+        return true;
+    }
+
+    std::string serverName(size_t index) const
+    {
+        return transport->driver->addressToString(servers[index]);
+    }
+
+    /// Id of a server in the coordinator's server list.
+    uint64_t serverId(size_t index) const
+    {
+        return ids[index];
+    }
+
+    void configServer(Address server, bool forward, Address next = Address())
+    {
+        HomaRpcBench::Rpc::configServer(transport, server, forward, next);
+    }
+
+    void dumpTimeTraces()
+    {
+        for (Address server : servers) {
+            HomaRpcBench::Rpc::dumpTimeTrace(transport, server);
+        }
+    }
+
+    void getServerStats(
+        size_t server, bool reset,
+        HomaRpcBench::WireFormat::ServerStatsRpc::Response* stats)
+    {
+        HomaRpcBench::Rpc::getServerStats(transport, servers[server], reset,
+                                          stats);
+    }
+
+    /// Apply a flight recorder action to count servers starting at first.
+    void flightRecorder(
+        HomaRpcBench::WireFormat::FlightRecorderRpc::Action action,
+        uint64_t opId, size_t first, size_t count)
+    {
+        for (size_t i = first; i < first + count && i < servers.size(); ++i) {
+            HomaRpcBench::Rpc::flightRecorder(transport, servers[i], action,
+                                              opId);
+        }
+    }
+
+    /// Fetch the snapshot of an op from a server; returns false if the
+    /// backend has no server-side records.
+    bool fetchFlightRecord(
+        size_t server, uint64_t opId, double* cyclesPerSecond,
+        std::vector<HomaRpcBench::FlightRecorder::NamedEvent>* events)
+    {
+        HomaRpcBench::Rpc::fetchFlightRecord(transport, servers[server], opId,
+                                             cyclesPerSecond, events);
+        return true;
+    }
+
+    Homa::Transport* transport;
+    std::vector<Address> servers;
+    /// Coordinator ids of servers, in the same order.
+    std::vector<uint64_t> ids;
+};
+
+/**
+ * Runs a benchmark over kernel TCP or UDP sockets, against socket_server
+ * instances.
+ */
+struct SocketBackend {
+    using Transport = HomaRpcBench::Socket::Transport;
+    using RemoteOp = HomaRpcBench::Socket::RemoteOp;
+    using Address = HomaRpcBench::Socket::Address;
+
+    explicit SocketBackend(Config& config)
+        : transport(config.socketTransport)
+        , servers(config.socketServers)
+    {}
+
+    const char* describe() const
+    {
+        return transport->getProtocol() == HomaRpcBench::Socket::Protocol::TCP
+                   ? " over tcp"
+                   : " over udp";
+    }
+
+    std::string serverName(size_t index) const
+    {
+        return HomaRpcBench::Socket::toString(servers[index]);
+    }
+
+    /// Socket servers do not enlist; they are known by their position in
+    /// --servers.
+    uint64_t serverId(size_t index) const
+    {
+        return index;
+    }
+
+    /// True if a message of the given size fits the protocol.
+    bool fitsMessage(size_t bytes) const
+    {
+        return bytes <= transport->getMaxMessageBytes();
+    }
+
+    /// Check that a message of the given size fits the protocol, and say
+    /// so if it does not.
+    bool checkMessageBytes(size_t bytes) const
+    {
+        if (!fitsMessage(bytes)) {
+            std::cerr << "A " << bytes << " byte message exceeds the "
+                      << transport->getMaxMessageBytes() << " byte limit of"
+                      << describe() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void configServer(Address server, bool forward, Address next = Address())
+    {
+        HomaRpcBench::Socket::configServer(transport, server, forward, next);
+    }
+
+    void dumpTimeTraces() {}
+
+    void getServerStats(
+        size_t server, bool reset,
+        HomaRpcBench::WireFormat::ServerStatsRpc::Response* stats)
+    {
+        HomaRpcBench::Socket::getServerStats(transport, servers[server], reset,
+                                             stats);
+    }
+
+    /// Socket servers keep no flight records.
+    void flightRecorder(
+        HomaRpcBench::WireFormat::FlightRecorderRpc::Action action,
+        uint64_t opId, size_t first, size_t count)
+    {}
+
+    bool fetchFlightRecord(
+        size_t server, uint64_t opId, double* cyclesPerSecond,
+        std::vector<HomaRpcBench::FlightRecorder::NamedEvent>* events)
+    {
+        return false;
+    }
+
+    HomaRpcBench::Socket::Transport* transport;
+    std::vector<Address> servers;
+};
+
+/**
+ * Call fn with the backend selected on the command line.
+ */
+template <typename Fn>
+void
+run(Config& config, Fn fn)
+{
+    if (config.socketTransport != nullptr) {
+        SocketBackend backend(config);
+        fn(backend);
+    } else {
+        HomaBackend backend(config);
+        fn(backend);
+    }
+}
+
+}  // namespace Backends
+
+namespace Setup {
+
+/**
+ * Chain the first hops servers of a backend so that each forwards echo
+ * requests to the next and the last one answers them.
+ */
+template <typename Backend>
+void
+configServerChain(Backend& backend, int hops)
+{
+    if (hops > static_cast<int>(backend.servers.size())) {
+        std::cerr << hops << " requested but only " << backend.servers.size()
+                  << " servers." << std::endl;
+        throw;
+    }
+
+    int i = 0;
+    auto entry = backend.servers.begin();
+    while ((i < hops - 1) && std::next(entry) != backend.servers.end()) {
+        backend.configServer(*entry, true, *std::next(entry));
+        ++i;
+        ++entry;
+    }
+    backend.configServer(*entry, false);
+}
+
+void
+configServerChain(Config& config)
+{
+    Backends::HomaBackend backend(config);
+    configServerChain(backend, config.hops);
+}
+
+template <typename Backend>
+void
+configServersStandalone(Backend& backend)
+{
+    for (auto server : backend.servers) {
+        backend.configServer(server, false);
+    }
+}
+
+void
+configServersStandalone(Config& config)
+{
+    Backends::HomaBackend backend(config);
+    configServersStandalone(backend);
+}
+
+/**
+ * Configure the servers for ops placed by a Balancer::Selector: a chain
+ * from the first server for the FIRST policy, otherwise standalone servers
+ * (only single hop ops can be spread).
+ *
+ * @return
+ *      False, with a message printed, if the policy cannot be used.
+ */
+template <typename Backend>
+bool
+configServersForPolicy(const Config& config, Backend& backend)
+{
+    if (config.policy == HomaRpcBench::Balancer::FIRST) {
+        configServerChain(backend, config.hops);
+        return true;
+    }
+    if (config.hops != 1) {
+        std::cerr << "--policy="
+                  << HomaRpcBench::Balancer::policyName(config.policy)
+                  << " needs --hops=1" << std::endl;
+        return false;
+    }
+    configServersStandalone(backend);
+    return true;
+}
+
+}  // namespace Setup
+
+namespace Alloc {
+
+/**
+ * Clear the handler allocation counters of every server, so that a later
+ * report() covers only the benchmark that follows.
+ */
+void
+resetServers(Config& config)
+{
+    if (!HomaRpcBench::AllocTracker::ENABLED) {
+        return;
+    }
+    for (auto entry : config.serverMap) {
+        HomaRpcBench::WireFormat::ServerStatsRpc::Response stats;
+        HomaRpcBench::Rpc::getServerStats(config.transport, entry.second, true,
+                                          &stats);
+    }
+}
+
+/**
+ * Print the heap allocations made per op by this client and by the handlers
+ * of each server; does nothing unless allocation tracking is compiled in.
+ */
+void
+report(Config& config, const HomaRpcBench::AllocTracker::OpStats& client)
+{
+    if (!HomaRpcBench::AllocTracker::ENABLED || client.ops == 0) {
+        return;
+    }
+    std::cout << Output::format(
+                     "client heap: %.2f allocs/op (max %lu), %.2f frees/op, "
+                     "%.1f bytes/op, %.1f allocator cycles/op",
+                     double(client.total.allocations) / client.ops,
+                     client.maxAllocations,
+                     double(client.total.frees) / client.ops,
+                     double(client.total.bytes) / client.ops,
+                     double(client.total.cycles) / client.ops)
+              << std::endl;
+    for (auto entry : config.serverMap) {
+        HomaRpcBench::WireFormat::ServerStatsRpc::Response stats;
+        HomaRpcBench::Rpc::getServerStats(config.transport, entry.second,
+                                          false, &stats);
+        if (stats.handlerOps == 0) {
+            std::cout << "server " << entry.first
+                      << " heap: not tracked (use server_alloc)" << std::endl;
+            continue;
+        }
+        std::cout << Output::format(
+                         "server %lu heap: %.2f allocs/op, %.2f frees/op, "
+                         "%.1f bytes/op, %.1f allocator cycles/op",
+                         entry.first,
+                         double(stats.handlerAllocations) / stats.handlerOps,
+                         double(stats.handlerFrees) / stats.handlerOps,
+                         double(stats.handlerAllocatedBytes) / stats.handlerOps,
+                         double(stats.handlerAllocatorCycles) /
+                             stats.handlerOps)
+                  << std::endl;
+    }
+}
+
+}  // namespace Alloc
+
+namespace Perf {
+
+/// Phases of a synchronous op, each ending at the tracepoint of the same
+/// name: RemoteOp constructed, Request serialized, Request sent, Response
+/// received and Response deserialized.
+enum Phase {
+    CONSTRUCT,
+    SERIALIZE,
+    SEND,
+    WAIT,
+    DESERIALIZE,
+    NUM_PHASES,
+};
+
+/**
+ * Times the phases of every synchronous op with the cycle counter and, with
+ * --perfCounters, samples hardware counters around them as well.
+ *
+ * Call begin() at the start of an op and mark() at the end of each phase.
+ */
+class OpPhases {
+  public:
+    /**
+     * @param perfCounters
+     *      Also sample hardware counters; see PerfCounters::PhaseProfiler.
+     * @param expectedOps
+     *      Number of ops to make room for, so that recording an op does not
+     *      allocate.
+     */
+    OpPhases(bool perfCounters, int expectedOps)
+        : profiler({"construct", "serialize", "send", "wait", "deserialize"})
+        , last(0)
+        , cycles()
+    {
+        if (perfCounters) {
+            profiler.enable();
+        }
+        for (std::vector<uint64_t>& phase : cycles) {
+            phase.reserve(std::max(expectedOps, 0));
+        }
+    }
+
+    /// Mark the start of an op at the given cycle time.
+    void begin(uint64_t start)
+    {
+        profiler.begin();
+        last = start;
+    }
+
+    /// Mark the end of the given phase of the current op.
+    void mark(Phase phase)
+    {
+        uint64_t now = HomaRpcBench::Clock::rdtsc();
+        cycles[phase].push_back(now - last);
+        last = now;
+        profiler.mark(phase);
+    }
+
+    /**
+     * Print the distribution of the time spent in each phase, one line per
+     * phase under the end-to-end result line.
+     *
+     * @param resultKey
+     *      Key of the end-to-end result (see Output::record()); the phases
+     *      are recorded under it so that those of different results stay
+     *      apart.
+     */
+    void print(const std::string& resultKey)
+    {
+        static const char* names[NUM_PHASES] = {
+            "RemoteOp construction", "request serialization", "request send",
+            "wait for response", "response deserialization"};
+        for (int phase = 0; phase < NUM_PHASES; ++phase) {
+            std::vector<Output::Latency> times;
+            times.reserve(cycles[phase].size());
+            for (uint64_t phaseCycles : cycles[phase]) {
+                times.emplace_back(HomaRpcBench::Clock::toSeconds(phaseCycles));
+            }
+            if (!times.empty()) {
+                Output::record(resultKey + " / phase: " + names[phase], times);
+                std::cout << Output::basic(
+                                 times,
+                                 Output::format("  phase: %s", names[phase]))
+                          << std::endl;
+            }
+        }
+    }
+
+    /// Print the hardware counters per phase, if they were sampled.
+    void printCounters(const std::string& title)
+    {
+        profiler.print(title);
+    }
+
+  private:
+    HomaRpcBench::PerfCounters::PhaseProfiler profiler;
+    /// Cycle time of the previous begin() or mark().
+    uint64_t last;
+    /// Cycles spent in each phase by every op.
+    std::vector<uint64_t> cycles[NUM_PHASES];
+};
+
+}  // namespace Perf
+
+namespace Flight {
+
+/**
+ * Flight recorder of a synchronous benchmark (see FlightRecorder.h): traces
+ * each op, keeps the slowest ones and has the servers of the chain snapshot
+ * their records of them.  While disabled, tracepoints only go to TimeTrace.
+ */
+template <typename Backend>
+class Session {
+  public:
+    /**
+     * @param backend
+     *      Backend the benchmark runs over.
+     * @param hops
+     *      Number of consecutive servers that handle each op.
+     */
+    Session(const Config& config, Backend& backend, int hops)
+        : backend(backend)
+        , hops(hops)
+        , opServers()
+        , recorder(1)
+        , exemplars(std::max(config.flightTopN, 0),
+                    config.flightSlowOp * HomaRpcBench::Clock::perSecond())
+        , config(config)
+    {
+        if (config.flightTopN >= 0 && !HomaRpcBench::Tracepoint::COMPILED) {
+            std::cerr << "Flight recorder unavailable: tracepoints are "
+                         "compiled out"
+                      << std::endl;
+        } else if (config.flightTopN >= 0) {
+            recorder.setEnabled(true);
+            backend.flightRecorder(
+                HomaRpcBench::WireFormat::FlightRecorderRpc::ENABLE, 0, 0,
+                backend.servers.size());
+        }
+    }
+
+    void begin(uint64_t opId)
+    {
+        recorder.begin(opId);
+    }
+
+    void trace(uint64_t cycles, const char* name)
+    {
+        recorder.trace(HomaRpcBench::Tracepoint::CLIENT, cycles, name);
+    }
+
+    void trace(const char* name)
+    {
+        recorder.trace(HomaRpcBench::Tracepoint::CLIENT, name);
+    }
+
+    /**
+     * Close the current op; if it is worth keeping, the servers snapshot
+     * their records of it before their rings overwrite them.
+     *
+     * @param server
+     *      Index of the first server that handled the op.
+     */
+    void end(uint64_t latencyCycles, size_t server = 0)
+    {
+        const HomaRpcBench::FlightRecorder::OpRecord* record = recorder.end();
+        if (record != nullptr && exemplars.offer(*record, latencyCycles)) {
+            opServers[record->opId] = server;
+            backend.flightRecorder(
+                HomaRpcBench::WireFormat::FlightRecorderRpc::SNAPSHOT,
+                record->opId, server, hops);
+        }
+    }
+
+    /**
+     * Print the kept ops, slowest first, with the tracepoints of the client
+     * and of every server of the chain; then stop the servers' recorders.
+     */
+    void print()
+    {
+        if (!recorder.isEnabled()) {
+            return;
+        }
+        std::vector<const HomaRpcBench::FlightRecorder::Exemplar*> kept =
+            exemplars.sorted();
+        std::cout << "Flight recorder: " << kept.size() << " ops kept";
+        if (config.flightSlowOp > 0) {
+            std::cout << ", " << exemplars.getSlowOps()
+                      << " ops slower than "
+                      << Output::formatTime(
+                             Output::Latency(config.flightSlowOp));
+        }
+        std::cout << std::endl;
+
+        double cyclesPerSecond = HomaRpcBench::Clock::perSecond();
+        for (const HomaRpcBench::FlightRecorder::Exemplar* exemplar : kept) {
+            const HomaRpcBench::FlightRecorder::OpRecord& record =
+                exemplar->record;
+            std::cout << "op " << record.opId << ": "
+                      << Output::formatTime(Output::Latency(
+                             exemplar->latencyCycles / cyclesPerSecond))
+                      << (exemplar->slow ? " (slow)" : "") << std::endl;
+            std::cout << "  client" << std::endl;
+            HomaRpcBench::FlightRecorder::printEvents(
+                HomaRpcBench::FlightRecorder::toNamedEvents(record),
+                record.events[0].cycles, cyclesPerSecond, "    ");
+            size_t first = opServers[record.opId];
+            for (size_t server = first; server < first + hops; ++server) {
+                double serverCyclesPerSecond;
+                std::vector<HomaRpcBench::FlightRecorder::NamedEvent> events;
+                if (!backend.fetchFlightRecord(server, record.opId,
+                                               &serverCyclesPerSecond,
+                                               &events)) {
+                    break;
+                }
+                // Server clocks are unrelated to the client's, so their
+                // events are timed from the first one.
+                std::cout << "  server " << backend.serverName(server)
+                          << " (own clock)" << std::endl;
+                if (events.empty()) {
+                    std::cout << "    no record" << std::endl;
+                    continue;
+                }
+                HomaRpcBench::FlightRecorder::printEvents(
+                    events, events[0].cycles, serverCyclesPerSecond, "    ");
+            }
+        }
+        backend.flightRecorder(
+            HomaRpcBench::WireFormat::FlightRecorderRpc::DISABLE, 0, 0,
+            backend.servers.size());
+    }
+
+  private:
+    Backend& backend;
+    int hops;
+    /// Index of the first server of each kept op.
+    std::map<uint64_t, size_t> opServers;
+    /// The client decides whether to keep an op as soon as it ends, so it
+    /// only needs the record of the current one.
+    HomaRpcBench::FlightRecorder::Recorder recorder;
+    HomaRpcBench::FlightRecorder::Exemplars exemplars;
+    const Config& config;
+};
+
+}  // namespace Flight
+
+namespace Verify {
+
+/**
+ * Fill the header of an EchoRpc request; when payload verification is enabled
+ * also mark the request and compute the checksums of its payloads.
+ *
+ * @param config
+ *      Benchmark configuration.
+ * @param pattern
+ *      Payload buffer; must already hold the verification pattern (see
+ *      Payload::fillPattern) when config.verify is set.
+ * @param sendBytes
+ *      Number of bytes in the request payload.
+ * @param receiveBytes
+ *      Number of bytes in the response payload.
+ * @param[out] request
+ *      Request header to fill in.
+ * @param[out] expectedResponseCrc
+ *      Set to the checksum the response payload should have.
+ */
+void
+initEchoRequest(const Config& config, const char* pattern, int sendBytes,
+                int receiveBytes,
+                HomaRpcBench::WireFormat::EchoRpc::Request* request,
+                uint32_t* expectedResponseCrc)
+{
+    request->common.opcode = HomaRpcBench::WireFormat::EchoRpc::opcode;
+    request->sentBytes = sendBytes;
+    request->responseBytes = receiveBytes;
+    request->flags = 0;
+    request->patternSeed = 0;
+    request->payloadCrc = 0;
+    request->hopLimit = 0;
+    *expectedResponseCrc = 0;
+    if (config.verify) {
+        request->flags |= HomaRpcBench::WireFormat::EchoRpc::VERIFY_PAYLOAD;
+        // The pattern must be filled from the same 32-bit seed the servers
+        // will see.
+        request->patternSeed = static_cast<uint32_t>(config.seed);
+        request->payloadCrc =
+            HomaRpcBench::Payload::crc32c(pattern, sendBytes);
+        *expectedResponseCrc =
+            HomaRpcBench::Payload::crc32c(pattern, receiveBytes);
+    }
+}
+
+/**
+ * Check a received EchoRpc response payload against both the checksum it
+ * carried and the checksum of the expected pattern.
+ */
+void
+checkEchoResponse(const char* payload,
+                  const HomaRpcBench::WireFormat::EchoRpc::Response& response,
+                  uint32_t expectedCrc,
+                  HomaRpcBench::Payload::VerifyStats* stats)
+{
+    if (!HomaRpcBench::Payload::verify(payload, response.responseBytes,
+                                       response.payloadCrc, stats)) {
+        std::cerr << "Response payload failed CRC32C verification"
+                  << std::endl;
+    } else if (response.payloadCrc != expectedCrc) {
+        stats->failures++;
+        std::cerr << "Response payload does not match the expected pattern"
+                  << std::endl;
+    }
+}
+
+/**
+ * Copy the payload of an echo response into a buffer, reporting a payload
+ * that is truncated or larger than the buffer.
+ */
+template <typename Message>
+void
+readResponsePayload(const Message* message, uint32_t offset, char* buffer,
+                    uint32_t length, size_t capacity)
+{
+    if (!HomaRpcBench::Payload::read(message, offset, buffer, length,
+                                     capacity)) {
+        std::cerr << "Response payload of " << length
+                  << " bytes is truncated or too large" << std::endl;
+    }
+}
+
+/**
+ * Print the client-side verification cost, if any verification was done.
+ */
+void
+printStats(const HomaRpcBench::Payload::VerifyStats& stats)
+{
+    if (stats.bytes > 0) {
+        std::cout << Output::format(
+                         "Client payload verification: %lu bytes, "
+                         "%.3f cycles/byte, %lu failures",
+                         stats.bytes, stats.cyclesPerByte(), stats.failures)
+                  << std::endl;
+    }
+}
+
+}  // namespace Verify
+
+namespace Mixed {
+
+/**
+ * One stream of echo RPCs within a mixed workload.  Each class has its own
+ * message sizes, offered load and target server, and keeps its own
+ * statistics so that classes can be compared against each other.
+ */
+template <typename Backend>
+struct TrafficClass {
+    std::string name;
+    int sendBytes;
+    int receiveBytes;
+    /// Offered load in ops/s; 0 means closed-loop (always keep window ops
+    /// outstanding).
+    double rate;
+    /// Maximum number of ops of this class that may be outstanding at once.
+    int window;
+    /// See Backend::serverId.
+    uint64_t serverId;
+    typename Backend::Address server;
+
+    /// Cycle time at which the next open-loop op is scheduled to arrive.
+    uint64_t nextArrival;
+    std::exponential_distribution<double> interArrival;
+    int outstanding;
+    uint64_t sentBytes;
+    uint64_t receivedBytes;
+    std::vector<Output::Latency> times;
+
+    HomaRpcBench::WireFormat::EchoRpc::Request request;
+    uint32_t expectedResponseCrc;
+};
+
+/**
+ * An op that has been sent but whose response has not yet been processed.
+ */
+template <typename Backend>
+struct PendingOp {
+    TrafficClass<Backend>* trafficClass;
+    /// Cycle time from which the op's latency is measured; for open-loop
+    /// classes this is the scheduled arrival time, so queueing behind a full
+    /// window is charged to the op.
+    uint64_t start;
+    std::unique_ptr<typename Backend::RemoteOp> op;
+};
+
+/**
+ * Parse a --classes specification (see USAGE) into the list of classes.
+ * Returns false and prints a message if the specification is malformed.
+ */
+template <typename Backend>
+bool
+parseClasses(const Config& config, const Backend& backend,
+             std::vector<TrafficClass<Backend>>* classes)
+{
+    if (backend.servers.empty()) {
+        std::cerr << "No servers enlisted" << std::endl;
+        return false;
+    }
+    std::stringstream specs(config.classes);
+    std::string spec;
+    while (std::getline(specs, spec, ';')) {
+        if (spec.empty()) {
+            continue;
+        }
+        TrafficClass<Backend> tc;
+        tc.name = Output::format("class%lu", classes->size());
+        tc.sendBytes = config.sendBytes;
+        tc.receiveBytes = config.receiveBytes;
+        tc.rate = 0;
+        tc.window = 0;
+        tc.serverId = backend.serverId(0);
+
+        std::stringstream fields(spec);
+        std::string field;
+        while (std::getline(fields, field, ',')) {
+            size_t split = field.find('=');
+            if (split == std::string::npos) {
+                std::cerr << "Malformed traffic class field: " << field
+                          << std::endl;
+                return false;
+            }
+            std::string key = field.substr(0, split);
+            std::string value = field.substr(split + 1);
+            if (key == "name") {
+                tc.name = value;
+                continue;
+            }
+            size_t parsed = 0;
+            try {
+                if (key == "send") {
+                    tc.sendBytes = std::stoi(value, &parsed);
+                } else if (key == "receive") {
+                    tc.receiveBytes = std::stoi(value, &parsed);
+                } else if (key == "rate") {
+                    tc.rate = std::stod(value, &parsed);
+                } else if (key == "window") {
+                    tc.window = std::stoi(value, &parsed);
+                } else if (key == "server") {
+                    tc.serverId = std::stoul(value, &parsed);
+                } else {
+                    std::cerr << "Unknown traffic class field: " << key
+                              << std::endl;
+                    return false;
+                }
+            } catch (const std::exception&) {
+                parsed = 0;
+            }
+            if (parsed == 0 || parsed != value.size()) {
+                std::cerr << "Bad value \"" << value << "\" for traffic class "
+                          << "field " << key << " in --classes" << std::endl;
+                return false;
+            }
+        }
+
+        size_t server = 0;
+        while (server < backend.servers.size() &&
+               backend.serverId(server) != tc.serverId) {
+            ++server;
+        }
+        if (server == backend.servers.size()) {
+            std::cerr << "Traffic class " << tc.name
+                      << " targets unknown server " << tc.serverId
+                      << std::endl;
+            return false;
+        }
+        if (tc.sendBytes < 0 || tc.receiveBytes < 0 ||
+            static_cast<size_t>(std::max(tc.sendBytes, tc.receiveBytes)) >
+                HomaRpcBench::BufferPool::MAX_BUFFER_BYTES) {
+            std::cerr << "Traffic class " << tc.name
+                      << " needs send and receive sizes in [0, "
+                      << HomaRpcBench::BufferPool::MAX_BUFFER_BYTES << "]"
+                      << std::endl;
+            return false;
+        }
+        if (!backend.checkMessageBytes(
+                sizeof(HomaRpcBench::WireFormat::EchoRpc::Request) +
+                tc.sendBytes) ||
+            !backend.checkMessageBytes(
+                sizeof(HomaRpcBench::WireFormat::EchoRpc::Response) +
+                tc.receiveBytes)) {
+            return false;
+        }
+        if (tc.rate < 0) {
+            std::cerr << "Traffic class " << tc.name
+                      << " has a negative rate" << std::endl;
+            return false;
+        }
+        if (tc.window == 0) {
+            tc.window = tc.rate > 0 ? 1024 : 1;
+        }
+        if (tc.window < 1) {
+            std::cerr << "Traffic class " << tc.name
+                      << " must allow at least 1 outstanding op" << std::endl;
+            return false;
+        }
+        tc.server = backend.servers[server];
+        tc.nextArrival = 0;
+        if (tc.rate > 0) {
+            tc.interArrival = std::exponential_distribution<double>(tc.rate);
+        }
+        tc.outstanding = 0;
+        tc.sentBytes = 0;
+        tc.receivedBytes = 0;
+        classes->push_back(tc);
+    }
+    if (classes->empty()) {
+        std::cerr << "No traffic classes given" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Issue the ops of every class from start until durationCycles have
+ * passed, then wait for the ops still outstanding.  Each class's
+ * statistics accumulate.
+ *
+ * @param payload
+ *      Request payload; at least as large as any class's sendBytes.
+ * @param receiveBuffer
+ *      Scratch space of receiveCapacity bytes for response payloads.
+ * @return
+ *      Cycle time at which the last op completed.
+ */
+template <typename Backend>
+uint64_t
+run(const Config& config, Backend& backend,
+    std::vector<TrafficClass<Backend>>* classes, uint64_t start,
+    uint64_t durationCycles, const char* payload, char* receiveBuffer,
+    int receiveCapacity, std::mt19937_64* generator,
+    HomaRpcBench::Payload::VerifyStats* verifyStats)
+{
+    std::list<PendingOp<Backend>> pending;
+    uint64_t stop = start + durationCycles;
+    for (TrafficClass<Backend>& tc : *classes) {
+        tc.nextArrival = start;
+    }
+
+    uint64_t now = start;
+    while (now < stop || !pending.empty()) {
+        // Issue new ops for every class that has one due.
+        for (TrafficClass<Backend>& tc : *classes) {
+            while (now < stop && tc.outstanding < tc.window &&
+                   (tc.rate == 0 || tc.nextArrival <= now)) {
+                uint64_t opStart = now;
+                if (tc.rate > 0) {
+                    opStart = tc.nextArrival;
+                    tc.nextArrival += HomaRpcBench::Clock::fromSeconds(
+                        tc.interArrival(*generator));
+                }
+                pending.push_back({&tc, opStart,
+                                   std::make_unique<typename Backend::RemoteOp>(
+                                       backend.transport)});
+                typename Backend::RemoteOp* op = pending.back().op.get();
+                op->request->append(&tc.request, sizeof(tc.request));
+                op->request->append(payload, tc.sendBytes);
+                op->send(tc.server);
+                tc.outstanding++;
+                tc.sentBytes += tc.sendBytes;
+            }
+        }
+
+        backend.transport->poll();
+        now = HomaRpcBench::Clock::rdtsc();
+
+        // Collect completed ops.
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (!it->op->isReady()) {
+                ++it;
+                continue;
+            }
+            TrafficClass<Backend>* tc = it->trafficClass;
+            HomaRpcBench::WireFormat::EchoRpc::Response response;
+            it->op->response->get(0, &response, sizeof(response));
+            Verify::readResponsePayload(it->op->response, sizeof(response),
+                                        receiveBuffer, response.responseBytes,
+                                        receiveCapacity);
+            tc->times.emplace_back(
+                HomaRpcBench::Clock::toSeconds(now - it->start));
+            if (config.verify) {
+                Verify::checkEchoResponse(receiveBuffer, response,
+                                          tc->expectedResponseCrc,
+                                          verifyStats);
+            }
+            tc->receivedBytes += response.responseBytes;
+            tc->outstanding--;
+            if (response.responseBytes !=
+                static_cast<uint32_t>(tc->receiveBytes)) {
+                std::cerr << "Expected " << tc->receiveBytes
+                          << " bytes but got " << response.responseBytes
+                          << " bytes." << std::endl;
+            }
+            it = pending.erase(it);
+        }
+    }
+    return now;
+}
+
+}  // namespace Mixed
+
+namespace Load {
+
+/// Most times loadCurve doubles the offered load looking for saturation.
+static const int MAX_DOUBLINGS = 20;
+
+/**
+ * Outcome of offering one load.
+ */
+struct Point {
+    double offered;
+    double achieved;
+    std::vector<Output::Latency> times;
+    /// True if the p99 met the objective and the achieved load tracked the
+    /// offered load.
+    bool sustained;
+    /// True if the knee search picked the offered load, which then depends
+    /// on earlier measurements; such points are not recorded.
+    bool searched;
+};
+
+}  // namespace Load
+
+namespace Async {
+
+/// Coroutine layer over a backend's transport.
+template <typename Backend>
+using Scheduler =
+    HomaRpcBench::Coroutine::Scheduler<typename Backend::Transport,
+                                       typename Backend::RemoteOp>;
+template <typename Backend>
+using RemoteOp =
+    HomaRpcBench::Coroutine::RemoteOp<typename Backend::Transport,
+                                      typename Backend::RemoteOp,
+                                      typename Backend::Address>;
+
+/**
+ * State shared by the logical clients of the coroutineRpc benchmark.
+ */
+template <typename Backend>
+struct EchoState {
+    const Config* config;
+    std::vector<typename Backend::Address> servers;
+    /// Picks the server of each op; shared by all clients.
+    HomaRpcBench::Balancer::Selector* selector;
+    HomaRpcBench::WireFormat::EchoRpc::Request request;
+    uint32_t expectedResponseCrc;
+    /// Request payload; holds the verification pattern if verifying.
+    const char* requestPayload;
+    /// Scratch space for response payloads; all clients run on one thread
+    /// and copy their payload out synchronously, so they can share it.
+    char* responsePayload;
+    size_t responseCapacity;
+    /// Number of ops still to be started across all clients.
+    int remaining;
+    std::vector<Output::Latency> times;
+    HomaRpcBench::Payload::VerifyStats verifyStats;
+};
+
+/**
+ * One logical client: issues nested echo ops back to back, written as the
+ * blocking loop of nestedRpc but suspending instead of spinning in wait().
+ */
+template <typename Backend>
+HomaRpcBench::Coroutine::Task
+echoClient(Scheduler<Backend>* scheduler, EchoState<Backend>* state)
+{
+    while (state->remaining > 0) {
+        state->remaining--;
+        size_t server = state->selector->pick();
+        state->selector->started(server);
+        uint64_t start = HomaRpcBench::Clock::rdtsc();
+
+        RemoteOp<Backend> op(scheduler);
+        op->request->append(&state->request, sizeof(state->request));
+        op->request->append(state->requestPayload, state->request.sentBytes);
+        co_await op.send(state->servers[server]);
+
+        co_await op.response();
+        HomaRpcBench::WireFormat::EchoRpc::Response response;
+        op->response->get(0, &response, sizeof(response));
+        Verify::readResponsePayload(op->response, sizeof(response),
+                                    state->responsePayload,
+                                    response.responseBytes,
+                                    state->responseCapacity);
+        uint64_t stop = HomaRpcBench::Clock::rdtsc();
+        state->times.emplace_back(HomaRpcBench::Clock::toSeconds(stop - start));
+        state->selector->finished(server, stop - start);
+
+        if (state->config->verify) {
+            Verify::checkEchoResponse(state->responsePayload, response,
+                                      state->expectedResponseCrc,
+                                      &state->verifyStats);
+        }
+        if (response.responseBytes != state->request.responseBytes) {
+            std::cerr << "Expected " << state->request.responseBytes
+                      << " bytes but got " << response.responseBytes
+                      << " bytes." << std::endl;
+        }
+        if (response.hopCount !=
+            static_cast<uint32_t>(state->config->hops)) {
+            std::cerr << "Expected " << state->config->hops
+                      << " hops but got " << response.hopCount << " hops."
+                      << std::endl;
+        }
+    }
+}
+
+/**
+ * State shared by the senders of the goodput benchmark.
+ */
+template <typename Backend>
+struct GoodputState {
+    /// Servers receiving the messages, used in round-robin order.
+    std::vector<typename Backend::Address> servers;
+    size_t nextServer;
+    HomaRpcBench::WireFormat::GoodputRpc::Request request;
+    const char* payload;
+    /// Cycle time after which no new messages are sent.
+    uint64_t stopTime;
+    uint64_t messages;
+    uint64_t bytes;
+    std::vector<Output::Latency> times;
+};
+
+/**
+ * Keeps one goodput message in flight until the benchmark ends; the
+ * benchmark runs one sender per message in the window.
+ */
+template <typename Backend>
+HomaRpcBench::Coroutine::Task
+goodputSender(Scheduler<Backend>* scheduler, GoodputState<Backend>* state)
+{
+    while (HomaRpcBench::Clock::rdtsc() < state->stopTime) {
+        typename Backend::Address server = state->servers[state->nextServer];
+        state->nextServer = (state->nextServer + 1) % state->servers.size();
+        uint64_t start = HomaRpcBench::Clock::rdtsc();
+
+        RemoteOp<Backend> op(scheduler);
+        op->request->append(&state->request, sizeof(state->request));
+        op->request->append(state->payload, state->request.sentBytes);
+        co_await op.send(server);
+        co_await op.response();
+
+        uint64_t stop = HomaRpcBench::Clock::rdtsc();
+        state->times.emplace_back(HomaRpcBench::Clock::toSeconds(stop - start));
+        state->messages++;
+        state->bytes += state->request.sentBytes;
+    }
+}
+
+}  // namespace Async
+
+namespace Replay {
+
+/**
+ * Statistics of the replayed ops that share a Trace::Record::recordClass.
+ */
+struct RecordClass {
+    uint64_t sentBytes;
+    uint64_t receivedBytes;
+    std::vector<Output::Latency> times;
+};
+
+/**
+ * A replayed op whose response has not yet been processed.
+ */
+template <typename Backend>
+struct PendingOp {
+    uint8_t recordClass;
+    uint32_t hops;
+    /// Cycle time at which the trace scheduled the op; latency is measured
+    /// from here so that issue delays are charged to the op.
+    uint64_t start;
+    std::unique_ptr<typename Backend::RemoteOp> op;
+};
+
+}  // namespace Replay
+
+namespace Benchmark {
+
+void
+noop(Config&)
+{
+    std::cout << "Nothing was done." << std::endl;
+}
+
+void
+serverList(Config& config)
+{
+    Homa::Driver* driver = config.transport->driver;
+
+    std::cout << "Server List has " << config.serverMap.size() << " entries."
+              << std::endl;
+    for (auto entry : config.serverMap) {
+        std::cout << "Server " << entry.first << " at "
+                  << driver->addressToString(entry.second) << std::endl;
+    }
+}
+
+/**
+ * Print the per-server results of the ops placed by a selector over
+ * elapsed seconds, recording them under the key of their result.
+ */
+template <typename Backend>
+void
+printServers(Backend& backend, HomaRpcBench::Balancer::Selector* selector,
+             double elapsed, const std::string& resultKey)
+{
+    std::vector<std::string> names;
+    for (size_t i = 0; i < backend.servers.size(); ++i) {
+        names.push_back(backend.serverName(i));
+    }
+    selector->print(names, elapsed, resultKey);
+}
+
+template <typename Backend>
+void
+nestedRpc(Config& config, Backend& backend)
+{
+    size_t stampBytes =
+        config.hopStamps
+            ? config.hops * sizeof(HomaRpcBench::WireFormat::HopStamp)
+            : 0;
+    if (!backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoRpc::Request) +
+            config.sendBytes) ||
+        !backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoRpc::Response) +
+            config.receiveBytes + stampBytes)) {
+        return;
+    }
+    if (!Setup::configServersForPolicy(config, backend)) {
+        return;
+    }
+    std::string description = Output::format(
+        "send %dB message, receive %dB message, nested with %d hops%s",
+        config.sendBytes, config.receiveBytes, config.hops,
+        backend.describe());
+    if (config.policy != HomaRpcBench::Balancer::FIRST) {
+        description += Output::format(
+            ", %s over %lu servers",
+            HomaRpcBench::Balancer::policyName(config.policy),
+            backend.servers.size());
+    }
+    std::vector<std::chrono::duration<double>> times;
+    size_t payloadBytes = std::max(config.sendBytes, config.receiveBytes);
+    HomaRpcBench::BufferPool::Buffer buffer =
+        config.bufferPool->acquire(payloadBytes);
+    // Responses must not overwrite the request pattern when verifying.
+    HomaRpcBench::BufferPool::Buffer verifyBuffer;
+    if (config.verify) {
+        verifyBuffer = config.bufferPool->acquire(payloadBytes);
+    }
+    HomaRpcBench::BufferPool::Buffer& receiveBuffer =
+        config.verify ? verifyBuffer : buffer;
+    HomaRpcBench::Payload::VerifyStats verifyStats;
+    if (config.verify) {
+        HomaRpcBench::Payload::fillPattern(buffer.get(), buffer.capacity(),
+                                           static_cast<uint32_t>(config.seed));
+    }
+
+    HomaRpcBench::Balancer::Selector selector(
+        config.policy, backend.servers.size(), config.seed, config.zipfSkew);
+
+    HomaRpcBench::WireFormat::EchoRpc::Request request;
+    HomaRpcBench::WireFormat::EchoRpc::Response response;
+    uint32_t expectedResponseCrc;
+    Verify::initEchoRequest(config, buffer.get(), config.sendBytes,
+                            config.receiveBytes, &request,
+                            &expectedResponseCrc);
+    if (config.hopStamps) {
+        request.flags |= HomaRpcBench::WireFormat::EchoRpc::HOP_STAMPS;
+    }
+    HomaRpcBench::HopStamps::Breakdown hopStamps;
+    HomaRpcBench::AllocTracker::OpStats allocStats;
+    Alloc::resetServers(config);
+    Perf::OpPhases phases(config.perfCounters, config.count);
+    Flight::Session<Backend> flight(config, backend, config.hops);
+
+    uint64_t benchStart = HomaRpcBench::Clock::rdtsc();
+    for (int i = 0; i < config.count; ++i) {
+        size_t server = selector.pick();
+        selector.started(server);
+        HomaRpcBench::AllocTracker::Counters allocStart =
+            HomaRpcBench::AllocTracker::snapshot();
+        uint64_t start = HomaRpcBench::Clock::rdtsc();
+        request.opId = i + 1;
+        flight.begin(request.opId);
+        flight.trace(start, "Benchmark: +++ START +++");
+        phases.begin(start);
+
+        typename Backend::RemoteOp op(backend.transport);
+        flight.trace("Benchmark: RemoteOp constructed");
+        phases.mark(Perf::CONSTRUCT);
+        op.request->append(&request, sizeof(request));
+        op.request->append(buffer.get(), request.sentBytes);
+        flight.trace("Benchmark: Request serialized");
+        phases.mark(Perf::SERIALIZE);
+        op.send(backend.servers[server]);
+        flight.trace("Benchmark: Request sent");
+        phases.mark(Perf::SEND);
+
+        op.wait();
+        flight.trace("Benchmark: Response received");
+        phases.mark(Perf::WAIT);
+        op.response->get(0, &response, sizeof(response));
+        Verify::readResponsePayload(op.response, sizeof(response),
+                                    receiveBuffer.get(), response.responseBytes,
+                                    receiveBuffer.capacity());
+        flight.trace("Benchmark: Response deserialized");
+        phases.mark(Perf::DESERIALIZE);
+        uint64_t stop = HomaRpcBench::Clock::rdtsc();
+        allocStats.add(HomaRpcBench::AllocTracker::snapshot() - allocStart);
+        times.emplace_back(HomaRpcBench::Clock::toSeconds(stop - start));
+        flight.end(stop - start, server);
+        selector.finished(server, stop - start);
+        if (config.hopStamps) {
+            hopStamps.addNested(op.response,
+                                sizeof(response) + response.responseBytes,
+                                response.hopCount, stop - start);
+        }
+        if (config.verify) {
+            Verify::checkEchoResponse(receiveBuffer.get(), response,
+                                      expectedResponseCrc, &verifyStats);
+        }
+        if (response.responseBytes != request.responseBytes) {
+            std::cerr << "Expected " << request.responseBytes
+                      << " bytes but got " << response.responseBytes
+                      << " bytes." << std::endl;
+        }
+        if (response.hopCount != static_cast<uint32_t>(config.hops)) {
+            std::cerr << "Expected " << config.hops << " hops but got "
+                      << response.hopCount << " hops." << std::endl;
+        }
+    }
+    double elapsed = HomaRpcBench::Clock::toSeconds(
+        HomaRpcBench::Clock::rdtsc() - benchStart);
+    // The description holds configured parameters only.
+    std::string key = "nestedRpc: " + description;
+    Output::record(key, times, times.size() / elapsed);
+    std::cout << Output::basicHeader() << std::endl;
+    std::cout << Output::basic(times, description) << std::endl;
+    phases.print(key);
+    if (config.hopStamps) {
+        hopStamps.print(key);
+    }
+    if (config.policy != HomaRpcBench::Balancer::FIRST) {
+        printServers(backend, &selector, elapsed, key);
+    }
+    Verify::printStats(verifyStats);
+    Alloc::report(config, allocStats);
+    phases.printCounters("client hardware counters per op:");
+    flight.print();
+    if (config.timetrace) {
+        PerfUtils::TimeTrace::print();
+        backend.dumpTimeTraces();
+    }
+}
+
+void
+nestedRpc(Config& config)
+{
+    Backends::run(config,
+                  [&config](auto& backend) { nestedRpc(config, backend); });
+}
+
+template <typename Backend>
+void
+ringRpc(Config& config, Backend& backend)
+{
+    size_t stampBytes =
+        config.hopStamps
+            ? config.hops * sizeof(HomaRpcBench::WireFormat::HopStamp)
+            : 0;
+    if (!backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoMultiLevelRpc::Request) +
+            config.sendBytes + stampBytes) ||
+        !backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoMultiLevelRpc::Response) +
+            config.receiveBytes + stampBytes)) {
+        return;
+    }
+    Setup::configServerChain(backend, config.hops);
+    std::string description = Output::format(
+        "send %dB message, receive %dB message, ring with %d hops%s",
+        config.sendBytes, config.receiveBytes, config.hops,
+        backend.describe());
+    std::vector<std::chrono::duration<double>> times;
+    HomaRpcBench::BufferPool::Buffer buffer = config.bufferPool->acquire(
+        std::max(config.sendBytes, config.receiveBytes));
+
+    typename Backend::Address server = backend.servers.front();
+
+    HomaRpcBench::WireFormat::EchoMultiLevelRpc::Request request;
+    HomaRpcBench::WireFormat::EchoMultiLevelRpc::Response response;
+    request.common.opcode = HomaRpcBench::WireFormat::EchoMultiLevelRpc::opcode;
+    request.sentBytes = config.sendBytes;
+    request.responseBytes = config.receiveBytes;
+    request.flags =
+        config.hopStamps ? HomaRpcBench::WireFormat::EchoRpc::HOP_STAMPS : 0;
+    request.numHopStamps = 0;
+    HomaRpcBench::HopStamps::Breakdown hopStamps;
+    HomaRpcBench::AllocTracker::OpStats allocStats;
+    Alloc::resetServers(config);
+    Perf::OpPhases phases(config.perfCounters, config.count);
+    Flight::Session<Backend> flight(config, backend, config.hops);
+
+    for (int i = 0; i < config.count; ++i) {
+        HomaRpcBench::AllocTracker::Counters allocStart =
+            HomaRpcBench::AllocTracker::snapshot();
+        uint64_t start = HomaRpcBench::Clock::rdtsc();
+        request.opId = i + 1;
+        flight.begin(request.opId);
+        flight.trace(start, "Benchmark: +++ START +++");
+        phases.begin(start);
+
+        typename Backend::RemoteOp op(backend.transport);
+        flight.trace("Benchmark: RemoteOp constructed");
+        phases.mark(Perf::CONSTRUCT);
+        op.request->append(&request, sizeof(request));
+        op.request->append(buffer.get(), request.sentBytes);
+        flight.trace("Benchmark: Request serialized");
+        phases.mark(Perf::SERIALIZE);
+        op.send(server);
+        flight.trace("Benchmark: Request sent");
+        phases.mark(Perf::SEND);
+
+        op.wait();
+        flight.trace("Benchmark: Response received");
+        phases.mark(Perf::WAIT);
+        op.response->get(0, &response, sizeof(response));
+        Verify::readResponsePayload(op.response, sizeof(response),
+                                    buffer.get(), response.responseBytes,
+                                    buffer.capacity());
+        flight.trace("Benchmark: Response deserialized");
+        phases.mark(Perf::DESERIALIZE);
+
+        uint64_t stop = HomaRpcBench::Clock::rdtsc();
+        allocStats.add(HomaRpcBench::AllocTracker::snapshot() - allocStart);
+        times.emplace_back(HomaRpcBench::Clock::toSeconds(stop - start));
+        flight.end(stop - start);
+        if (config.hopStamps) {
+            hopStamps.addRing(op.response,
+                              sizeof(response) + response.responseBytes,
+                              response.numHopStamps, stop - start);
+        }
+        if (response.responseBytes != request.responseBytes) {
+            std::cerr << "Expected " << request.responseBytes
+                      << " bytes but got " << response.responseBytes
+                      << " bytes." << std::endl;
+        }
+    }
+    std::string key = "ringRpc: " + description;
+    Output::record(key, times);
+    std::cout << Output::basicHeader() << std::endl;
+    std::cout << Output::basic(times, description) << std::endl;
+    phases.print(key);
+    if (config.hopStamps) {
+        hopStamps.print(key);
+    }
+    Alloc::report(config, allocStats);
+    phases.printCounters("client hardware counters per op:");
+    flight.print();
+    if (config.timetrace) {
+        PerfUtils::TimeTrace::print();
+        backend.dumpTimeTraces();
+    }
+}
+
+void
+ringRpc(Config& config)
+{
+    Backends::run(config,
+                  [&config](auto& backend) { ringRpc(config, backend); });
+}
+
+template <typename Backend>
+void
+mixedRpc(Config& config, Backend& backend)
+{
+    std::vector<Mixed::TrafficClass<Backend>> classes;
+    if (!Mixed::parseClasses(config, backend, &classes)) {
+        return;
+    }
+    Setup::configServersStandalone(backend);
+
+    int maxBytes = 0;
+    for (Mixed::TrafficClass<Backend>& tc : classes) {
+        maxBytes = std::max({maxBytes, tc.sendBytes, tc.receiveBytes});
+    }
+    HomaRpcBench::BufferPool::Buffer buffer =
+        config.bufferPool->acquire(maxBytes);
+    // Responses must not overwrite the request pattern when verifying.
+    HomaRpcBench::BufferPool::Buffer verifyBuffer;
+    if (config.verify) {
+        verifyBuffer = config.bufferPool->acquire(maxBytes);
+    }
+    char* receiveBuffer = config.verify ? verifyBuffer.get() : buffer.get();
+    HomaRpcBench::Payload::VerifyStats verifyStats;
+    if (config.verify) {
+        HomaRpcBench::Payload::fillPattern(buffer.get(), buffer.capacity(),
+                                           static_cast<uint32_t>(config.seed));
+    }
+    for (Mixed::TrafficClass<Backend>& tc : classes) {
+        Verify::initEchoRequest(config, buffer.get(), tc.sendBytes,
+                                tc.receiveBytes, &tc.request,
+                                &tc.expectedResponseCrc);
+    }
+    std::mt19937_64 generator(config.seed);
+
+    uint64_t benchStart = HomaRpcBench::Clock::rdtsc();
+    uint64_t now = Mixed::run(config, backend, &classes, benchStart,
+                              HomaRpcBench::Clock::fromSeconds(config.duration),
+                              buffer.get(), receiveBuffer, maxBytes,
+                              &generator, &verifyStats);
+    double elapsed = HomaRpcBench::Clock::toSeconds(now - benchStart);
+
+    std::cout << Output::basicHeader() << std::endl;
+    for (Mixed::TrafficClass<Backend>& tc : classes) {
+        if (tc.times.empty()) {
+            std::cout << "class " << tc.name << ": no ops completed"
+                      << std::endl;
+            continue;
+        }
+        std::string offered =
+            tc.rate > 0 ? Output::format("%.0f ops/s", tc.rate)
+                        : Output::format("closed-loop x%d", tc.window);
+        std::string key = Output::format(
+            "mixedRpc: class %s: send %dB, receive %dB, server %lu, %s "
+            "offered%s",
+            tc.name.c_str(), tc.sendBytes, tc.receiveBytes, tc.serverId,
+            offered.c_str(), backend.describe());
+        Output::record(key, tc.times, tc.times.size() / elapsed);
+        std::string description = Output::format(
+            "class %s: send %dB, receive %dB, server %lu, %s offered, "
+            "%.0f ops/s, %.3f Gbps achieved%s",
+            tc.name.c_str(), tc.sendBytes, tc.receiveBytes, tc.serverId,
+            offered.c_str(), tc.times.size() / elapsed,
+            (tc.sentBytes + tc.receivedBytes) * 8 / elapsed / 1e9,
+            backend.describe());
+        std::cout << Output::basic(tc.times, description) << std::endl;
+    }
+    Verify::printStats(verifyStats);
+    if (config.timetrace) {
+        PerfUtils::TimeTrace::print();
+        backend.dumpTimeTraces();
+    }
+}
+
+void
+mixedRpc(Config& config)
+{
+    Backends::run(config,
+                  [&config](auto& backend) { mixedRpc(config, backend); });
+}
+
+/**
+ * Step the open-loop offered load up to saturation and binary search the
+ * knee: the highest load whose p99 meets --slo while the achieved load
+ * still tracks the offered load.
+ */
+template <typename Backend>
+void
+loadCurve(Config& config, Backend& backend)
+{
+    if (!backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoRpc::Request) +
+            config.sendBytes) ||
+        !backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoRpc::Response) +
+            config.receiveBytes)) {
+        return;
+    }
+    Setup::configServerChain(backend, config.hops);
+    int maxBytes = std::max(config.sendBytes, config.receiveBytes);
+    std::vector<char> buffer(maxBytes);
+    std::vector<char> verifyBuffer(config.verify ? maxBytes : 0);
+    char* receiveBuffer = config.verify ? verifyBuffer.data() : buffer.data();
+    HomaRpcBench::Payload::VerifyStats verifyStats;
+    if (config.verify) {
+        HomaRpcBench::Payload::fillPattern(buffer.data(), buffer.size(),
+                                           static_cast<uint32_t>(config.seed));
+    }
+    std::mt19937_64 generator(config.seed);
+
+    // Offer Poisson arrivals at rate ops/s, as a mixedRpc class would.
+    auto measure = [&](double rate) {
+        Mixed::TrafficClass<Backend> tc;
+        tc.name = "load";
+        tc.sendBytes = config.sendBytes;
+        tc.receiveBytes = config.receiveBytes;
+        tc.rate = rate;
+        tc.window = 1024;
+        tc.serverId = backend.serverId(0);
+        tc.server = backend.servers.front();
+        tc.nextArrival = 0;
+        tc.interArrival = std::exponential_distribution<double>(rate);
+        tc.outstanding = 0;
+        tc.sentBytes = 0;
+        tc.receivedBytes = 0;
+        Verify::initEchoRequest(config, buffer.data(), tc.sendBytes,
+                                tc.receiveBytes, &tc.request,
+                                &tc.expectedResponseCrc);
+        std::vector<Mixed::TrafficClass<Backend>> classes = {tc};
+
+        uint64_t start = HomaRpcBench::Clock::rdtsc();
+        uint64_t stop = Mixed::run(
+            config, backend, &classes, start,
+            HomaRpcBench::Clock::fromSeconds(config.loadStepDuration),
+            buffer.data(), receiveBuffer, maxBytes, &generator, &verifyStats);
+        Load::Point point;
+        point.offered = rate;
+        point.times = std::move(classes[0].times);
+        point.achieved = point.times.size() /
+                         HomaRpcBench::Clock::toSeconds(stop - start);
+        Output::TimeDist dist = Output::distribution(point.times);
+        point.sustained = dist.p99.count() <= config.loadSlo &&
+                          point.achieved >= config.loadTracking * rate;
+        point.searched = false;
+        return point;
+    };
+
+    std::vector<Load::Point> points;
+    double sustainedRate = 0;
+    double failedRate = 0;
+    double rate = config.loadStartRate;
+    for (int i = 0; i < Load::MAX_DOUBLINGS && failedRate == 0; ++i) {
+        points.push_back(measure(rate));
+        if (points.back().sustained) {
+            sustainedRate = rate;
+            rate *= 2;
+        } else {
+            failedRate = rate;
+        }
+    }
+    for (int i = 0; i < config.loadSearchSteps && failedRate > 0; ++i) {
+        rate = (sustainedRate + failedRate) / 2;
+        points.push_back(measure(rate));
+        points.back().searched = true;
+        if (points.back().sustained) {
+            sustainedRate = rate;
+        } else {
+            failedRate = rate;
+        }
+    }
+
+    std::sort(points.begin(), points.end(),
+              [](const Load::Point& a, const Load::Point& b) {
+                  return a.offered < b.offered;
+              });
+    std::cout << Output::basicHeader() << std::endl;
+    for (Load::Point& point : points) {
+        if (!point.searched) {
+            Output::record(
+                Output::format("loadCurve: send %dB message, receive %dB "
+                               "message, nested with %d hops, offered %.0f "
+                               "ops/s%s",
+                               config.sendBytes, config.receiveBytes,
+                               config.hops, point.offered, backend.describe()),
+                point.times, point.achieved);
+        }
+        std::string description = Output::format(
+            "send %dB message, receive %dB message, nested with %d hops, "
+            "offered %.0f ops/s, achieved %.0f ops/s%s%s",
+            config.sendBytes, config.receiveBytes, config.hops, point.offered,
+            point.achieved, backend.describe(),
+            point.sustained ? "" : ", not sustained");
+        std::cout << Output::basic(point.times, description) << std::endl;
+    }
+    std::string objective = Output::format(
+        "sustained means p99 within %s and at least %.0f%% of the offered "
+        "load achieved",
+        Output::formatTime(Output::Latency(config.loadSlo)).c_str(),
+        100 * config.loadTracking);
+    if (failedRate == 0) {
+        std::cout << Output::format("No knee up to %.0f ops/s offered; %s",
+                                    sustainedRate, objective.c_str())
+                  << std::endl;
+    } else {
+        std::cout << Output::format("Knee between %.0f and %.0f ops/s "
+                                    "offered; %s",
+                                    sustainedRate, failedRate,
+                                    objective.c_str())
+                  << std::endl;
+    }
+    Verify::printStats(verifyStats);
+    if (config.timetrace) {
+        PerfUtils::TimeTrace::print();
+        backend.dumpTimeTraces();
+    }
+}
+
+void
+loadCurve(Config& config)
+{
+    Backends::run(config,
+                  [&config](auto& backend) { loadCurve(config, backend); });
+}
+
+template <typename Backend>
+void
+coroutineRpc(Config& config, Backend& backend)
+{
+    if (config.readyChecks < 0) {
+        std::cerr << "--readyChecks must not be negative" << std::endl;
+        return;
+    }
+    if (!backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoRpc::Request) +
+            config.sendBytes) ||
+        !backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoRpc::Response) +
+            config.receiveBytes)) {
+        return;
+    }
+    if (!Setup::configServersForPolicy(config, backend)) {
+        return;
+    }
+    std::vector<char> requestPayload(config.sendBytes);
+    std::vector<char> responsePayload(config.receiveBytes);
+    if (config.verify) {
+        requestPayload.resize(std::max(config.sendBytes, config.receiveBytes));
+        HomaRpcBench::Payload::fillPattern(requestPayload.data(),
+                                           requestPayload.size(),
+                                           static_cast<uint32_t>(config.seed));
+    }
+
+    HomaRpcBench::Balancer::Selector selector(
+        config.policy, backend.servers.size(), config.seed, config.zipfSkew);
+
+    Async::EchoState<Backend> state;
+    state.config = &config;
+    state.servers = backend.servers;
+    state.selector = &selector;
+    Verify::initEchoRequest(config, requestPayload.data(), config.sendBytes,
+                            config.receiveBytes, &state.request,
+                            &state.expectedResponseCrc);
+    state.requestPayload = requestPayload.data();
+    state.responsePayload = responsePayload.data();
+    state.responseCapacity = responsePayload.size();
+    state.remaining = config.count;
+    state.times.reserve(config.count);
 
-struct Config {
-    Homa::Transport* transport;
-    int count;
-    ServerMap serverMap;
-    int hops;
-    int sendBytes;
-    int receiveBytes;
-    bool timetrace;
-};
+    Async::Scheduler<Backend> scheduler(backend.transport, config.readyChecks);
+    for (int i = 0; i < config.clients; ++i) {
+        scheduler.spawn(Async::echoClient(&scheduler, &state));
+    }
+    uint64_t start = HomaRpcBench::Clock::rdtsc();
+    scheduler.run();
+    double elapsed =
+        HomaRpcBench::Clock::toSeconds(HomaRpcBench::Clock::rdtsc() - start);
 
-struct TestCase {
-    const char* name;       // Name of the performance test; this is what gets
-                            // typed on the command line to run the test.
-    void (*func)(Config&);  // Function that implements the test.
-};
+    std::string parameters = Output::format(
+        "send %dB message, receive %dB message, nested with %d hops, "
+        "%d coroutine clients%s",
+        config.sendBytes, config.receiveBytes, config.hops, config.clients,
+        backend.describe());
+    std::string description =
+        parameters +
+        Output::format(", %.0f ops/s", state.times.size() / elapsed);
+    if (config.policy != HomaRpcBench::Balancer::FIRST) {
+        std::string policy = Output::format(
+            ", %s over %lu servers",
+            HomaRpcBench::Balancer::policyName(config.policy),
+            backend.servers.size());
+        parameters += policy;
+        description += policy;
+    }
+    std::string key = "coroutineRpc: " + parameters;
+    Output::record(key, state.times, state.times.size() / elapsed);
+    std::cout << Output::basicHeader() << std::endl;
+    std::cout << Output::basic(state.times, description) << std::endl;
+    // Ops found ready late carry the lag in their latency.
+    const typename Async::Scheduler<Backend>::ReadyLag& lag =
+        scheduler.getReadyLag();
+    std::cout << Output::format(
+                     "  readiness checks: %s per poll; ready ops noticed "
+                     "%.2f polls late on average, %lu at most",
+                     config.readyChecks == 0
+                         ? "all waiters"
+                         : std::to_string(config.readyChecks).c_str(),
+                     lag.ops == 0 ? 0.0
+                                  : static_cast<double>(lag.totalPolls) /
+                                        lag.ops,
+                     lag.maxPolls)
+              << std::endl;
+    if (config.policy != HomaRpcBench::Balancer::FIRST) {
+        printServers(backend, &selector, elapsed, key);
+    }
+    Verify::printStats(state.verifyStats);
+    if (config.timetrace) {
+        PerfUtils::TimeTrace::print();
+        backend.dumpTimeTraces();
+    }
+}
 
-namespace Setup {
+void
+coroutineRpc(Config& config)
+{
+    Backends::run(config,
+                  [&config](auto& backend) { coroutineRpc(config, backend); });
+}
 
+/**
+ * Closed-loop echo ops from --clients logical clients, coalesced into
+ * EchoBatchRpc messages by an AutoBatcher.  Sweeps the size window and
+ * reports the throughput and the latency of the individual ops, which
+ * includes the time they waited for their batch to be sent.
+ */
+template <typename Backend>
 void
-configServerChain(Config& config)
+batchRpc(Config& config, Backend& backend)
 {
-    if (config.hops > config.serverMap.size()) {
-        std::cerr << config.hops << " requested but only "
-                  << config.serverMap.size() << " servers." << std::endl;
-        throw;
+    using Batcher = HomaRpcBench::AutoBatcher<
+        std::remove_pointer_t<decltype(backend.transport)>,
+        typename Backend::RemoteOp, typename Backend::Address>;
+
+    std::vector<uint32_t> batchSizes;
+    std::stringstream sizeList(config.batchSizes);
+    std::string size;
+    while (std::getline(sizeList, size, ',')) {
+        int ops = 0;
+        size_t parsed = 0;
+        try {
+            ops = std::stoi(size, &parsed);
+        } catch (const std::exception&) {
+            parsed = 0;
+        }
+        if (parsed == 0 || parsed != size.size()) {
+            std::cerr << "Bad batch size \"" << size << "\" in --batchSizes"
+                      << std::endl;
+            return;
+        }
+        if (ops < 1) {
+            std::cerr << "Batch size " << ops << " must be at least 1"
+                      << std::endl;
+            return;
+        }
+        batchSizes.push_back(ops);
     }
-    Homa::Driver* driver = config.transport->driver;
+    if (batchSizes.empty()) {
+        std::cerr << "--batchSizes needs at least one size" << std::endl;
+        return;
+    }
+    if (config.clients < 1) {
+        std::cerr << "batchRpc needs at least 1 client" << std::endl;
+        return;
+    }
+    uint32_t largest =
+        *std::max_element(batchSizes.begin(), batchSizes.end());
+    if (!backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoBatchRpc::Request) +
+            largest *
+                (sizeof(HomaRpcBench::WireFormat::EchoBatchRpc::SubRequest) +
+                 config.sendBytes)) ||
+        !backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoBatchRpc::Response) +
+            largest *
+                (sizeof(HomaRpcBench::WireFormat::EchoBatchRpc::SubResponse) +
+                 config.receiveBytes))) {
+        return;
+    }
+    Setup::configServerChain(backend, 1);
+    HomaRpcBench::BufferPool::Buffer buffer =
+        config.bufferPool->acquire(config.sendBytes);
+    HomaRpcBench::BufferPool::Buffer receiveBuffer =
+        config.bufferPool->acquire(config.receiveBytes);
+    uint64_t delayCycles = HomaRpcBench::Clock::fromSeconds(config.batchDelay);
 
-    int i = 0;
-    auto entry = config.serverMap.begin();
-    while ((i < config.hops - 1) &&
-           std::next(entry) != config.serverMap.end()) {
-        HomaRpcBench::Rpc::configServer(config.transport, entry->second, true,
-                                        std::next(entry)->second);
-        ++i;
-        ++entry;
+    std::cout << Output::basicHeader() << std::endl;
+    for (uint32_t batchSize : batchSizes) {
+        Batcher batcher(backend.transport, backend.servers.front(), batchSize,
+                        delayCycles);
+        std::vector<Output::Latency> times;
+        times.reserve(config.count);
+        uint64_t start = HomaRpcBench::Clock::rdtsc();
+        uint64_t stop =
+            start + HomaRpcBench::Clock::fromSeconds(config.duration);
+        uint64_t now = start;
+        uint64_t submitted = 0;
+        uint64_t shortResponses = 0;
+        auto done = [&](uint64_t id, uint64_t latencyCycles,
+                        uint32_t responseBytes) {
+            times.emplace_back(HomaRpcBench::Clock::toSeconds(latencyCycles));
+            if (responseBytes != static_cast<uint32_t>(config.receiveBytes)) {
+                shortResponses++;
+            }
+        };
+        // Every client has one op outstanding; a completed op is replaced
+        // until the op count or the duration is reached.
+        size_t toSubmit = config.clients;
+        bool issuing = true;
+        while (issuing || batcher.outstanding() > 0) {
+            for (; toSubmit > 0 && issuing; --toSubmit) {
+                batcher.submit(submitted++, buffer.get(), config.sendBytes,
+                               config.receiveBytes);
+                issuing = submitted < static_cast<uint64_t>(config.count);
+            }
+            toSubmit += batcher.poll(receiveBuffer.get(),
+                                     receiveBuffer.capacity(), done);
+            now = HomaRpcBench::Clock::rdtsc();
+            issuing = issuing && now < stop;
+        }
+        double elapsed = HomaRpcBench::Clock::toSeconds(now - start);
+
+        std::string description = Output::format(
+            "send %dB, receive %dB, batches of up to %u ops (%.1f on "
+            "average, %.0f%% sent by the %.0f us window), %d clients, "
+            "%.0f ops/s, %.0f messages/s%s",
+            config.sendBytes, config.receiveBytes, batchSize,
+            batcher.meanBatchOps(), 100 * batcher.timedOutFraction(),
+            config.batchDelay * 1e6, config.clients, times.size() / elapsed,
+            times.size() / batcher.meanBatchOps() / elapsed,
+            backend.describe());
+        std::string key = Output::format(
+            "batchRpc: send %dB, receive %dB, batches of up to %u ops, "
+            "%.0f us window, %d clients%s",
+            config.sendBytes, config.receiveBytes, batchSize,
+            config.batchDelay * 1e6, config.clients, backend.describe());
+        Output::record(key, times, times.size() / elapsed);
+        std::cout << Output::basic(times, description) << std::endl;
+        if (shortResponses > 0) {
+            std::cerr << shortResponses << " ops got fewer than "
+                      << config.receiveBytes << " response bytes"
+                      << std::endl;
+        }
+    }
+    if (config.timetrace) {
+        PerfUtils::TimeTrace::print();
+        backend.dumpTimeTraces();
     }
-    HomaRpcBench::Rpc::configServer(config.transport, entry->second, false);
 }
 
-}  // namespace Setup
+void
+batchRpc(Config& config)
+{
+    Backends::run(config,
+                  [&config](auto& backend) { batchRpc(config, backend); });
+}
 
-namespace Benchmark {
+/**
+ * Keep a growing number of idle ops outstanding, held open by the servers
+ * (see HoldRpc), and measure what the client's transport calls cost and
+ * the latency of a stream of probe echo ops to the first server.  Costs
+ * that grow faster than the number of idle ops point at superlinear
+ * bookkeeping in the transport.
+ */
+template <typename Backend>
+void
+pollScaling(Config& config, Backend& backend)
+{
+    // Only one in this many transport calls is kept for the percentiles;
+    // the means cover them all.
+    static constexpr uint64_t CALL_SAMPLE_INTERVAL = 16;
+    // Most idle ops held open at once.
+    static constexpr int MAX_IDLE_OPS = 100000;
+
+    std::vector<int> idleCounts;
+    std::stringstream countList(config.idleOps);
+    std::string count;
+    while (std::getline(countList, count, ',')) {
+        int ops = 0;
+        size_t parsed = 0;
+        try {
+            ops = std::stoi(count, &parsed);
+        } catch (const std::exception&) {
+            parsed = 0;
+        }
+        if (parsed == 0 || parsed != count.size()) {
+            std::cerr << "Bad idle op count \"" << count << "\" in --idleOps"
+                      << std::endl;
+            return;
+        }
+        if (ops < 0 || ops > MAX_IDLE_OPS) {
+            std::cerr << "Idle op count " << ops << " is outside [0, "
+                      << MAX_IDLE_OPS << "]" << std::endl;
+            return;
+        }
+        idleCounts.push_back(ops);
+    }
+    if (idleCounts.empty()) {
+        std::cerr << "--idleOps needs at least one count" << std::endl;
+        return;
+    }
+    if (!backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoRpc::Request) +
+            config.sendBytes) ||
+        !backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoRpc::Response) +
+            config.receiveBytes)) {
+        return;
+    }
+    Setup::configServersStandalone(backend);
+    HomaRpcBench::BufferPool::Buffer buffer = config.bufferPool->acquire(
+        std::max(config.sendBytes, config.receiveBytes));
+    Config plainConfig = config;
+    plainConfig.verify = false;
+    HomaRpcBench::WireFormat::EchoRpc::Request request;
+    HomaRpcBench::WireFormat::EchoRpc::Response response;
+    uint32_t expectedResponseCrc;
+    Verify::initEchoRequest(plainConfig, buffer.get(), config.sendBytes,
+                            config.receiveBytes, &request,
+                            &expectedResponseCrc);
+    HomaRpcBench::WireFormat::HoldRpc::Request hold;
+    hold.common.opcode = HomaRpcBench::WireFormat::HoldRpc::opcode;
+    hold.release = false;
+    uint64_t stepCycles =
+        HomaRpcBench::Clock::fromSeconds(config.loadStepDuration);
+
+    /// Cost of one kind of transport call, in cycles.
+    struct CallCost {
+        std::vector<uint64_t> samples;
+        uint64_t calls;
+        uint64_t cycles;
+
+        void add(uint64_t callCycles)
+        {
+            if (calls++ % CALL_SAMPLE_INTERVAL == 0) {
+                samples.push_back(callCycles);
+            }
+            cycles += callCycles;
+        }
+
+        double mean() const
+        {
+            return calls == 0 ? 0 : double(cycles) / calls;
+        }
+
+        /// Mean and percentiles of the calls in cycles; these are not op
+        /// latencies, so they stay out of Output::basic() and the results
+        /// file.
+        std::string describe()
+        {
+            if (samples.empty()) {
+                return "no calls";
+            }
+            std::sort(samples.begin(), samples.end());
+            size_t count = samples.size();
+            return Output::format(
+                "%.0f cycles mean, p50 %lu, p90 %lu, p99 %lu, p999 %lu",
+                mean(), samples[count / 2], samples[count * 9 / 10],
+                samples[count * 99 / 100], samples[count * 999 / 1000]);
+        }
+    };
+
+    std::cout << Output::basicHeader() << std::endl;
+    int previousCount = 0;
+    double previousPollCycles = 0;
+    for (int idleCount : idleCounts) {
+        std::vector<std::unique_ptr<typename Backend::RemoteOp>> idleOps;
+        idleOps.reserve(idleCount);
+        for (int i = 0; i < idleCount; ++i) {
+            idleOps.push_back(std::make_unique<typename Backend::RemoteOp>(
+                backend.transport));
+            idleOps.back()->request->append(&hold, sizeof(hold));
+            idleOps.back()->send(
+                backend.servers[i % backend.servers.size()]);
+        }
+
+        std::vector<Output::Latency> probeTimes;
+        CallCost poll = {};
+        CallCost receive = {};
+        // Probe one op at a time; the first tenth of the step is not
+        // measured, so that the idle ops have reached the servers.  The step
+        // is stretched until a probe was measured, as many idle ops can keep
+        // the first probes queued behind them for longer than the step.
+        uint64_t start = HomaRpcBench::Clock::rdtsc();
+        uint64_t measureStart = start + stepCycles / 10;
+        uint64_t stop = measureStart + stepCycles;
+        uint64_t now = start;
+        while ((now < stop || probeTimes.empty()) &&
+               probeTimes.size() < static_cast<size_t>(config.count)) {
+            bool measured = now >= measureStart;
+            uint64_t probeStart = now;
+            typename Backend::RemoteOp op(backend.transport);
+            op.request->append(&request, sizeof(request));
+            op.request->append(buffer.get(), request.sentBytes);
+            op.send(backend.servers.front());
+            while (!op.isReady()) {
+                uint64_t pollStart = HomaRpcBench::Clock::rdtsc();
+                backend.transport->poll();
+                uint64_t pollStop = HomaRpcBench::Clock::rdtsc();
+                backend.transport->receiveServerOp();
+                uint64_t receiveStop = HomaRpcBench::Clock::rdtsc();
+                if (measured) {
+                    poll.add(pollStop - pollStart);
+                    receive.add(receiveStop - pollStop);
+                }
+            }
+            op.response->get(0, &response, sizeof(response));
+            now = HomaRpcBench::Clock::rdtsc();
+            if (measured) {
+                probeTimes.emplace_back(
+                    HomaRpcBench::Clock::toSeconds(now - probeStart));
+            }
+        }
+        double elapsed = HomaRpcBench::Clock::toSeconds(now - measureStart);
+
+        // Have the servers answer the idle ops, and wait for them all.
+        uint64_t heldOps = 0;
+        for (typename Backend::Address server : backend.servers) {
+            typename Backend::RemoteOp release(backend.transport);
+            HomaRpcBench::WireFormat::HoldRpc::Request releaseRequest = hold;
+            releaseRequest.release = true;
+            release.request->append(&releaseRequest, sizeof(releaseRequest));
+            release.send(server);
+            release.wait();
+            HomaRpcBench::WireFormat::HoldRpc::Response releaseResponse;
+            release.response->get(0, &releaseResponse,
+                                  sizeof(releaseResponse));
+            heldOps += releaseResponse.heldOps;
+        }
+        // Bounded, so that a lost answer cannot hang the remaining counts.
+        uint64_t drainDeadline = HomaRpcBench::Clock::rdtsc() +
+                                 HomaRpcBench::Clock::fromSeconds(5.0);
+        size_t answered = 0;
+        while (answered < idleOps.size() &&
+               HomaRpcBench::Clock::rdtsc() < drainDeadline) {
+            backend.transport->poll();
+            while (answered < idleOps.size() &&
+                   idleOps[answered]->isReady()) {
+                answered++;
+            }
+        }
+        size_t unanswered = idleOps.size() - answered;
+        if (heldOps != static_cast<uint64_t>(idleCount)) {
+            std::cerr << "The servers held " << heldOps << " of " << idleCount
+                      << " idle ops when the measurement ended" << std::endl;
+        }
+        if (unanswered > 0) {
+            std::cerr << unanswered << " of " << idleCount
+                      << " idle ops were not answered after the release"
+                      << std::endl;
+        }
+
+        Output::record(Output::format("pollScaling: %d idle ops: probe echo, "
+                                      "send %dB, receive %dB%s",
+                                      idleCount, config.sendBytes,
+                                      config.receiveBytes, backend.describe()),
+                       probeTimes, probeTimes.size() / elapsed);
+        std::cout << Output::basic(
+                         probeTimes,
+                         Output::format("%d idle ops: probe echo, send %dB, "
+                                        "receive %dB, %.0f probes/s%s",
+                                        idleCount, config.sendBytes,
+                                        config.receiveBytes,
+                                        probeTimes.size() / elapsed,
+                                        backend.describe()))
+                  << std::endl;
+        std::string growth;
+        if (previousCount > 0 && idleCount > previousCount &&
+            previousPollCycles > 0) {
+            growth = Output::format(
+                ", grows as idle ops^%.2f since %d",
+                std::log(poll.mean() / previousPollCycles) /
+                    std::log(double(idleCount) / previousCount),
+                previousCount);
+        }
+        std::cout << "  poll(): " << poll.describe() << growth << std::endl;
+        std::cout << "  receiveServerOp(): " << receive.describe()
+                  << std::endl;
+        previousCount = idleCount;
+        previousPollCycles = poll.mean();
+    }
+    if (config.timetrace) {
+        PerfUtils::TimeTrace::print();
+        backend.dumpTimeTraces();
+    }
+}
 
 void
-noop(Config&)
+pollScaling(Config& config)
 {
-    std::cout << "Nothing was done." << std::endl;
+    Backends::run(config,
+                  [&config](auto& backend) { pollScaling(config, backend); });
 }
 
+template <typename Backend>
 void
-serverList(Config& config)
+largeRpc(Config& config, Backend& backend)
 {
-    Homa::Driver* driver = config.transport->driver;
+    std::vector<int> sizes;
+    std::stringstream sizeList(config.sizes);
+    std::string size;
+    while (std::getline(sizeList, size, ',')) {
+        int bytes = 0;
+        size_t parsed = 0;
+        try {
+            bytes = std::stoi(size, &parsed);
+        } catch (const std::exception&) {
+            parsed = 0;
+        }
+        if (parsed == 0 || parsed != size.size()) {
+            std::cerr << "Bad message size \"" << size << "\" in --sizes"
+                      << std::endl;
+            return;
+        }
+        if (bytes < 0 || static_cast<size_t>(bytes) >
+                              HomaRpcBench::BufferPool::MAX_BUFFER_BYTES) {
+            std::cerr << "Message size " << bytes << " is outside [0, "
+                      << HomaRpcBench::BufferPool::MAX_BUFFER_BYTES << "]"
+                      << std::endl;
+            return;
+        }
+        sizes.push_back(bytes);
+    }
+    if (sizes.empty()) {
+        std::cerr << "--sizes needs at least one size" << std::endl;
+        return;
+    }
+    if (!backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoRpc::Request) +
+            *std::max_element(sizes.begin(), sizes.end())) ||
+        !backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::EchoRpc::Response) +
+            config.receiveBytes)) {
+        return;
+    }
+    Setup::configServerChain(backend, config.hops);
+    typename Backend::Address server = backend.servers.front();
 
-    std::cout << "Server List has " << config.serverMap.size() << " entries."
-              << std::endl;
-    for (auto entry : config.serverMap) {
-        std::cout << "Server " << entry.first << " at "
-                  << driver->addressToString(entry.second) << std::endl;
+    std::cout << Output::basicHeader() << std::endl;
+    for (int sendBytes : sizes) {
+        HomaRpcBench::BufferPool::Buffer buffer = config.bufferPool->acquire(
+            std::max(sendBytes, config.receiveBytes));
+        HomaRpcBench::WireFormat::EchoRpc::Request request;
+        HomaRpcBench::WireFormat::EchoRpc::Response response;
+        uint32_t expectedResponseCrc;
+        HomaRpcBench::Payload::VerifyStats verifyStats;
+        if (config.verify) {
+            HomaRpcBench::Payload::fillPattern(
+                buffer.get(), buffer.capacity(),
+                static_cast<uint32_t>(config.seed));
+        }
+        Verify::initEchoRequest(config, buffer.get(), sendBytes,
+                                config.receiveBytes, &request,
+                                &expectedResponseCrc);
+        // Responses must not overwrite the request pattern when verifying.
+        HomaRpcBench::BufferPool::Buffer receiveBuffer =
+            config.bufferPool->acquire(config.receiveBytes);
+
+        // Large sizes would take far too long for the full op count, so each
+        // size also stops after the configured duration.
+        std::vector<Output::Latency> times;
+        Perf::OpPhases phases(false, config.count);
+        uint64_t sizeStart = HomaRpcBench::Clock::rdtsc();
+        uint64_t sizeStop =
+            sizeStart + HomaRpcBench::Clock::fromSeconds(config.duration);
+        uint64_t stop = sizeStart;
+        for (int i = 0; i < config.count && stop < sizeStop; ++i) {
+            uint64_t start = HomaRpcBench::Clock::rdtsc();
+            phases.begin(start);
+            typename Backend::RemoteOp op(backend.transport);
+            phases.mark(Perf::CONSTRUCT);
+            op.request->append(&request, sizeof(request));
+            op.request->append(buffer.get(), request.sentBytes);
+            phases.mark(Perf::SERIALIZE);
+            op.send(server);
+            phases.mark(Perf::SEND);
+            op.wait();
+            phases.mark(Perf::WAIT);
+            op.response->get(0, &response, sizeof(response));
+            Verify::readResponsePayload(op.response, sizeof(response),
+                                        receiveBuffer.get(),
+                                        response.responseBytes,
+                                        receiveBuffer.capacity());
+            phases.mark(Perf::DESERIALIZE);
+            stop = HomaRpcBench::Clock::rdtsc();
+            times.emplace_back(HomaRpcBench::Clock::toSeconds(stop - start));
+            if (config.verify) {
+                Verify::checkEchoResponse(receiveBuffer.get(), response,
+                                          expectedResponseCrc, &verifyStats);
+            }
+            if (response.responseBytes != request.responseBytes) {
+                std::cerr << "Expected " << request.responseBytes
+                          << " bytes but got " << response.responseBytes
+                          << " bytes." << std::endl;
+            }
+        }
+        double elapsed = HomaRpcBench::Clock::toSeconds(stop - sizeStart);
+        std::string description = Output::format(
+            "send %dB message, receive %dB message, nested with %d hops, "
+            "%.0f ops/s, %.3f Gbps request goodput%s",
+            sendBytes, config.receiveBytes, config.hops,
+            times.size() / elapsed,
+            8.0 * sendBytes * times.size() / elapsed / 1e9,
+            backend.describe());
+        std::string key = Output::format(
+            "largeRpc: send %dB message, receive %dB message, nested with %d "
+            "hops%s",
+            sendBytes, config.receiveBytes, config.hops, backend.describe());
+        Output::record(key, times, times.size() / elapsed);
+        std::cout << Output::basic(times, description) << std::endl;
+        phases.print(key);
+        Verify::printStats(verifyStats);
     }
+    std::cout << "Buffer pool hugepage (MAP_HUGETLB) bytes: "
+              << config.bufferPool->getHugepageBytes() << std::endl;
 }
 
 void
-nestedRpc(Config& config)
+largeRpc(Config& config)
 {
-    Setup::configServerChain(config);
-    std::string description = Output::format(
-        "send %dB message, receive %dB message, nested with %d hops",
-        config.sendBytes, config.receiveBytes, config.hops);
-    std::vector<std::chrono::duration<double>> times;
-    char buffer[1024 * 1024];
+    Backends::run(config,
+                  [&config](auto& backend) { largeRpc(config, backend); });
+}
 
+/**
+ * Sweep the client's packet drop rate and report how the tail latency of
+ * nested echo ops and the recovery traffic grow with it.  Recovery packets
+ * are packets the client sent or received again with the same contents
+ * (see Faults::Stats::repeats); the servers' own counts are printed when
+ * they are run with --faults and exit.
+ */
+void
+lossRpc(Config& config)
+{
+    std::vector<double> rates;
+    std::stringstream rateList(config.lossRates);
+    std::string rate;
+    while (std::getline(rateList, rate, ',')) {
+        double probability = 0;
+        size_t parsed = 0;
+        try {
+            probability = std::stod(rate, &parsed);
+        } catch (const std::exception&) {
+            parsed = 0;
+        }
+        if (parsed == 0 || parsed != rate.size()) {
+            std::cerr << "Bad loss rate \"" << rate << "\" in --lossRates"
+                      << std::endl;
+            return;
+        }
+        if (probability < 0 || probability >= 1) {
+            std::cerr << "Loss rate " << probability << " is outside [0, 1)"
+                      << std::endl;
+            return;
+        }
+        rates.push_back(probability);
+    }
+    if (rates.empty()) {
+        std::cerr << "--lossRates needs at least one rate" << std::endl;
+        return;
+    }
+    Setup::configServerChain(config);
     Homa::Driver::Address server = config.serverMap.begin()->second;
+    HomaRpcBench::Faults::Driver* faultDriver = config.faultDriver;
+    const HomaRpcBench::Faults::Rules baseRules = faultDriver->getRules();
 
+    HomaRpcBench::BufferPool::Buffer buffer = config.bufferPool->acquire(
+        std::max(config.sendBytes, config.receiveBytes));
     HomaRpcBench::WireFormat::EchoRpc::Request request;
     HomaRpcBench::WireFormat::EchoRpc::Response response;
-    request.common.opcode = HomaRpcBench::WireFormat::EchoRpc::opcode;
-    request.sentBytes = config.sendBytes;
-    request.responseBytes = config.receiveBytes;
-
-    for (int i = 0; i < config.count; ++i) {
-        uint64_t start = PerfUtils::Cycles::rdtsc();
-        PerfUtils::TimeTrace::record(start, "Benchmark: +++ START +++");
+    uint32_t expectedResponseCrc;
+    Verify::initEchoRequest(config, buffer.get(), config.sendBytes,
+                            config.receiveBytes, &request,
+                            &expectedResponseCrc);
 
-        Homa::RemoteOp op(config.transport);
-        PerfUtils::TimeTrace::record("Benchmark: RemoteOp constructed");
-        op.request->append(&request, sizeof(request));
-        op.request->append(&buffer, request.sentBytes);
-        PerfUtils::TimeTrace::record("Benchmark: Request serialized");
-        op.send(server);
-        PerfUtils::TimeTrace::record("Benchmark: Request sent");
-
-        op.wait();
-        PerfUtils::TimeTrace::record("Benchmark: Response received");
-        op.response->get(0, &response, sizeof(response));
-        op.response->get(sizeof(response), &buffer, response.responseBytes);
-        PerfUtils::TimeTrace::record("Benchmark: Response deserialized");
-        uint64_t stop = PerfUtils::Cycles::rdtsc();
-        times.emplace_back(PerfUtils::Cycles::toSeconds(stop - start));
-        if (response.responseBytes != request.responseBytes) {
-            std::cerr << "Expected " << request.responseBytes
-                      << " bytes but got " << response.responseBytes
-                      << " bytes." << std::endl;
+    std::cout << Output::basicHeader() << std::endl;
+    for (double probability : rates) {
+        HomaRpcBench::Faults::Rules rules = baseRules;
+        for (auto& triggers : rules.triggers) {
+            triggers[HomaRpcBench::Faults::DROP] =
+                HomaRpcBench::Faults::Trigger();
+            triggers[HomaRpcBench::Faults::DROP].probability = probability;
         }
-        if (response.hopCount != config.hops) {
-            std::cerr << "Expected " << config.hops << " hops but got "
-                      << response.hopCount << " hops." << std::endl;
+        faultDriver->setRules(rules);
+        faultDriver->resetStats();
+
+        // Every lost packet costs a Homa timeout, so high rates also stop
+        // after the configured duration.
+        std::vector<Output::Latency> times;
+        Perf::OpPhases phases(false, config.count);
+        uint64_t rateStart = HomaRpcBench::Clock::rdtsc();
+        uint64_t rateStop =
+            rateStart + HomaRpcBench::Clock::fromSeconds(config.duration);
+        uint64_t stop = rateStart;
+        for (int i = 0; i < config.count && stop < rateStop; ++i) {
+            uint64_t start = HomaRpcBench::Clock::rdtsc();
+            phases.begin(start);
+            Homa::RemoteOp op(config.transport);
+            phases.mark(Perf::CONSTRUCT);
+            op.request->append(&request, sizeof(request));
+            op.request->append(buffer.get(), request.sentBytes);
+            phases.mark(Perf::SERIALIZE);
+            op.send(server);
+            phases.mark(Perf::SEND);
+            op.wait();
+            phases.mark(Perf::WAIT);
+            op.response->get(0, &response, sizeof(response));
+            phases.mark(Perf::DESERIALIZE);
+            stop = HomaRpcBench::Clock::rdtsc();
+            times.emplace_back(HomaRpcBench::Clock::toSeconds(stop - start));
+            if (response.responseBytes != request.responseBytes) {
+                std::cerr << "Expected " << request.responseBytes
+                          << " bytes but got " << response.responseBytes
+                          << " bytes." << std::endl;
+            }
         }
+        double elapsed = HomaRpcBench::Clock::toSeconds(stop - rateStart);
+        std::string description = Output::format(
+            "drop %.3f%% each way: %.3f%% of client packets lost, "
+            "%.3f recovery packets/op, %.0f ops/s",
+            100 * probability, 100 * faultDriver->lossRate(),
+            static_cast<double>(faultDriver->recoveryPackets()) /
+                times.size(),
+            times.size() / elapsed);
+        std::string key = Output::format(
+            "lossRpc: send %dB message, receive %dB message, drop %.3f%% "
+            "each way",
+            config.sendBytes, config.receiveBytes, 100 * probability);
+        Output::record(key, times, times.size() / elapsed);
+        std::cout << Output::basic(times, description) << std::endl;
+        phases.print(key);
     }
-    std::cout << Output::basicHeader() << std::endl;
-    std::cout << Output::basic(times, description) << std::endl;
+    faultDriver->setRules(baseRules);
     if (config.timetrace) {
         PerfUtils::TimeTrace::print();
-        for (auto server : config.serverMap) {
-            HomaRpcBench::Rpc::dumpTimeTrace(config.transport, server.second);
+        for (auto entry : config.serverMap) {
+            HomaRpcBench::Rpc::dumpTimeTrace(config.transport, entry.second);
         }
     }
 }
 
+template <typename Backend>
 void
-ringRpc(Config& config)
+goodput(Config& config, Backend& backend)
 {
-    Setup::configServerChain(config);
+    if (config.window < 1) {
+        std::cerr << "goodput needs a window of at least 1 message"
+                  << std::endl;
+        return;
+    }
+    if (!backend.checkMessageBytes(
+            sizeof(HomaRpcBench::WireFormat::GoodputRpc::Request) +
+            config.sendBytes)) {
+        return;
+    }
+    Setup::configServersStandalone(backend);
+    HomaRpcBench::BufferPool::Buffer payload =
+        config.bufferPool->acquire(config.sendBytes);
+
+    Async::GoodputState<Backend> state;
+    state.servers = backend.servers;
+    for (size_t i = 0; i < backend.servers.size(); ++i) {
+        HomaRpcBench::WireFormat::ServerStatsRpc::Response stats;
+        backend.getServerStats(i, true, &stats);
+    }
+    state.nextServer = 0;
+    state.request.common.opcode = HomaRpcBench::WireFormat::GoodputRpc::opcode;
+    state.request.sentBytes = config.sendBytes;
+    state.payload = payload.get();
+    state.messages = 0;
+    state.bytes = 0;
+
+    Async::Scheduler<Backend> scheduler(backend.transport);
+    for (int i = 0; i < config.window; ++i) {
+        scheduler.spawn(Async::goodputSender(&scheduler, &state));
+    }
+    uint64_t start = HomaRpcBench::Clock::rdtsc();
+    state.stopTime = start + HomaRpcBench::Clock::fromSeconds(config.duration);
+    scheduler.run();
+    uint64_t elapsedCycles = HomaRpcBench::Clock::rdtsc() - start;
+    double elapsed = HomaRpcBench::Clock::toSeconds(elapsedCycles);
+    if (state.times.empty()) {
+        std::cout << "No goodput messages completed" << std::endl;
+        return;
+    }
+
     std::string description = Output::format(
-        "send %dB message, receive %dB message, ring with %d hops",
-        config.sendBytes, config.receiveBytes, config.hops);
-    std::vector<std::chrono::duration<double>> times;
-    char buffer[1024 * 1024];
+        "send %dB one-way messages to %lu servers, %d in flight%s",
+        config.sendBytes, state.servers.size(), config.window,
+        backend.describe());
+    std::string key = "goodput: " + description;
+    Output::record(key, state.times, state.times.size() / elapsed);
+    std::cout << Output::basicHeader() << std::endl;
+    std::cout << Output::basic(state.times, description) << std::endl;
+    // The client polls continuously, so its whole thread is charged to the
+    // bytes it moved.
+    std::cout << Output::format(
+                     "client: %.3f Gbps, %.0f messages/s, %.3f cycles/byte",
+                     8.0 * state.bytes / elapsed / 1e9,
+                     state.messages / elapsed,
+                     static_cast<double>(elapsedCycles) / state.bytes)
+              << std::endl;
+    for (size_t i = 0; i < backend.servers.size(); ++i) {
+        HomaRpcBench::WireFormat::ServerStatsRpc::Response stats;
+        backend.getServerStats(i, false, &stats);
+        double active = stats.goodputActiveCycles / stats.cyclesPerSecond;
+        std::cout << Output::format(
+                         "server %lu: %.3f Gbps, %.0f messages/s, "
+                         "%.3f cycles/byte (polling thread), "
+                         "%.3f cycles/byte (handler)",
+                         backend.serverId(i),
+                         active > 0 ? 8.0 * stats.goodputBytes / active / 1e9
+                                    : 0.0,
+                         active > 0 ? stats.goodputMessages / active : 0.0,
+                         stats.goodputBytes > 0
+                             ? static_cast<double>(stats.goodputActiveCycles) /
+                                   stats.goodputBytes
+                             : 0.0,
+                         stats.goodputBytes > 0
+                             ? static_cast<double>(stats.goodputHandlerCycles) /
+                                   stats.goodputBytes
+                             : 0.0)
+                  << std::endl;
+    }
+}
 
-    Homa::Driver::Address server = config.serverMap.begin()->second;
+void
+goodput(Config& config)
+{
+    Backends::run(config,
+                  [&config](auto& backend) { goodput(config, backend); });
+}
 
-    HomaRpcBench::WireFormat::EchoMultiLevelRpc::Request request;
-    HomaRpcBench::WireFormat::EchoMultiLevelRpc::Response response;
-    request.common.opcode = HomaRpcBench::WireFormat::EchoMultiLevelRpc::opcode;
-    request.sentBytes = config.sendBytes;
-    request.responseBytes = config.receiveBytes;
+template <typename Backend>
+void
+replay(Config& config, Backend& backend)
+{
+    if (config.trace.empty()) {
+        std::cerr << "replay needs a --trace file" << std::endl;
+        return;
+    }
+    HomaRpcBench::Trace::Reader trace;
+    if (!trace.open(config.trace)) {
+        return;
+    }
+    if (backend.servers.empty()) {
+        std::cerr << "No servers enlisted" << std::endl;
+        return;
+    }
+    if (config.verify) {
+        std::cerr << "replay ignores --verify; checksumming every request "
+                     "would skew its timing"
+                  << std::endl;
+    }
 
-    for (int i = 0; i < config.count; ++i) {
-        uint64_t start = PerfUtils::Cycles::rdtsc();
-        PerfUtils::TimeTrace::record(start, "Benchmark: +++ START +++");
+    // Chain every server to the next, so that an op of h hops sent to
+    // server i is handled by servers i to i + h - 1 (see hopLimit).
+    Setup::configServerChain(backend, backend.servers.size());
+    const std::vector<typename Backend::Address>& servers = backend.servers;
+    uint32_t numServers = servers.size();
 
-        Homa::RemoteOp op(config.transport);
-        PerfUtils::TimeTrace::record("Benchmark: RemoteOp constructed");
-        op.request->append(&request, sizeof(request));
-        op.request->append(&buffer, request.sentBytes);
-        PerfUtils::TimeTrace::record("Benchmark: Request serialized");
-        op.send(server);
-        PerfUtils::TimeTrace::record("Benchmark: Request sent");
+    HomaRpcBench::WireFormat::EchoRpc::Request request;
+    uint32_t expectedResponseCrc;
+    Config plainConfig = config;
+    plainConfig.verify = false;
+    Verify::initEchoRequest(plainConfig, nullptr, 0, 0, &request,
+                            &expectedResponseCrc);
+    // Payload contents are irrelevant; one buffer serves every request and
+    // response and grows with the largest record seen.
+    HomaRpcBench::BufferPool::Buffer buffer;
 
-        op.wait();
-        PerfUtils::TimeTrace::record("Benchmark: Response received");
-        op.response->get(0, &response, sizeof(response));
-        op.response->get(sizeof(response), &buffer, response.responseBytes);
-        PerfUtils::TimeTrace::record("Benchmark: Response deserialized");
+    std::map<uint8_t, Replay::RecordClass> classes;
+    std::list<Replay::PendingOp<Backend>> pending;
+    uint64_t remapped = 0;
+    uint64_t clamped = 0;
+    uint64_t skipped = 0;
+    uint64_t hopErrors = 0;
+    uint64_t totalLag = 0;
+    uint64_t maxLag = 0;
+    size_t maxOutstanding = 0;
+    double cyclesPerNs = HomaRpcBench::Clock::perSecond() / 1e9;
 
-        uint64_t stop = PerfUtils::Cycles::rdtsc();
-        times.emplace_back(PerfUtils::Cycles::toSeconds(stop - start));
-        if (response.responseBytes != request.responseBytes) {
-            std::cerr << "Expected " << request.responseBytes
-                      << " bytes but got " << response.responseBytes
-                      << " bytes." << std::endl;
+    uint64_t next = 0;
+    uint64_t benchStart = HomaRpcBench::Clock::rdtsc();
+    uint64_t now = benchStart;
+    while (next < trace.size() || !pending.empty()) {
+        // Issue every record whose time has come.
+        while (next < trace.size()) {
+            HomaRpcBench::Trace::Record record = trace.get(next);
+            uint64_t arrival =
+                benchStart +
+                static_cast<uint64_t>(record.offsetNs * cyclesPerNs);
+            if (arrival > now) {
+                break;
+            }
+            ++next;
+            if (record.requestBytes >
+                    HomaRpcBench::BufferPool::MAX_BUFFER_BYTES ||
+                record.responseBytes >
+                    HomaRpcBench::BufferPool::MAX_BUFFER_BYTES ||
+                !backend.fitsMessage(sizeof(request) + record.requestBytes) ||
+                !backend.fitsMessage(
+                    sizeof(HomaRpcBench::WireFormat::EchoRpc::Response) +
+                    record.responseBytes)) {
+                skipped++;
+                continue;
+            }
+            uint32_t server = record.server;
+            if (server >= numServers) {
+                server %= numServers;
+                remapped++;
+            }
+            uint32_t hops = std::max<uint32_t>(record.hops, 1);
+            if (hops > numServers || server + hops > numServers) {
+                hops = std::min(hops, numServers);
+                server = std::min(server, numServers - hops);
+                clamped++;
+            }
+            size_t payloadBytes =
+                std::max(record.requestBytes, record.responseBytes);
+            if (payloadBytes > buffer.capacity()) {
+                buffer = config.bufferPool->acquire(payloadBytes);
+            }
+
+            request.sentBytes = record.requestBytes;
+            request.responseBytes = record.responseBytes;
+            request.hopLimit = hops;
+            pending.push_back(
+                {record.recordClass, hops, arrival,
+                 std::make_unique<typename Backend::RemoteOp>(
+                     backend.transport)});
+            typename Backend::RemoteOp* op = pending.back().op.get();
+            op->request->append(&request, sizeof(request));
+            op->request->append(buffer.get(), record.requestBytes);
+            op->send(servers[server]);
+            classes[record.recordClass].sentBytes += record.requestBytes;
+            uint64_t lag = now - arrival;
+            totalLag += lag;
+            maxLag = std::max(maxLag, lag);
         }
+        trace.release(next);
+        maxOutstanding = std::max(maxOutstanding, pending.size());
+
+        backend.transport->poll();
+        now = HomaRpcBench::Clock::rdtsc();
+
+        // Collect completed ops.
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (!it->op->isReady()) {
+                ++it;
+                continue;
+            }
+            HomaRpcBench::WireFormat::EchoRpc::Response response;
+            it->op->response->get(0, &response, sizeof(response));
+            Verify::readResponsePayload(it->op->response, sizeof(response),
+                                        buffer.get(), response.responseBytes,
+                                        buffer.capacity());
+            Replay::RecordClass& rc = classes[it->recordClass];
+            rc.times.emplace_back(
+                HomaRpcBench::Clock::toSeconds(now - it->start));
+            rc.receivedBytes += response.responseBytes;
+            if (response.hopCount != it->hops) {
+                hopErrors++;
+            }
+            it = pending.erase(it);
+        }
+    }
+    double elapsed = HomaRpcBench::Clock::toSeconds(now - benchStart);
+    uint64_t issued = trace.size() - skipped;
+
+    std::cout << Output::format(
+                     "replayed %lu of %lu records in %.3f s (%.0f ops/s), "
+                     "up to %lu in flight; issue lag mean %.2f us, "
+                     "max %.2f us",
+                     issued, trace.size(), elapsed, issued / elapsed,
+                     maxOutstanding,
+                     issued > 0 ? HomaRpcBench::Clock::toSeconds(totalLag) /
+                                      issued * 1e6
+                                : 0.0,
+                     HomaRpcBench::Clock::toSeconds(maxLag) * 1e6)
+              << std::endl;
+    if (skipped > 0 || remapped > 0 || clamped > 0 || hopErrors > 0) {
+        std::cerr << skipped << " records skipped (larger than "
+                  << HomaRpcBench::BufferPool::MAX_BUFFER_BYTES
+                  << " bytes or than a message of the transport), "
+                  << remapped
+                  << " mapped onto fewer servers, " << clamped
+                  << " had their chain shortened or moved to fit "
+                  << numServers << " servers, " << hopErrors
+                  << " returned an unexpected hop count" << std::endl;
     }
     std::cout << Output::basicHeader() << std::endl;
-    std::cout << Output::basic(times, description) << std::endl;
+    for (auto& entry : classes) {
+        Replay::RecordClass& rc = entry.second;
+        if (rc.times.empty()) {
+            continue;
+        }
+        std::string description = Output::format(
+            "trace class %u: %lu ops, mean send %.0fB, mean receive %.0fB%s",
+            entry.first, rc.times.size(),
+            static_cast<double>(rc.sentBytes) / rc.times.size(),
+            static_cast<double>(rc.receivedBytes) / rc.times.size(),
+            backend.describe());
+        Output::record(Output::format("replay: trace class %u%s", entry.first,
+                                      backend.describe()),
+                       rc.times);
+        std::cout << Output::basic(rc.times, description) << std::endl;
+    }
     if (config.timetrace) {
         PerfUtils::TimeTrace::print();
-        for (auto server : config.serverMap) {
-            HomaRpcBench::Rpc::dumpTimeTrace(config.transport, server.second);
-        }
+        backend.dumpTimeTraces();
     }
 }
 
+void
+replay(Config& config)
+{
+    Backends::run(config,
+                  [&config](auto& backend) { replay(config, backend); });
+}
+
 }  // namespace Benchmark
 
 TestCase tests[] = {
-    {"noop", Benchmark::noop},
-    {"serverList", Benchmark::serverList},
-    {"nestedRpc", Benchmark::nestedRpc},
-    {"ringRpc", Benchmark::ringRpc},
+    {"noop", Benchmark::noop, false, false},
+    {"serverList", Benchmark::serverList, false, false},
+    {"nestedRpc", Benchmark::nestedRpc, true, false},
+    {"ringRpc", Benchmark::ringRpc, true, false},
+    {"mixedRpc", Benchmark::mixedRpc, true, false},
+    {"loadCurve", Benchmark::loadCurve, true, false},
+    {"coroutineRpc", Benchmark::coroutineRpc, true, false},
+    {"batchRpc", Benchmark::batchRpc, true, false},
+    {"pollScaling", Benchmark::pollScaling, true, false},
+    {"largeRpc", Benchmark::largeRpc, true, false},
+    {"lossRpc", Benchmark::lossRpc, false, true},
+    {"goodput", Benchmark::goodput, true, false},
+    {"replay", Benchmark::replay, true, false},
 };
 
 volatile sig_atomic_t INTERRUPT_FLAG = 0;
@@ -228,6 +2890,119 @@ sig_int_handler(int sig)
     INTERRUPT_FLAG = 1;
 }
 
+/**
+ * Return the first test whose name contains testName, or nullptr.
+ */
+TestCase*
+findTest(const std::string& testName)
+{
+    for (TestCase& test : tests) {
+        if (std::strstr(test.name, testName.c_str()) != NULL) {
+            return &test;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Run the first test whose name contains testName.
+ */
+void
+runTest(Config& config, const std::string& testName)
+{
+    TestCase* test = findTest(testName);
+    if (test == nullptr) {
+        std::cout << "No test found matching the given arguments" << std::endl;
+        return;
+    }
+    if (config.socketTransport != nullptr && !test->sockets) {
+        std::cout << test->name << " does not support the socket backend"
+                  << std::endl;
+        return;
+    }
+    test->func(config);
+}
+
+#ifdef HOMARPCBENCH_SIMULATION
+/**
+ * The coordinator and the servers of a simulated run, each on its own host
+ * of a Sim::Network, and the host the client runs on.
+ */
+class SimCluster {
+  public:
+    explicit SimCluster(const HomaRpcBench::Sim::Config& simConfig)
+        : network(simConfig)
+        , coordinatorTransport()
+        , coordinator()
+        , serverTransports()
+        , servers()
+        , clientDriver(nullptr)
+        , coordinatorAddr(0)
+    {
+        HomaRpcBench::Sim::Driver* driver = network.addHost();
+        coordinatorTransport.reset(newTransport(driver));
+        coordinator.reset(
+            new HomaRpcBench::Coordinator(coordinatorTransport.get()));
+        coordinator->setQuiet(true);
+        HomaRpcBench::Coordinator* coordinatorPtr = coordinator.get();
+        network.setPoller(driver,
+                          [coordinatorPtr] { return coordinatorPtr->poll(); });
+        coordinatorAddr = driver->getLocalAddress();
+
+        // Each server enlists before the next is created, so server ids
+        // follow host order.
+        for (uint32_t i = 0; i < simConfig.servers; ++i) {
+            driver = network.addHost();
+            serverTransports.emplace_back(newTransport(driver));
+            servers.emplace_back(
+                new HomaRpcBench::Server(serverTransports.back().get()));
+            HomaRpcBench::Server* server = servers.back().get();
+            server->setQuiet(true);
+            server->setServerId(HomaRpcBench::Rpc::enlistServer(
+                serverTransports.back().get(), coordinatorAddr));
+            network.setPoller(driver, [server] { return server->poll(); });
+        }
+        clientDriver = network.addHost();
+    }
+
+    SimCluster(const SimCluster&) = delete;
+    SimCluster& operator=(const SimCluster&) = delete;
+
+    /// Driver of the host left for the client; it has no poller.
+    HomaRpcBench::Sim::Driver* getClientDriver()
+    {
+        return clientDriver;
+    }
+
+    Homa::Driver::Address getCoordinatorAddress() const
+    {
+        return coordinatorAddr;
+    }
+
+    const HomaRpcBench::Sim::Network& getNetwork() const
+    {
+        return network;
+    }
+
+  private:
+    static Homa::Transport* newTransport(Homa::Driver* driver)
+    {
+        return new Homa::Transport(
+            driver, std::hash<std::string>{}(
+                        driver->addressToString(driver->getLocalAddress())));
+    }
+
+    /// Declared first so that it outlives the transports of its hosts.
+    HomaRpcBench::Sim::Network network;
+    std::unique_ptr<Homa::Transport> coordinatorTransport;
+    std::unique_ptr<HomaRpcBench::Coordinator> coordinator;
+    std::vector<std::unique_ptr<Homa::Transport>> serverTransports;
+    std::vector<std::unique_ptr<HomaRpcBench::Server>> servers;
+    HomaRpcBench::Sim::Driver* clientDriver;
+    Homa::Driver::Address coordinatorAddr;
+};
+#endif
+
 int
 main(int argc, char* argv[])
 {
@@ -236,8 +3011,6 @@ main(int argc, char* argv[])
                        true,                    // show help if requested
                        "HomaRpcBench Client");  // version string
 
-    int port = args["<port>"].asLong();
-    std::string coordinator_mac = args["<coordinator_address>"].asString();
     int verboseLevel = args["--verbose"].asLong();
 
     // Set log level
@@ -261,39 +3034,228 @@ main(int argc, char* argv[])
     config.sendBytes = args["--sendBytes"].asLong();
     config.receiveBytes = args["--receiveBytes"].asLong();
     config.timetrace = args["--timetrace"].isString();
+    config.duration = std::stod(args["--duration"].asString());
+    config.seed = args["--seed"].asLong();
+    if (!HomaRpcBench::Balancer::parsePolicy(args["--policy"].asString(),
+                                             &config.policy)) {
+        return 1;
+    }
+    config.zipfSkew = std::stod(args["--zipf"].asString());
+    config.classes = args["--classes"].asString();
+    config.verify = args["--verify"].asBool();
+    config.perfCounters = args["--perfCounters"].asBool();
+    config.hopStamps = args["--hopStamps"].asBool();
+    config.flightTopN = -1;
+    config.flightSlowOp = 0;
+    if (args["--flightRecorder"].isString()) {
+        config.flightTopN = std::stoi(args["--flightRecorder"].asString());
+        if (args["--slowOp"].isString()) {
+            config.flightSlowOp =
+                std::stod(args["--slowOp"].asString()) / 1e6;
+        }
+        if (config.flightTopN < 0 || config.flightSlowOp < 0) {
+            std::cerr << "--flightRecorder and --slowOp must not be negative"
+                      << std::endl;
+            return 1;
+        }
+    }
+    config.clients = args["--clients"].asLong();
+    config.readyChecks = args["--readyChecks"].asLong();
+    config.idleOps = args["--idleOps"].asString();
+    config.batchSizes = args["--batchSizes"].asString();
+    config.batchDelay = std::stod(args["--batchDelayUs"].asString()) / 1e6;
+    config.sizes = args["--sizes"].asString();
+    config.window = args["--window"].asLong();
+    config.lossRates = args["--lossRates"].asString();
+    config.loadSlo = std::stod(args["--slo"].asString()) / 1e6;
+    config.loadStartRate = std::stod(args["--startRate"].asString());
+    config.loadStepDuration = std::stod(args["--stepDuration"].asString());
+    config.loadTracking = std::stod(args["--tracking"].asString());
+    config.loadSearchSteps = args["--searchSteps"].asLong();
+    if (config.loadStartRate <= 0 || config.loadStepDuration <= 0) {
+        std::cerr << "--startRate and --stepDuration must be positive"
+                  << std::endl;
+        return 1;
+    }
+    HomaRpcBench::Faults::Rules faultRules;
+    if (args["--faults"].isString()) {
+        if (args["--servers"].isString()) {
+            std::cerr << "--faults needs the Homa transport" << std::endl;
+            return 1;
+        }
+        if (!HomaRpcBench::Faults::parseRules(args["--faults"].asString(),
+                                              &faultRules)) {
+            return 1;
+        }
+    }
+    if (args["--trace"].isString()) {
+        config.trace = args["--trace"].asString();
+    }
+    for (int bytes : {config.sendBytes, config.receiveBytes}) {
+        if (bytes < 0 || static_cast<size_t>(bytes) >
+                              HomaRpcBench::BufferPool::MAX_BUFFER_BYTES) {
+            std::cerr << "Message size " << bytes << " is outside [0, "
+                      << HomaRpcBench::BufferPool::MAX_BUFFER_BYTES << "]"
+                      << std::endl;
+            return 1;
+        }
+    }
     if (config.timetrace) {
         std::string timetrace_log_path = args["--timetrace"].asString();
         timetrace_log_path += "/client-timetrace.log";
         PerfUtils::TimeTrace::setOutputFileName(timetrace_log_path.c_str());
+        uint32_t tracepoints;
+        if (!HomaRpcBench::Tracepoint::parseMask(
+                args["--tracepoints"].asString(), &tracepoints)) {
+            return 1;
+        }
+        HomaRpcBench::Tracepoint::setMask(tracepoints);
+    }
+    if (args["--results"].isString()) {
+        std::string resultsPath = args["--results"].asString();
+        Output::resultsFile = std::fopen(resultsPath.c_str(), "a");
+        if (Output::resultsFile == nullptr) {
+            std::cerr << "Cannot open results file " << resultsPath
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    config.transport = nullptr;
+    config.faultDriver = nullptr;
+    config.socketTransport = nullptr;
+    HomaRpcBench::BufferPool bufferPool;
+    config.bufferPool = &bufferPool;
+    const std::string testName = args["<bench>"].asString();
+
+    if (HomaRpcBench::Clock::VIRTUAL && !args["--simulate"].isString()) {
+        std::cerr << "The client_sim build only runs with --simulate"
+                  << std::endl;
+        return 1;
     }
+    int status = 0;
+    if (args["--servers"].isString()) {
+        // Kernel socket baseline; the servers are given directly, so there
+        // is no coordinator.
+        std::stringstream servers(args["--servers"].asString());
+        std::string server;
+        while (std::getline(servers, server, ',')) {
+            HomaRpcBench::Socket::Address address;
+            if (!HomaRpcBench::Socket::parseAddress(server, &address)) {
+                return 1;
+            }
+            config.socketServers.push_back(address);
+        }
+        std::string protocol = args["--protocol"].asString();
+        if (config.socketServers.empty() ||
+            (protocol != "tcp" && protocol != "udp")) {
+            std::cerr << "--servers needs at least one server and a "
+                         "protocol of tcp or udp"
+                      << std::endl;
+            return 1;
+        }
+        HomaRpcBench::Socket::Transport socketTransport(
+            protocol == "tcp" ? HomaRpcBench::Socket::Protocol::TCP
+                              : HomaRpcBench::Socket::Protocol::UDP,
+            HomaRpcBench::Socket::localAddressFor(config.socketServers[0]),
+            args["--busyPoll"].asBool());
+        config.socketTransport = &socketTransport;
+
+        signal(SIGINT, sig_int_handler);
+        runTest(config, testName);
+    } else if (args["--simulate"].isString()) {
+#ifdef HOMARPCBENCH_SIMULATION
+        HomaRpcBench::Sim::Config simConfig;
+        if (!HomaRpcBench::Sim::parseConfig(args["--simulate"].asString(),
+                                            &simConfig)) {
+            return 1;
+        }
+        simConfig.seed = config.seed;
+        if (config.timetrace) {
+            std::cerr << "--timetrace is not supported with --simulate"
+                      << std::endl;
+            return 1;
+        }
+        SimCluster cluster(simConfig);
+
+        TestCase* test = findTest(testName);
+        Homa::Driver* transportDriver = cluster.getClientDriver();
+        std::unique_ptr<HomaRpcBench::Faults::Driver> faultDriver;
+        if (args["--faults"].isString() || (test != nullptr && test->faults)) {
+            faultDriver.reset(new HomaRpcBench::Faults::Driver(
+                cluster.getClientDriver(), faultRules));
+            config.faultDriver = faultDriver.get();
+            transportDriver = faultDriver.get();
+        }
+        Homa::Transport transport(
+            transportDriver,
+            std::hash<std::string>{}(transportDriver->addressToString(
+                transportDriver->getLocalAddress())));
+        config.transport = &transport;
+        HomaRpcBench::Rpc::getServerList(
+            &transport, cluster.getCoordinatorAddress(), &config.serverMap);
 
-    Homa::Drivers::DPDK::DpdkDriver::Config driverConfig;
-    driverConfig.HIGHEST_PACKET_PRIORITY_OVERRIDE = 0;
-    Homa::Drivers::DPDK::DpdkDriver driver(port, &driverConfig);
-    Homa::Transport transport(
-        &driver, std::hash<std::string>{}(
-                     driver.addressToString(driver.getLocalAddress())));
-    config.transport = &transport;
+        signal(SIGINT, sig_int_handler);
+        runTest(config, testName);
+        std::cout << "Simulated network: " << cluster.getNetwork().summary()
+                  << std::endl;
+        if (!cluster.getNetwork().isReproducible()) {
+            // The results depend on how fast this run went; fail so that
+            // scripts do not take them as those of the seed.
+            std::cerr << "Not reproducible: "
+                      << cluster.getNetwork().getStats().repeats
+                      << " packets repeated an earlier one, so Homa's "
+                      << "real-clock timers fired" << std::endl;
+            status = 1;
+        }
+        if (args["--faults"].isString() && (test == nullptr || !test->faults)) {
+            std::cout << "Fault injection: " << faultDriver->summary()
+                      << std::endl;
+        }
+#else
+        std::cerr << "--simulate needs the client_sim build" << std::endl;
+        return 1;
+#endif
+    } else {
+        int port = args["<port>"].asLong();
+        std::string coordinator_mac =
+            args["<coordinator_address>"].asString();
 
-    Homa::Driver::Address coordinatorAddr = driver.getAddress(&coordinator_mac);
-    HomaRpcBench::Rpc::getServerList(&transport, coordinatorAddr,
-                                     &config.serverMap);
+        Homa::Drivers::DPDK::DpdkDriver::Config driverConfig;
+        driverConfig.HIGHEST_PACKET_PRIORITY_OVERRIDE = 0;
+        Homa::Drivers::DPDK::DpdkDriver driver(port, &driverConfig);
+        TestCase* test = findTest(testName);
+        Homa::Driver* transportDriver = &driver;
+        std::unique_ptr<HomaRpcBench::Faults::Driver> faultDriver;
+        if (args["--faults"].isString() || (test != nullptr && test->faults)) {
+            faultDriver.reset(
+                new HomaRpcBench::Faults::Driver(&driver, faultRules));
+            config.faultDriver = faultDriver.get();
+            transportDriver = faultDriver.get();
+        }
+        Homa::Transport transport(
+            transportDriver,
+            std::hash<std::string>{}(
+                driver.addressToString(driver.getLocalAddress())));
+        config.transport = &transport;
 
-    // Register the signal handler
-    signal(SIGINT, sig_int_handler);
+        Homa::Driver::Address coordinatorAddr =
+            driver.getAddress(&coordinator_mac);
+        HomaRpcBench::Rpc::getServerList(&transport, coordinatorAddr,
+                                         &config.serverMap);
 
-    bool foundTest = false;
-    const std::string testName = args["<bench>"].asString();
-    for (TestCase& test : tests) {
-        if (std::strstr(test.name, testName.c_str()) != NULL) {
-            foundTest = true;
-            test.func(config);
-            break;
+        // Register the signal handler
+        signal(SIGINT, sig_int_handler);
+
+        runTest(config, testName);
+        if (args["--faults"].isString() && (test == nullptr || !test->faults)) {
+            std::cout << "Fault injection: " << faultDriver->summary()
+                      << std::endl;
         }
     }
-    if (!foundTest) {
-        std::cout << "No test found matching the given arguments" << std::endl;
+    if (Output::resultsFile != nullptr) {
+        std::fclose(Output::resultsFile);
     }
 
-    return 0;
+    return status;
 }
\ No newline at end of file
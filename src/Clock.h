@@ -0,0 +1,87 @@
+#ifndef HOMARPCBENCH_CLOCK_H
+#define HOMARPCBENCH_CLOCK_H
+
+#include <cstdint>
+
+#include <PerfUtils/Cycles.h>
+
+namespace HomaRpcBench {
+
+/**
+ * Time source of the benchmarks, the servers and the helpers whose times
+ * reach the results.
+ *
+ * Reads the cycle counter through PerfUtils::Cycles, except in the
+ * simulation build (the client_sim target, which defines
+ * HOMARPCBENCH_SIMULATION), where time is the virtual time of the
+ * Sim::Network the whole run executes in.  Virtual time counts nanoseconds
+ * and only moves when the network says so, which is what makes a simulated
+ * run reproducible as long as the Homa library's own timers, which still
+ * read the real cycle counter, never fire (see Sim::Network); it also
+ * means that a simulated host does no work in zero time, so CPU costs
+ * (cycles per byte, poll() cycles) read 0 there.
+ * In every other build the functions compile to the PerfUtils calls.
+ */
+namespace Clock {
+
+#ifdef HOMARPCBENCH_SIMULATION
+inline constexpr bool VIRTUAL = true;
+
+/// Current virtual time in nanoseconds; advanced by Sim::Network only.
+inline uint64_t virtualNanoseconds = 0;
+
+inline uint64_t
+rdtsc()
+{
+    return virtualNanoseconds;
+}
+
+inline double
+perSecond()
+{
+    return 1e9;
+}
+
+inline double
+toSeconds(uint64_t cycles)
+{
+    return static_cast<double>(cycles) / 1e9;
+}
+
+inline uint64_t
+fromSeconds(double seconds)
+{
+    return static_cast<uint64_t>(seconds * 1e9 + 0.5);
+}
+#else
+inline constexpr bool VIRTUAL = false;
+
+inline uint64_t
+rdtsc()
+{
+    return PerfUtils::Cycles::rdtsc();
+}
+
+inline double
+perSecond()
+{
+    return PerfUtils::Cycles::perSecond();
+}
+
+inline double
+toSeconds(uint64_t cycles)
+{
+    return PerfUtils::Cycles::toSeconds(cycles);
+}
+
+inline uint64_t
+fromSeconds(double seconds)
+{
+    return PerfUtils::Cycles::fromSeconds(seconds);
+}
+#endif
+
+}  // namespace Clock
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_CLOCK_H
@@ -0,0 +1,402 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <docopt.h>
+
+#include "Output.h"
+
+static const char USAGE[] = R"(HomaRpcBench compare.
+
+    Compares the latency distributions saved by "client --results" in a
+    candidate run against a baseline run.  Results are matched by their
+    key, the benchmark and its configured parameters; a key may appear only
+    once per file.
+
+    For every result it reports bootstrapped deltas of the median, p99 and
+    p999 latency with 95% confidence intervals, the change in the ops/s the
+    benchmark achieved (a single measurement per run, so without an
+    interval; n/a for benchmarks that do not measure one), and a
+    Mann-Whitney U test of the two distributions.  A result regresses when
+    the test is significant and a latency interval lies entirely beyond the
+    threshold in the slower direction or throughput dropped by more than
+    the threshold, or when the interval of p99 or p999 lies beyond the
+    threshold on its own (a tail regression, which shifts too few samples
+    for the rank test to notice).
+
+    Exits with 1 if any candidate regresses, 2 on errors or if a result of
+    one file has no match in the other, and 0 otherwise.
+
+    Usage:
+        compare [options] <baseline> <candidate>...
+
+    Options:
+        -h --help           Show this screen.
+        --version           Show version.
+        --alpha=<p>         Significance level of the Mann-Whitney test
+                            [default: 0.01].
+        --threshold=<pct>   Smallest change, in percent, that counts as a
+                            regression or improvement [default: 5].
+        --bootstrap=<n>     Bootstrap resamples per statistic
+                            [default: 2000].
+        --seed=<n>          Seed for bootstrap resampling [default: 1].
+)";
+
+namespace HomaRpcBench {
+namespace Compare {
+
+/**
+ * One result of a run.
+ */
+struct Result {
+    /// Latency samples in seconds, sorted.
+    std::vector<double> samples;
+    /// Ops/s the benchmark achieved; 0 if it does not measure one.
+    double throughput;
+
+    Result()
+        : samples()
+        , throughput(0)
+    {}
+};
+
+/// Results of a run, keyed by result key.
+using Results = std::map<std::string, Result>;
+
+/**
+ * Load a results file written through Output::resultsFile.  Returns false
+ * and prints a message if the file cannot be read or is malformed.
+ */
+bool
+load(const std::string& path, Results* results)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        if (line.compare(0, 7, "result ") != 0) {
+            std::cerr << path << ": expected a result line" << std::endl;
+            return false;
+        }
+        std::string key = line.substr(7);
+        if (results->count(key) != 0) {
+            std::cerr << path << ": result \"" << key
+                      << "\" appears more than once" << std::endl;
+            return false;
+        }
+        Result& result = (*results)[key];
+        std::string sampleLine;
+        std::getline(file, sampleLine);
+        if (sampleLine.compare(0, 11, "throughput ") == 0) {
+            result.throughput = std::strtod(sampleLine.c_str() + 11, nullptr);
+            std::getline(file, sampleLine);
+        }
+        std::istringstream stream(sampleLine);
+        size_t count = 0;
+        stream >> count;
+        for (size_t i = 0; i < count; ++i) {
+            double sample;
+            if (!(stream >> sample)) {
+                std::cerr << path << ": result \"" << key
+                          << "\" is truncated" << std::endl;
+                return false;
+            }
+            result.samples.push_back(sample);
+        }
+    }
+    for (auto& entry : *results) {
+        std::sort(entry.second.samples.begin(), entry.second.samples.end());
+    }
+    return true;
+}
+
+/// Return the q-quantile of sorted samples.
+double
+quantile(const std::vector<double>& sorted, double q)
+{
+    size_t index = static_cast<size_t>(q * sorted.size());
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+/**
+ * Return the q-quantile of one bootstrap resample of sorted samples without
+ * building the resample: the k-th smallest of n ranks drawn uniformly with
+ * replacement is distributed as n * Beta(k, n - k + 1).
+ */
+double
+resampleQuantile(const std::vector<double>& sorted, double q,
+                 std::mt19937_64& generator)
+{
+    double n = sorted.size();
+    double k = std::max(1.0, std::ceil(q * n));
+    std::gamma_distribution<double> a(k, 1.0);
+    std::gamma_distribution<double> b(n - k + 1, 1.0);
+    double x = a(generator);
+    double y = b(generator);
+    size_t index = static_cast<size_t>(x / (x + y) * n);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+/**
+ * Relative change of a statistic between baseline and candidate, with a
+ * bootstrapped 95% confidence interval.
+ */
+struct Delta {
+    double estimate;
+    double low;
+    double high;
+};
+
+/**
+ * Compute the relative change of a statistic from its point estimates and
+ * from a function that draws the statistic of one resample of each run.
+ */
+template <typename ResampleFn>
+Delta
+bootstrap(double baseline, double candidate, int resamples,
+          ResampleFn resample)
+{
+    std::vector<double> deltas;
+    deltas.reserve(resamples);
+    for (int i = 0; i < resamples; ++i) {
+        std::pair<double, double> stats = resample();
+        deltas.push_back((stats.second - stats.first) / stats.first);
+    }
+    std::sort(deltas.begin(), deltas.end());
+    return {(candidate - baseline) / baseline, quantile(deltas, 0.025),
+            quantile(deltas, 0.975)};
+}
+
+/**
+ * Outcome of a two-sided Mann-Whitney U test.
+ */
+struct MannWhitney {
+    /// Two-sided p-value from the normal approximation with tie correction.
+    double pValue;
+    /// Probability that a candidate sample exceeds a baseline sample (ties
+    /// count half); above 0.5 means the candidate is slower.
+    double superiority;
+};
+
+MannWhitney
+mannWhitney(const std::vector<double>& baseline,
+            const std::vector<double>& candidate)
+{
+    double n1 = baseline.size();
+    double n2 = candidate.size();
+    double n = n1 + n2;
+    // Walk both sorted runs in merged order, giving tied values their
+    // average rank.
+    double rankSum = 0;
+    double tieTerm = 0;
+    double rank = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < baseline.size() || j < candidate.size()) {
+        double value;
+        if (j == candidate.size() ||
+            (i < baseline.size() && baseline[i] <= candidate[j])) {
+            value = baseline[i];
+        } else {
+            value = candidate[j];
+        }
+        double a = 0;
+        while (i < baseline.size() && baseline[i] == value) {
+            ++i;
+            ++a;
+        }
+        double b = 0;
+        while (j < candidate.size() && candidate[j] == value) {
+            ++j;
+            ++b;
+        }
+        double t = a + b;
+        rankSum += b * (rank + (t + 1) / 2);
+        tieTerm += t * t * t - t;
+        rank += t;
+    }
+    double u = rankSum - n2 * (n2 + 1) / 2;
+    double mean = n1 * n2 / 2;
+    double variance = n1 * n2 / 12 * ((n + 1) - tieTerm / (n * (n - 1)));
+    MannWhitney result;
+    result.superiority = u / (n1 * n2);
+    if (variance <= 0) {
+        result.pValue = 1.0;
+        return result;
+    }
+    double z = (std::fabs(u - mean) - 0.5) / std::sqrt(variance);
+    result.pValue = std::erfc(std::max(z, 0.0) / std::sqrt(2.0));
+    return result;
+}
+
+std::string
+formatDelta(const Delta& delta)
+{
+    return Output::format("%+6.1f%% [%+6.1f, %+6.1f]", delta.estimate * 100,
+                          delta.low * 100, delta.high * 100);
+}
+
+/**
+ * Outcome of comparing a candidate run against the baseline.
+ */
+struct Outcome {
+    /// Number of results that regressed.
+    int regressions;
+    /// Number of results found in only one of the two runs.
+    int unmatched;
+};
+
+/**
+ * Compare every result of a candidate run against the baseline and print
+ * one block per result.
+ */
+Outcome
+compare(const Results& baseline, const Results& candidate, double alpha,
+        double threshold, int resamples, std::mt19937_64& generator)
+{
+    Outcome outcome = {0, 0};
+    for (auto& entry : candidate) {
+        auto base = baseline.find(entry.first);
+        if (base == baseline.end()) {
+            std::cout << "  only in candidate: " << entry.first << std::endl;
+            outcome.unmatched++;
+            continue;
+        }
+        const std::vector<double>& b = base->second.samples;
+        const std::vector<double>& c = entry.second.samples;
+        if (b.size() < 2 || c.size() < 2) {
+            std::cout << "  too few samples: " << entry.first << std::endl;
+            continue;
+        }
+
+        MannWhitney test = mannWhitney(b, c);
+        std::vector<Delta> latency;
+        for (double q : {0.5, 0.99, 0.999}) {
+            latency.push_back(bootstrap(
+                quantile(b, q), quantile(c, q), resamples, [&]() {
+                    return std::make_pair(
+                        resampleQuantile(b, q, generator),
+                        resampleQuantile(c, q, generator));
+                }));
+        }
+        bool slower = false;
+        bool faster = false;
+        for (const Delta& delta : latency) {
+            slower |= delta.low > threshold;
+            faster |= delta.high < -threshold;
+        }
+        // Throughput is the achieved ops/s the benchmark recorded, not
+        // derived from latency: open-loop, pipelined and multi-client
+        // benchmarks overlap their ops.
+        std::string throughput = "n/a";
+        double bThroughput = base->second.throughput;
+        double cThroughput = entry.second.throughput;
+        if (bThroughput > 0 && cThroughput > 0) {
+            double change = (cThroughput - bThroughput) / bThroughput;
+            slower |= change < -threshold;
+            faster |= change > threshold;
+            throughput = Output::format("%+6.1f%%", change * 100);
+        }
+        bool slowerTail =
+            latency[1].low > threshold || latency[2].low > threshold;
+        const char* verdict = "no significant change";
+        if (test.pValue < alpha && test.superiority > 0.5 && slower) {
+            verdict = "REGRESSION";
+            outcome.regressions++;
+        } else if (slowerTail) {
+            verdict = "TAIL REGRESSION";
+            outcome.regressions++;
+        } else if (test.pValue < alpha && test.superiority < 0.5 && faster) {
+            verdict = "improvement";
+        }
+
+        std::cout << "  " << entry.first << std::endl;
+        std::cout << Output::format(
+                         "    samples %lu -> %lu, median %s -> %s, "
+                         "Mann-Whitney p=%.3g, P(slower)=%.3f: %s",
+                         b.size(), c.size(),
+                         Output::formatTime(Output::Latency(quantile(b, 0.5)))
+                             .c_str(),
+                         Output::formatTime(Output::Latency(quantile(c, 0.5)))
+                             .c_str(),
+                         test.pValue, test.superiority, verdict)
+                  << std::endl;
+        std::cout << Output::format(
+                         "    p50 %s  p99 %s  p999 %s  throughput %s",
+                         formatDelta(latency[0]).c_str(),
+                         formatDelta(latency[1]).c_str(),
+                         formatDelta(latency[2]).c_str(),
+                         throughput.c_str())
+                  << std::endl;
+    }
+    for (auto& entry : baseline) {
+        if (candidate.count(entry.first) == 0) {
+            std::cout << "  only in baseline: " << entry.first << std::endl;
+            outcome.unmatched++;
+        }
+    }
+    return outcome;
+}
+
+}  // namespace Compare
+}  // namespace HomaRpcBench
+
+int
+main(int argc, char* argv[])
+{
+    using namespace HomaRpcBench::Compare;
+
+    std::map<std::string, docopt::value> args =
+        docopt::docopt(USAGE, {argv + 1, argv + argc},
+                       true,                     // show help if requested
+                       "HomaRpcBench compare");  // version string
+    double alpha = std::stod(args["--alpha"].asString());
+    double threshold = std::stod(args["--threshold"].asString()) / 100;
+    int resamples = args["--bootstrap"].asLong();
+    std::mt19937_64 generator(args["--seed"].asLong());
+    if (resamples < 1) {
+        std::cerr << "--bootstrap must be at least 1" << std::endl;
+        return 2;
+    }
+
+    std::string baselinePath = args["<baseline>"].asString();
+    Results baseline;
+    if (!load(baselinePath, &baseline)) {
+        return 2;
+    }
+    int regressions = 0;
+    int unmatched = 0;
+    for (const std::string& candidatePath :
+         args["<candidate>"].asStringList()) {
+        Results candidate;
+        if (!load(candidatePath, &candidate)) {
+            return 2;
+        }
+        std::cout << candidatePath << " vs " << baselinePath << ":"
+                  << std::endl;
+        Outcome outcome = compare(baseline, candidate, alpha, threshold,
+                                  resamples, generator);
+        regressions += outcome.regressions;
+        unmatched += outcome.unmatched;
+    }
+    std::cout << regressions << " regression(s)" << std::endl;
+    if (unmatched > 0) {
+        std::cerr << unmatched << " result(s) without a match in the other run"
+                  << std::endl;
+        return 2;
+    }
+    return regressions > 0 ? 1 : 0;
+}
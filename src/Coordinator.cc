@@ -0,0 +1,84 @@
+#include "Coordinator.h"
+
+#include <iostream>
+
+namespace HomaRpcBench {
+
+/**
+ * Handle at most one request and make progress on the transport.
+ *
+ * @return
+ *      True if a request was handled.
+ */
+bool
+Coordinator::poll()
+{
+    Homa::ServerOp op = transport->receiveServerOp();
+    bool handled = static_cast<bool>(op);
+    if (op) {
+        dispatch(&op);
+    }
+    transport->poll();
+    return handled;
+}
+
+/**
+ * Stop logging every enlistment and server list request, for runs that
+ * enlist many servers.
+ */
+void
+Coordinator::setQuiet(bool quiet)
+{
+    this->quiet = quiet;
+}
+
+void
+Coordinator::dispatch(Homa::ServerOp* op)
+{
+    if (!Dispatcher::dispatch(this, op)) {
+        std::cerr << "Unknown opcode" << std::endl;
+    }
+}
+
+void
+Coordinator::handleEnlistRpc(
+    Homa::ServerOp* op, const WireFormat::EnlistServerRpc::Request& request)
+{
+    WireFormat::EnlistServerRpc::Response response;
+    uint64_t serverId = nextServerId++;
+    Homa::Driver::Address serverAddress =
+        transport->driver->getAddress(&request.address);
+    serverMap.insert({serverId, serverAddress});
+    response.common.opcode = WireFormat::EnlistServerRpc::opcode;
+    response.serverId = serverId;
+    op->response->append(&response, sizeof(response));
+    op->reply();
+    if (!quiet) {
+        std::cout << "Enlisted Server " << serverId << " at "
+                  << transport->driver->addressToString(serverAddress)
+                  << std::endl;
+    }
+}
+
+void
+Coordinator::handleGetServerList(
+    Homa::ServerOp* op, const WireFormat::GetServerListRpc::Request& request)
+{
+    WireFormat::GetServerListRpc::Response response;
+    response.common.opcode = WireFormat::GetServerListRpc::opcode;
+    response.num = serverMap.size();
+    op->response->append(&response, sizeof(response));
+    for (auto server = serverMap.begin(); server != serverMap.end(); ++server) {
+        WireFormat::GetServerListRpc::ServerListEntry entry;
+        entry.serverId = server->first;
+        transport->driver->addressToWireFormat(server->second, &entry.address);
+        op->response->append(&entry, sizeof(entry));
+    }
+    op->reply();
+    if (!quiet) {
+        std::cout << "Replied to getServerList with " << response.num
+                  << " entries." << std::endl;
+    }
+}
+
+}  // namespace HomaRpcBench
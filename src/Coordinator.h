@@ -0,0 +1,53 @@
+#ifndef HOMARPCBENCH_COORDINATOR_H
+#define HOMARPCBENCH_COORDINATOR_H
+
+#include <cstdint>
+#include <map>
+
+#include <Homa/Homa.h>
+
+#include "Dispatch.h"
+#include "WireFormat.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Contains the functionality of the Coordinator which keeps track of a list
+ * of Servers that can targeted by client benchmarks.
+ */
+class Coordinator {
+  public:
+    explicit Coordinator(Homa::Transport* transport)
+        : transport(transport)
+        , nextServerId(1)
+        , serverMap()
+        , quiet(false)
+    {}
+    bool poll();
+    void setQuiet(bool quiet);
+
+  private:
+    void dispatch(Homa::ServerOp* op);
+    void handleEnlistRpc(Homa::ServerOp* op,
+                         const WireFormat::EnlistServerRpc::Request& request);
+    void handleGetServerList(
+        Homa::ServerOp* op,
+        const WireFormat::GetServerListRpc::Request& request);
+
+    using Dispatcher = Dispatch::Table<
+        Coordinator, Homa::ServerOp,
+        Dispatch::Route<WireFormat::EnlistServerRpc,
+                        &Coordinator::handleEnlistRpc>,
+        Dispatch::Route<WireFormat::GetServerListRpc,
+                        &Coordinator::handleGetServerList>>;
+
+    Homa::Transport* transport;
+    uint64_t nextServerId;
+    std::map<uint64_t, Homa::Driver::Address> serverMap;
+    /// If set, enlistments and server list requests are not logged.
+    bool quiet;
+};
+
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_COORDINATOR_H
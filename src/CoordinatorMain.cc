@@ -1,6 +1,7 @@
 #include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 
 #include <signal.h>
 
@@ -9,7 +10,8 @@
 #include <Homa/Homa.h>
 #include <docopt.h>
 
-#include "WireFormat.h"
+#include "Coordinator.h"
+#include "Faults.h"
 
 static const char USAGE[] = R"(HomaRpcBench Coordinator.
 
@@ -20,98 +22,11 @@ static const char USAGE[] = R"(HomaRpcBench Coordinator.
         -h --help       Show this screen.
         --version       Show version.
         -v --verbose    Show verbose output.
+        --faults=<spec> Inject packet drops, delays, duplicates and
+                        reordering between Homa and the NIC, and print what
+                        was injected on exit; see src/Faults.h.
 )";
 
-namespace HomaRpcBench {
-
-/**
- * Contains the functionality of the Coordinator which keeps track of a list
- * of Servers that can targeted by client benchmarks.
- */
-class Coordinator {
-  public:
-    explicit Coordinator(Homa::Transport* transport)
-        : transport(transport)
-        , nextServerId(1)
-        , serverMap()
-    {}
-    void poll();
-
-  private:
-    void dispatch(Homa::ServerOp* op);
-    void handleEnlistRpc(Homa::ServerOp* op);
-    void handleGetServerList(Homa::ServerOp* op);
-    Homa::Transport* transport;
-    uint64_t nextServerId;
-    std::map<uint64_t, Homa::Driver::Address> serverMap;
-};
-
-void
-Coordinator::poll()
-{
-    Homa::ServerOp op = transport->receiveServerOp();
-    if (op) {
-        dispatch(&op);
-    }
-    transport->poll();
-}
-
-void
-Coordinator::dispatch(Homa::ServerOp* op)
-{
-    WireFormat::Common common;
-    op->request->get(0, &common, sizeof(common));
-
-    switch (common.opcode) {
-        case WireFormat::EnlistServerRpc::opcode:
-            handleEnlistRpc(op);
-            break;
-        case WireFormat::GetServerListRpc::opcode:
-            handleGetServerList(op);
-            break;
-        default:
-            std::cerr << "Unknown opcode" << std::endl;
-    }
-}
-
-void
-Coordinator::handleEnlistRpc(Homa::ServerOp* op)
-{
-    WireFormat::EnlistServerRpc::Request request;
-    WireFormat::EnlistServerRpc::Response response;
-    op->request->get(0, &request, sizeof(request));
-    uint64_t serverId = nextServerId++;
-    Homa::Driver::Address serverAddress =
-        transport->driver->getAddress(&request.address);
-    serverMap.insert({serverId, serverAddress});
-    response.common.opcode = WireFormat::EnlistServerRpc::opcode;
-    response.serverId = serverId;
-    op->response->append(&response, sizeof(response));
-    op->reply();
-    std::cout << "Enlisted Server " << serverId << " at "
-              << transport->driver->addressToString(serverAddress) << std::endl;
-}
-
-void
-Coordinator::handleGetServerList(Homa::ServerOp* op)
-{
-    WireFormat::GetServerListRpc::Response response;
-    response.common.opcode = WireFormat::GetServerListRpc::opcode;
-    response.num = serverMap.size();
-    op->response->append(&response, sizeof(response));
-    for (auto server = serverMap.begin(); server != serverMap.end(); ++server) {
-        WireFormat::GetServerListRpc::ServerListEntry entry;
-        entry.serverId = server->first;
-        transport->driver->addressToWireFormat(server->second, &entry.address);
-        op->response->append(&entry, sizeof(entry));
-    }
-    op->reply();
-    std::cout << "Replied to getServerList with " << response.num << " entries."
-              << std::endl;
-}
-
-}  // namespace HomaRpcBench
-
 volatile sig_atomic_t INTERRUPT_FLAG = 0;
 void
 sig_int_handler(int sig)
@@ -128,6 +43,12 @@ main(int argc, char* argv[])
                        "HomaRpcBench Coordinator");  // version string
     int port = args["<port>"].asLong();
     int verboseLevel = args["--verbose"].asLong();
+    HomaRpcBench::Faults::Rules faultRules;
+    if (args["--faults"].isString() &&
+        !HomaRpcBench::Faults::parseRules(args["--faults"].asString(),
+                                          &faultRules)) {
+        return 1;
+    }
 
     // Set log level
     Homa::Debug::setLogPolicy(Homa::Debug::logPolicyFromString("SILENT"));
@@ -147,9 +68,17 @@ main(int argc, char* argv[])
     Homa::Drivers::DPDK::DpdkDriver::Config driverConfig;
     driverConfig.HIGHEST_PACKET_PRIORITY_OVERRIDE = 0;
     Homa::Drivers::DPDK::DpdkDriver driver(port, &driverConfig);
+    Homa::Driver* transportDriver = &driver;
+    std::unique_ptr<HomaRpcBench::Faults::Driver> faultDriver;
+    if (args["--faults"].isString()) {
+        faultDriver.reset(
+            new HomaRpcBench::Faults::Driver(&driver, faultRules));
+        transportDriver = faultDriver.get();
+    }
     Homa::Transport transport(
-        &driver, std::hash<std::string>{}(
-                     driver.addressToString(driver.getLocalAddress())));
+        transportDriver,
+        std::hash<std::string>{}(
+            driver.addressToString(driver.getLocalAddress())));
     HomaRpcBench::Coordinator coordinator(&transport);
 
     // Register the signal handler
@@ -161,6 +90,10 @@ main(int argc, char* argv[])
         }
         coordinator.poll();
     }
+    if (faultDriver) {
+        std::cout << "Fault injection: " << faultDriver->summary()
+                  << std::endl;
+    }
 
     return 0;
 }
\ No newline at end of file
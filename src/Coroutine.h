@@ -0,0 +1,425 @@
+#ifndef HOMARPCBENCH_COROUTINE_H
+#define HOMARPCBENCH_COROUTINE_H
+
+#include <algorithm>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "Clock.h"
+
+namespace HomaRpcBench {
+
+/**
+ * C++20 coroutine layer over Homa::RemoteOp (or Socket::RemoteOp; the
+ * transport types are template parameters, as in AutoBatcher).
+ *
+ * Benchmarks are written as straight-line coroutines that co_await their
+ * RemoteOps; a single Scheduler drives Transport::poll() and resumes each
+ * coroutine once the op it waits on is ready, so thousands of logical
+ * clients can share one thread:
+ *
+ *     using Scheduler = Coroutine::Scheduler<Homa::Transport, Homa::RemoteOp>;
+ *     using RemoteOp = Coroutine::RemoteOp<Homa::Transport, Homa::RemoteOp,
+ *                                          Homa::Driver::Address>;
+ *
+ *     Coroutine::Task
+ *     client(Scheduler* scheduler, Homa::Driver::Address server)
+ *     {
+ *         RemoteOp op(scheduler);
+ *         op->request->append(...);
+ *         co_await op.send(server);
+ *         co_await op.response();
+ *         op->response->get(...);
+ *     }
+ */
+namespace Coroutine {
+
+template <typename Transport, typename Op>
+class Scheduler;
+
+/**
+ * Top-level coroutine run by a Scheduler.  A Task does not start until it is
+ * handed to Scheduler::spawn() and is destroyed by the Scheduler when it
+ * finishes.
+ */
+class Task {
+  public:
+    struct promise_type {
+        Task get_return_object()
+        {
+            return Task(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+        std::suspend_always final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+
+    Task(Task&& other)
+        : handle(other.handle)
+    {
+        other.handle = nullptr;
+    }
+
+    ~Task()
+    {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+  private:
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : handle(handle)
+    {}
+
+    /// Frame of the coroutine; owned by this Task until it is spawned.
+    std::coroutine_handle<promise_type> handle;
+
+    template <typename Transport, typename Op>
+    friend class Scheduler;
+};
+
+/**
+ * Runs Tasks on the calling thread, resuming each when the RemoteOp (an
+ * Op polled by a Transport) or timer it waits on is ready.
+ */
+template <typename Transport, typename Op>
+class Scheduler {
+  public:
+    /**
+     * How late ready RemoteOps were noticed: the polls that ran after the
+     * last check of a waiter that was not ready and before the check that
+     * found it ready.  The transport does not say which ops a poll
+     * completed, so with a readiness check budget an op may complete while
+     * its waiter is not checked.
+     */
+    struct ReadyLag {
+        /// Ready ops noticed.
+        uint64_t ops;
+        uint64_t totalPolls;
+        uint64_t maxPolls;
+
+        ReadyLag()
+            : ops(0)
+            , totalPolls(0)
+            , maxPolls(0)
+        {}
+    };
+
+    /**
+     * @param readyChecksPerPoll
+     *      Most waiting RemoteOps checked for readiness after each poll,
+     *      taken round-robin; 0 checks every waiter, which costs O(waiters)
+     *      per poll but notices every ready op after the poll that made it
+     *      ready.
+     */
+    explicit Scheduler(Transport* transport, size_t readyChecksPerPoll = 0)
+        : transport(transport)
+        , readyChecksPerPoll(readyChecksPerPoll)
+        , runnable()
+        , waiting()
+        , nextCheck(0)
+        , timers()
+        , liveTasks(0)
+        , pollCount(0)
+        , readyLag()
+    {}
+
+    ~Scheduler()
+    {
+        // Frames of tasks that never finished; destroying a suspended frame
+        // also destroys the RemoteOps it holds.
+        for (Waiter& waiter : waiting) {
+            waiter.handle.destroy();
+        }
+        while (!timers.empty()) {
+            timers.top().handle.destroy();
+            timers.pop();
+        }
+        for (std::coroutine_handle<> handle : runnable) {
+            handle.destroy();
+        }
+    }
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    /**
+     * Take ownership of a Task and make it runnable.
+     */
+    void spawn(Task task)
+    {
+        runnable.push_back(task.handle);
+        task.handle = nullptr;
+        liveTasks++;
+    }
+
+    /**
+     * Run until every spawned Task has finished.
+     */
+    void run()
+    {
+        while (liveTasks > 0) {
+            runOnce();
+        }
+    }
+
+    /**
+     * Poll the transport once and resume the Tasks that became ready: those
+     * whose timer expired, and those among the waiters checked (see the
+     * constructor) whose RemoteOp is ready.
+     */
+    void runOnce()
+    {
+        transport->poll();
+        pollCount++;
+
+        size_t checks = waiting.size();
+        if (readyChecksPerPoll == 0) {
+            // One pass from the start sees each waiter once.
+            nextCheck = 0;
+        } else {
+            checks = std::min(checks, readyChecksPerPoll);
+        }
+        for (size_t i = 0; i < checks && !waiting.empty(); ++i) {
+            if (nextCheck >= waiting.size()) {
+                nextCheck = 0;
+            }
+            Waiter& waiter = waiting[nextCheck];
+            if (waiter.op->isReady()) {
+                // checkedPoll is this poll if the budget wrapped around to a
+                // waiter already checked in this pass.
+                uint64_t lag =
+                    pollCount - std::min(waiter.checkedPoll + 1, pollCount);
+                readyLag.ops++;
+                readyLag.totalPolls += lag;
+                readyLag.maxPolls = std::max(readyLag.maxPolls, lag);
+                runnable.push_back(waiter.handle);
+                waiter = waiting.back();
+                waiting.pop_back();
+            } else {
+                waiter.checkedPoll = pollCount;
+                ++nextCheck;
+            }
+        }
+        if (!timers.empty()) {
+            uint64_t now = Clock::rdtsc();
+            while (!timers.empty() && timers.top().wakeTime <= now) {
+                runnable.push_back(timers.top().handle);
+                timers.pop();
+            }
+        }
+
+        // Tasks resumed here may make others runnable; those wait for the
+        // next call so every pass also polls the transport.
+        size_t count = runnable.size();
+        for (size_t i = 0; i < count; ++i) {
+            std::coroutine_handle<> handle = runnable.front();
+            runnable.pop_front();
+            handle.resume();
+            if (handle.done()) {
+                handle.destroy();
+                liveTasks--;
+            }
+        }
+    }
+
+    /// Number of Tasks spawned that have not yet finished.
+    size_t getLiveTasks() const
+    {
+        return liveTasks;
+    }
+
+    /// Number of times the transport has been polled.
+    uint64_t getPollCount() const
+    {
+        return pollCount;
+    }
+
+    size_t getReadyChecksPerPoll() const
+    {
+        return readyChecksPerPoll;
+    }
+
+    const ReadyLag& getReadyLag() const
+    {
+        return readyLag;
+    }
+
+    /**
+     * Awaitable that suspends the calling Task until the given cycle time.
+     */
+    struct SleepAwaiter {
+        Scheduler* scheduler;
+        uint64_t wakeTime;
+
+        bool await_ready() const
+        {
+            return Clock::rdtsc() >= wakeTime;
+        }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            scheduler->timers.push({wakeTime, handle});
+        }
+        void await_resume() {}
+    };
+
+    SleepAwaiter sleepUntil(uint64_t wakeTime)
+    {
+        return {this, wakeTime};
+    }
+
+    /**
+     * Awaitable that lets every other runnable Task run before the caller
+     * continues.
+     */
+    struct YieldAwaiter {
+        Scheduler* scheduler;
+
+        bool await_ready() const
+        {
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            scheduler->runnable.push_back(handle);
+        }
+        void await_resume() {}
+    };
+
+    YieldAwaiter yield()
+    {
+        return {this};
+    }
+
+  private:
+    struct Waiter {
+        Op* op;
+        std::coroutine_handle<> handle;
+        /// Poll count when the op was last found not ready (or when it
+        /// started waiting).
+        uint64_t checkedPoll;
+    };
+
+    struct Timer {
+        uint64_t wakeTime;
+        std::coroutine_handle<> handle;
+
+        bool operator>(const Timer& other) const
+        {
+            return wakeTime > other.wakeTime;
+        }
+    };
+
+    void waitFor(Op* op, std::coroutine_handle<> handle)
+    {
+        waiting.push_back({op, handle, pollCount});
+    }
+
+    Transport* const transport;
+    /// See the constructor.
+    const size_t readyChecksPerPoll;
+    /// Tasks ready to be resumed, in order.
+    std::deque<std::coroutine_handle<>> runnable;
+    /// Tasks suspended until their RemoteOp is ready.
+    std::vector<Waiter> waiting;
+    /// Index in waiting of the next waiter runOnce() checks.
+    size_t nextCheck;
+    /// Tasks suspended until a cycle time, earliest first.
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    size_t liveTasks;
+    uint64_t pollCount;
+    ReadyLag readyLag;
+
+    template <typename, typename, typename>
+    friend class RemoteOp;
+};
+
+/**
+ * Op whose send and response can be co_awaited from a Task run by the
+ * given Scheduler.
+ */
+template <typename Transport, typename Op, typename Address>
+class RemoteOp {
+  public:
+    explicit RemoteOp(Scheduler<Transport, Op>* scheduler)
+        : scheduler(scheduler)
+        , op(scheduler->transport)
+    {}
+
+    Op* operator->()
+    {
+        return &op;
+    }
+
+    /**
+     * Awaitable that sends the request.  Both transports send
+     * asynchronously, so this never suspends; it exists so that callers
+     * read as straight-line code.
+     */
+    struct SendAwaiter {
+        Op* op;
+        Address destination;
+
+        bool await_ready()
+        {
+            op->send(destination);
+            return true;
+        }
+        void await_suspend(std::coroutine_handle<>) {}
+        void await_resume() {}
+    };
+
+    SendAwaiter send(Address destination)
+    {
+        return {&op, destination};
+    }
+
+    /**
+     * Awaitable that suspends the calling Task until the response has
+     * arrived.
+     */
+    struct ResponseAwaiter {
+        RemoteOp* remoteOp;
+
+        bool await_ready()
+        {
+            return remoteOp->op.isReady();
+        }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            remoteOp->scheduler->waitFor(&remoteOp->op, handle);
+        }
+        void await_resume() {}
+    };
+
+    ResponseAwaiter response()
+    {
+        return {this};
+    }
+
+  private:
+    Scheduler<Transport, Op>* const scheduler;
+    Op op;
+};
+
+}  // namespace Coroutine
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_COROUTINE_H
@@ -0,0 +1,152 @@
+#ifndef HOMARPCBENCH_DISPATCH_H
+#define HOMARPCBENCH_DISPATCH_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "WireFormat.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Compile-time RPC dispatch.
+ *
+ * A service lists a Route for each WireFormat RPC it serves, naming the
+ * member function that handles it:
+ *
+ *     void handleEchoRpc(Homa::ServerOp* op,
+ *                        const WireFormat::EchoRpc::Request& request);
+ *
+ *     using Dispatcher = Dispatch::Table<
+ *         Server, Homa::ServerOp,
+ *         Dispatch::Route<WireFormat::EchoRpc, &Server::handleEchoRpc>,
+ *         ...>;
+ *
+ * The Table builds a constexpr jump table indexed by opcode.  The request
+ * header is copied out of the message once, into a buffer large enough for
+ * any listed request, and handed to the handler as a typed view, so handlers
+ * no longer re-read the header themselves.  Adding an RPC only requires
+ * adding its WireFormat struct, its handler and its entry in the list.
+ */
+namespace Dispatch {
+
+/**
+ * Binds a WireFormat RPC struct to the member function of a service that
+ * handles it.
+ *
+ * @tparam RpcType
+ *      WireFormat RPC struct with a static opcode and a Request struct
+ *      beginning with WireFormat::Common.
+ * @tparam HandlerMethod
+ *      Pointer to a member function of the service taking (Op*, const
+ *      RpcType::Request&).
+ */
+template <typename RpcType, auto HandlerMethod>
+struct Route {
+    using Rpc = RpcType;
+    static constexpr auto handler = HandlerMethod;
+    static_assert(Rpc::opcode < WireFormat::ILLEGAL_OPCODE,
+                  "RPC opcode out of range");
+};
+
+/**
+ * Returns true if no two of the given opcodes are the same.
+ */
+template <std::size_t N>
+constexpr bool
+uniqueOpcodes(const std::array<uint16_t, N>& opcodes)
+{
+    for (std::size_t i = 0; i < N; ++i) {
+        for (std::size_t j = i + 1; j < N; ++j) {
+            if (opcodes[i] == opcodes[j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Jump table dispatching incoming ops of type Op to the handlers of Service
+ * given by the listed Routes.
+ *
+ * @tparam Service
+ *      Class whose member functions handle the RPCs.
+ * @tparam Op
+ *      Type of op being dispatched; must provide request->get() like
+ *      Homa::ServerOp.
+ * @tparam Routes
+ *      One Route per RPC served.
+ */
+template <typename Service, typename Op, typename... Routes>
+class Table {
+  public:
+    static_assert(sizeof...(Routes) > 0, "Table needs at least one Route");
+    static_assert(uniqueOpcodes<sizeof...(Routes)>(
+                      {static_cast<uint16_t>(Routes::Rpc::opcode)...}),
+                  "Two RPCs in a dispatch Table share an opcode");
+
+    /// Number of bytes copied out of each request: the largest request
+    /// header of any routed RPC.
+    static constexpr uint32_t HEADER_BYTES =
+        std::max({sizeof(WireFormat::Common),
+                  sizeof(typename Routes::Rpc::Request)...});
+
+    /**
+     * Copy the request header out of the op and call the matching handler.
+     *
+     * @return
+     *      False if the opcode is unknown or the request is too short for
+     *      the header of its RPC; the op is left untouched in that case.
+     */
+    static bool dispatch(Service* service, Op* op)
+    {
+        alignas(8) char header[HEADER_BYTES];
+        uint32_t length = op->request->get(0, header, HEADER_BYTES);
+        if (length < sizeof(WireFormat::Common)) {
+            return false;
+        }
+        uint16_t opcode =
+            reinterpret_cast<const WireFormat::Common*>(header)->opcode;
+        if (opcode >= NUM_OPCODES || table[opcode].handler == nullptr ||
+            length < table[opcode].headerBytes) {
+            return false;
+        }
+        table[opcode].handler(service, op, header);
+        return true;
+    }
+
+  private:
+    using Handler = void (*)(Service*, Op*, const char*);
+
+    struct Entry {
+        Handler handler;
+        uint32_t headerBytes;
+    };
+
+    static constexpr std::size_t NUM_OPCODES = WireFormat::ILLEGAL_OPCODE;
+
+    template <typename R>
+    static void invoke(Service* service, Op* op, const char* header)
+    {
+        (service->*R::handler)(
+            op, *reinterpret_cast<const typename R::Rpc::Request*>(header));
+    }
+
+    static constexpr std::array<Entry, NUM_OPCODES> makeTable()
+    {
+        std::array<Entry, NUM_OPCODES> entries{};
+        ((entries[Routes::Rpc::opcode] =
+              Entry{&invoke<Routes>, sizeof(typename Routes::Rpc::Request)}),
+         ...);
+        return entries;
+    }
+
+    static constexpr std::array<Entry, NUM_OPCODES> table = makeTable();
+};
+
+}  // namespace Dispatch
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_DISPATCH_H
@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <PerfUtils/Cycles.h>
+#include <docopt.h>
+
+#include "Dispatch.h"
+#include "Output.h"
+#include "WireFormat.h"
+
+static const char USAGE[] = R"(HomaRpcBench dispatch_bench.
+
+    Compares the cost of dispatching server requests through the compile-time
+    Dispatch::Table with the switch-based dispatch it replaced.
+
+    Usage:
+        dispatch_bench [options]
+
+    Options:
+        -h --help           Show this screen.
+        --version           Show version.
+        --count=<n>         Requests dispatched per sample [default: 1000].
+        --samples=<n>       Number of samples to take [default: 10000].
+)";
+
+namespace HomaRpcBench {
+namespace DispatchBench {
+
+/**
+ * Stands in for the request message of a Homa::ServerOp; serves get() out
+ * of a flat buffer so that only the dispatch cost is measured.
+ */
+struct FakeMessage {
+    std::vector<char> bytes;
+
+    uint32_t get(uint32_t offset, void* destination, uint32_t count) const
+    {
+        if (offset >= bytes.size()) {
+            return 0;
+        }
+        count = std::min<uint32_t>(count, bytes.size() - offset);
+        std::memcpy(destination, bytes.data() + offset, count);
+        return count;
+    }
+};
+
+struct FakeOp {
+    const FakeMessage* request;
+};
+
+/**
+ * Service with the same RPCs, in the same order, as HomaRpcBench::Server
+ * (keep them in step) whose handlers only touch their request header.
+ * Handlers are kept out of line, as the real ones are too large to be
+ * inlined into dispatch.
+ */
+class Service {
+  public:
+    Service()
+        : sink(0)
+    {}
+
+    __attribute__((noinline)) void handleConfigServerRpc(
+        FakeOp* op, const WireFormat::ConfigServerRpc::Request& request)
+    {
+        sink += request.forward;
+    }
+
+    __attribute__((noinline)) void handleDumpTimeTraceRpc(
+        FakeOp* op, const WireFormat::DumpTimeTraceRpc::Request& request)
+    {
+        sink += request.common.opcode;
+    }
+
+    __attribute__((noinline)) void handleEchoRpc(
+        FakeOp* op, const WireFormat::EchoRpc::Request& request)
+    {
+        sink += request.sentBytes + request.responseBytes;
+    }
+
+    __attribute__((noinline)) void handleEchoMultiLevelRpc(
+        FakeOp* op, const WireFormat::EchoMultiLevelRpc::Request& request)
+    {
+        sink += request.sentBytes + request.responseBytes;
+    }
+
+    __attribute__((noinline)) void handleEchoBatchRpc(
+        FakeOp* op, const WireFormat::EchoBatchRpc::Request& request)
+    {
+        sink += request.numOps;
+    }
+
+    __attribute__((noinline)) void handleHoldRpc(
+        FakeOp* op, const WireFormat::HoldRpc::Request& request)
+    {
+        sink += request.release;
+    }
+
+    __attribute__((noinline)) void handleGoodputRpc(
+        FakeOp* op, const WireFormat::GoodputRpc::Request& request)
+    {
+        sink += request.sentBytes;
+    }
+
+    __attribute__((noinline)) void handleServerStatsRpc(
+        FakeOp* op, const WireFormat::ServerStatsRpc::Request& request)
+    {
+        sink += request.reset;
+    }
+
+    __attribute__((noinline)) void handleFlightRecorderRpc(
+        FakeOp* op, const WireFormat::FlightRecorderRpc::Request& request)
+    {
+        sink += request.action + request.opId;
+    }
+
+    /**
+     * The switch-based dispatch: copy out the Common header, switch on the
+     * opcode, then copy out the full request header again.
+     */
+    bool dispatchSwitch(FakeOp* op)
+    {
+        WireFormat::Common common;
+        op->request->get(0, &common, sizeof(common));
+
+        switch (common.opcode) {
+            case WireFormat::ConfigServerRpc::opcode: {
+                WireFormat::ConfigServerRpc::Request request;
+                op->request->get(0, &request, sizeof(request));
+                handleConfigServerRpc(op, request);
+                break;
+            }
+            case WireFormat::DumpTimeTraceRpc::opcode: {
+                WireFormat::DumpTimeTraceRpc::Request request;
+                op->request->get(0, &request, sizeof(request));
+                handleDumpTimeTraceRpc(op, request);
+                break;
+            }
+            case WireFormat::EchoRpc::opcode: {
+                WireFormat::EchoRpc::Request request;
+                op->request->get(0, &request, sizeof(request));
+                handleEchoRpc(op, request);
+                break;
+            }
+            case WireFormat::EchoMultiLevelRpc::opcode: {
+                WireFormat::EchoMultiLevelRpc::Request request;
+                op->request->get(0, &request, sizeof(request));
+                handleEchoMultiLevelRpc(op, request);
+                break;
+            }
+            case WireFormat::EchoBatchRpc::opcode: {
+                WireFormat::EchoBatchRpc::Request request;
+                op->request->get(0, &request, sizeof(request));
+                handleEchoBatchRpc(op, request);
+                break;
+            }
+            case WireFormat::HoldRpc::opcode: {
+                WireFormat::HoldRpc::Request request;
+                op->request->get(0, &request, sizeof(request));
+                handleHoldRpc(op, request);
+                break;
+            }
+            case WireFormat::GoodputRpc::opcode: {
+                WireFormat::GoodputRpc::Request request;
+                op->request->get(0, &request, sizeof(request));
+                handleGoodputRpc(op, request);
+                break;
+            }
+            case WireFormat::ServerStatsRpc::opcode: {
+                WireFormat::ServerStatsRpc::Request request;
+                op->request->get(0, &request, sizeof(request));
+                handleServerStatsRpc(op, request);
+                break;
+            }
+            case WireFormat::FlightRecorderRpc::opcode: {
+                WireFormat::FlightRecorderRpc::Request request;
+                op->request->get(0, &request, sizeof(request));
+                handleFlightRecorderRpc(op, request);
+                break;
+            }
+            default:
+                return false;
+        }
+        return true;
+    }
+
+    using Dispatcher = Dispatch::Table<
+        Service, FakeOp,
+        Dispatch::Route<WireFormat::ConfigServerRpc,
+                        &Service::handleConfigServerRpc>,
+        Dispatch::Route<WireFormat::DumpTimeTraceRpc,
+                        &Service::handleDumpTimeTraceRpc>,
+        Dispatch::Route<WireFormat::EchoRpc, &Service::handleEchoRpc>,
+        Dispatch::Route<WireFormat::EchoMultiLevelRpc,
+                        &Service::handleEchoMultiLevelRpc>,
+        Dispatch::Route<WireFormat::EchoBatchRpc,
+                        &Service::handleEchoBatchRpc>,
+        Dispatch::Route<WireFormat::HoldRpc, &Service::handleHoldRpc>,
+        Dispatch::Route<WireFormat::GoodputRpc, &Service::handleGoodputRpc>,
+        Dispatch::Route<WireFormat::ServerStatsRpc,
+                        &Service::handleServerStatsRpc>,
+        Dispatch::Route<WireFormat::FlightRecorderRpc,
+                        &Service::handleFlightRecorderRpc>>;
+
+    /// Accumulates handler results so the work cannot be optimized away.
+    uint64_t sink;
+};
+
+/**
+ * Build a request message holding a header for the given RPC followed by a
+ * small payload.
+ */
+template <typename Rpc>
+FakeMessage
+makeRequest()
+{
+    typename Rpc::Request request;
+    std::memset(&request, 0, sizeof(request));
+    request.common.opcode = Rpc::opcode;
+    FakeMessage message;
+    message.bytes.resize(sizeof(request) + 100);
+    std::memcpy(message.bytes.data(), &request, sizeof(request));
+    return message;
+}
+
+/**
+ * Time the given dispatch function over a request stream and print the
+ * per-request distribution.
+ */
+template <typename DispatchFn>
+void
+run(const std::vector<FakeMessage>& requests, int count, int samples,
+    const std::string& description, DispatchFn dispatch)
+{
+    std::vector<Output::Latency> times;
+    uint64_t totalCycles = 0;
+    size_t next = 0;
+    for (int i = 0; i < samples; ++i) {
+        uint64_t start = PerfUtils::Cycles::rdtsc();
+        for (int j = 0; j < count; ++j) {
+            FakeOp op = {&requests[next]};
+            dispatch(&op);
+            next = next + 1 < requests.size() ? next + 1 : 0;
+        }
+        uint64_t cycles = PerfUtils::Cycles::rdtsc() - start;
+        totalCycles += cycles;
+        times.emplace_back(PerfUtils::Cycles::toSeconds(cycles) / count);
+    }
+    std::cout << Output::basic(
+                     times,
+                     Output::format("%s (%.1f cycles/op)", description.c_str(),
+                                    static_cast<double>(totalCycles) /
+                                        (static_cast<double>(count) * samples)))
+              << std::endl;
+}
+
+}  // namespace DispatchBench
+}  // namespace HomaRpcBench
+
+int
+main(int argc, char* argv[])
+{
+    using namespace HomaRpcBench;
+    using namespace HomaRpcBench::DispatchBench;
+
+    std::map<std::string, docopt::value> args =
+        docopt::docopt(USAGE, {argv + 1, argv + argc},
+                       true,  // show help if requested
+                       "HomaRpcBench dispatch_bench");  // version string
+    int count = args["--count"].asLong();
+    int samples = args["--samples"].asLong();
+
+    // Benchmark traffic is almost all echo requests; also show a stream that
+    // cycles through every opcode so the branch predictor cannot settle.
+    std::vector<FakeMessage> echoRequests = {
+        makeRequest<WireFormat::EchoRpc>()};
+    std::vector<FakeMessage> mixedRequests = {
+        makeRequest<WireFormat::EchoRpc>(),
+        makeRequest<WireFormat::ConfigServerRpc>(),
+        makeRequest<WireFormat::EchoMultiLevelRpc>(),
+        makeRequest<WireFormat::EchoBatchRpc>(),
+        makeRequest<WireFormat::GoodputRpc>(),
+        makeRequest<WireFormat::EchoRpc>(),
+        makeRequest<WireFormat::DumpTimeTraceRpc>(),
+        makeRequest<WireFormat::HoldRpc>(),
+        makeRequest<WireFormat::EchoMultiLevelRpc>(),
+        makeRequest<WireFormat::ServerStatsRpc>(),
+        makeRequest<WireFormat::FlightRecorderRpc>(),
+        makeRequest<WireFormat::EchoRpc>(),
+    };
+
+    Service service;
+    auto switchDispatch = [&service](FakeOp* op) {
+        service.dispatchSwitch(op);
+    };
+    auto tableDispatch = [&service](FakeOp* op) {
+        Service::Dispatcher::dispatch(&service, op);
+    };
+
+    std::cout << Output::basicHeader() << std::endl;
+    run(echoRequests, count, samples, "switch dispatch, echo requests",
+        switchDispatch);
+    run(echoRequests, count, samples, "table dispatch, echo requests",
+        tableDispatch);
+    run(mixedRequests, count, samples, "switch dispatch, mixed opcodes",
+        switchDispatch);
+    run(mixedRequests, count, samples, "table dispatch, mixed opcodes",
+        tableDispatch);
+    if (service.sink == 0) {
+        std::cerr << "Handlers were never called" << std::endl;
+    }
+
+    return 0;
+}
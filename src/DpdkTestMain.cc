@@ -1,4 +1,6 @@
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include <signal.h>
@@ -8,6 +10,7 @@
 #include <PerfUtils/TimeTrace.h>
 #include <docopt.h>
 
+#include "Faults.h"
 #include "Output.h"
 
 static const char USAGE[] = R"(HomaRpcBench dpdk_test.
@@ -19,6 +22,11 @@ static const char USAGE[] = R"(HomaRpcBench dpdk_test.
         -h --help           Show this screen.
         --version           Show version.
         --timetrace         Enable TimeTrace output [default: false].
+        --faults=<spec>     Inject packet drops, delays, duplicates and
+                            reordering below the ping-pong; see
+                            src/Faults.h.
+        --timeoutUs=<us>    Give up on a ping whose pong has not arrived
+                            after this many microseconds [default: 10000].
 )";
 
 volatile sig_atomic_t INTERRUPT_FLAG = 0;
@@ -28,6 +36,89 @@ sig_int_handler(int sig)
     INTERRUPT_FLAG = 1;
 }
 
+/**
+ * Answer every ping with a pong carrying the ping's sequence number.
+ */
+template <typename Driver>
+void
+runServer(Driver& driver)
+{
+    std::cout << driver.addressToString(driver.getLocalAddress())
+              << std::endl;
+    while (true) {
+        if (INTERRUPT_FLAG) {
+            break;
+        }
+        Homa::Driver::Packet* incoming[10];
+        uint32_t receivedPackets;
+        do {
+            receivedPackets = driver.receivePackets(10, incoming);
+        } while (receivedPackets == 0 && !INTERRUPT_FLAG);
+        if (receivedPackets == 0) {
+            break;
+        }
+        Homa::Driver::Packet* pong = driver.allocPacket();
+        pong->address = incoming[0]->address;
+        pong->length = 100;
+        std::memcpy(pong->payload, incoming[0]->payload, sizeof(uint64_t));
+        driver.sendPacket(pong);
+        driver.releasePackets(incoming, receivedPackets);
+        driver.releasePackets(&pong, 1);
+    }
+}
+
+/**
+ * Send numbered pings one at a time and time each until its pong arrives.
+ * Pongs of earlier pings (late, or duplicated by --faults) are ignored.
+ *
+ * @return
+ *      Number of pings given up on after timeoutCycles.
+ */
+template <typename Driver>
+int
+runClient(Driver& driver, Homa::Driver::Address server_address,
+          uint64_t timeoutCycles, std::vector<Output::Latency>* times)
+{
+    int lost = 0;
+    for (uint64_t i = 0; i < 100000; ++i) {
+        uint64_t start = PerfUtils::Cycles::rdtsc();
+        PerfUtils::TimeTrace::record(start, "START");
+        Homa::Driver::Packet* ping = driver.allocPacket();
+        PerfUtils::TimeTrace::record("allocPacket");
+        ping->address = server_address;
+        ping->length = 100;
+        std::memcpy(ping->payload, &i, sizeof(i));
+        PerfUtils::TimeTrace::record("set ping args");
+        driver.sendPacket(ping);
+        PerfUtils::TimeTrace::record("sendPacket");
+        driver.releasePackets(&ping, 1);
+        PerfUtils::TimeTrace::record("releasePacket");
+        bool answered = false;
+        uint64_t stop;
+        do {
+            Homa::Driver::Packet* incoming[10];
+            uint32_t receivedPackets = driver.receivePackets(10, incoming);
+            PerfUtils::TimeTrace::record("receivePackets");
+            for (uint32_t j = 0; j < receivedPackets; ++j) {
+                uint64_t sequence;
+                std::memcpy(&sequence, incoming[j]->payload, sizeof(sequence));
+                answered |= sequence == i;
+            }
+            if (receivedPackets > 0) {
+                driver.releasePackets(incoming, receivedPackets);
+                PerfUtils::TimeTrace::record("releasePacket");
+            }
+            stop = PerfUtils::Cycles::rdtsc();
+        } while (!answered && stop - start < timeoutCycles);
+        if (answered) {
+            times->emplace_back(PerfUtils::Cycles::toSeconds(stop - start));
+        } else {
+            lost++;
+        }
+    }
+    return lost;
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -42,61 +133,54 @@ main(int argc, char* argv[])
     if (!isServer) {
         server_address_string = args["<server_address>"].asString();
     }
+    bool injectFaults = args["--faults"].isString();
+    HomaRpcBench::Faults::Rules faultRules;
+    if (injectFaults && !HomaRpcBench::Faults::parseRules(
+                            args["--faults"].asString(), &faultRules)) {
+        return 1;
+    }
+    uint64_t timeoutCycles = PerfUtils::Cycles::fromSeconds(
+        std::stod(args["--timeoutUs"].asString()) / 1e6);
 
     Homa::Drivers::DPDK::DpdkDriver driver(port);
+    // Only built on request; it holds large fixed buffers.
+    std::unique_ptr<HomaRpcBench::Faults::Driver> faultDriver;
+    if (injectFaults) {
+        faultDriver.reset(
+            new HomaRpcBench::Faults::Driver(&driver, faultRules));
+    }
 
     if (isServer) {
-        std::cout << driver.addressToString(driver.getLocalAddress())
-                  << std::endl;
-        while (true) {
-            if (INTERRUPT_FLAG) {
-                break;
-            }
-            Homa::Driver::Packet* incoming[10];
-            uint32_t receivedPackets;
-            do {
-                receivedPackets = driver.receivePackets(10, incoming);
-            } while (receivedPackets == 0);
-            Homa::Driver::Packet* pong = driver.allocPacket();
-            pong->address = incoming[0]->address;
-            pong->length = 100;
-            driver.sendPacket(pong);
-            driver.releasePackets(incoming, receivedPackets);
-            driver.releasePackets(&pong, 1);
+        signal(SIGINT, sig_int_handler);
+        if (injectFaults) {
+            runServer(*faultDriver);
+            std::cout << "Fault injection: " << faultDriver->summary()
+                      << std::endl;
+        } else {
+            runServer(driver);
         }
     } else {
         Homa::Driver::Address server_address =
             driver.getAddress(&server_address_string);
         std::vector<Output::Latency> times;
-        for (int i = 0; i < 100000; ++i) {
-            uint64_t start = PerfUtils::Cycles::rdtsc();
-            PerfUtils::TimeTrace::record(start, "START");
-            Homa::Driver::Packet* ping = driver.allocPacket();
-            PerfUtils::TimeTrace::record("allocPacket");
-            ping->address = server_address;
-            ping->length = 100;
-            PerfUtils::TimeTrace::record("set ping args");
-            driver.sendPacket(ping);
-            PerfUtils::TimeTrace::record("sendPacket");
-            driver.releasePackets(&ping, 1);
-            PerfUtils::TimeTrace::record("releasePacket");
-            Homa::Driver::Packet* incoming[10];
-            uint32_t receivedPackets;
-            do {
-                receivedPackets = driver.receivePackets(10, incoming);
-                PerfUtils::TimeTrace::record("receivePackets");
-            } while (receivedPackets == 0);
-            driver.releasePackets(incoming, receivedPackets);
-            PerfUtils::TimeTrace::record("releasePacket");
-            uint64_t stop = PerfUtils::Cycles::rdtsc();
-            times.emplace_back(PerfUtils::Cycles::toSeconds(stop - start));
-        }
+        int lost = injectFaults ? runClient(*faultDriver, server_address,
+                                            timeoutCycles, &times)
+                                : runClient(driver, server_address,
+                                            timeoutCycles, &times);
         if (args["--timetrace"].asBool()) {
             PerfUtils::TimeTrace::print();
         }
         std::cout << Output::basicHeader() << std::endl;
-        std::cout << Output::basic(times, "DpdkDriver Ping-Pong") << std::endl;
+        std::string description = "DpdkDriver Ping-Pong";
+        if (injectFaults || lost > 0) {
+            description += Output::format(", %d pings lost", lost);
+        }
+        std::cout << Output::basic(times, description) << std::endl;
+        if (injectFaults) {
+            std::cout << "Fault injection: " << faultDriver->summary()
+                      << std::endl;
+        }
     }
 
     return 0;
-}
\ No newline at end of file
+}
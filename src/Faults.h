@@ -0,0 +1,533 @@
+#ifndef HOMARPCBENCH_FAULTS_H
+#define HOMARPCBENCH_FAULTS_H
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Homa/Driver.h>
+
+#include "Clock.h"
+#include "Output.h"
+#include "RepeatDetector.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Packet loss, delay, duplication and reordering injected between a
+ * Homa::Transport and its real driver, so that Homa's loss recovery can be
+ * measured on a clean fabric.
+ *
+ * Faults are described by a spec: a comma separated list of <key>=<value>
+ * where key is one of
+ *      drop, delay, dup, reorder
+ *          Fraction of packets affected; the value is either a probability
+ *          (0.01) or 1/N for exactly every Nth packet.  Prefix the key with
+ *          tx. or rx. to affect one direction only.
+ *      delayUs
+ *          How long delayed packets are held [default: 100].
+ *      seed
+ *          Seed of the probabilistic faults [default: 1].
+ * e.g. "drop=0.01,rx.reorder=1/50,delay=0.001,delayUs=500".
+ *
+ * A reordered packet is held until the next packet in the same direction
+ * has passed it (or until delayUs, if no packet follows).
+ */
+namespace Faults {
+
+enum Direction {
+    TX,
+    RX,
+    NUM_DIRECTIONS,
+};
+
+enum Fault {
+    DROP,
+    DELAY,
+    DUPLICATE,
+    REORDER,
+    NUM_FAULTS,
+};
+
+/// Spec names of each Fault.
+static const char* const FAULT_NAMES[NUM_FAULTS] = {"drop", "delay", "dup",
+                                                    "reorder"};
+
+/**
+ * When a fault hits a packet: with a probability, or every Nth packet.
+ */
+struct Trigger {
+    double probability;
+    /// If nonzero, the fault hits every Nth packet and probability is
+    /// ignored.
+    uint64_t every;
+
+    Trigger()
+        : probability(0)
+        , every(0)
+    {}
+};
+
+struct Rules {
+    Trigger triggers[NUM_DIRECTIONS][NUM_FAULTS];
+    double delaySeconds;
+    uint64_t seed;
+
+    Rules()
+        : triggers()
+        , delaySeconds(100e-6)
+        , seed(1)
+    {}
+};
+
+/**
+ * Parse a fault spec (see above) into rules.  Returns false and prints a
+ * message if the spec is malformed.
+ */
+inline bool
+parseRules(const std::string& spec, Rules* rules)
+{
+    *rules = Rules();
+    std::stringstream entries(spec);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        if (entry.empty()) {
+            continue;
+        }
+        size_t equals = entry.find('=');
+        if (equals == std::string::npos) {
+            std::cerr << "Fault spec entry " << entry << " has no value"
+                      << std::endl;
+            return false;
+        }
+        std::string key = entry.substr(0, equals);
+        std::string value = entry.substr(equals + 1);
+        try {
+            if (key == "delayUs") {
+                rules->delaySeconds = std::stod(value) / 1e6;
+                continue;
+            }
+            if (key == "seed") {
+                rules->seed = std::stoull(value);
+                continue;
+            }
+            Trigger trigger;
+            if (value.compare(0, 2, "1/") == 0) {
+                trigger.every = std::stoull(value.substr(2));
+                if (trigger.every == 0) {
+                    std::cerr << "Fault spec entry " << entry
+                              << " needs N of 1/N to be at least 1"
+                              << std::endl;
+                    return false;
+                }
+            } else {
+                trigger.probability = std::stod(value);
+            }
+            if (trigger.probability < 0 || trigger.probability > 1) {
+                std::cerr << "Fault probability " << value
+                          << " is outside [0, 1]" << std::endl;
+                return false;
+            }
+            int first = TX;
+            int last = RX;
+            if (key.compare(0, 3, "tx.") == 0) {
+                last = TX;
+                key = key.substr(3);
+            } else if (key.compare(0, 3, "rx.") == 0) {
+                first = RX;
+                key = key.substr(3);
+            }
+            int fault = 0;
+            while (fault < NUM_FAULTS && key != FAULT_NAMES[fault]) {
+                fault++;
+            }
+            if (fault == NUM_FAULTS) {
+                std::cerr << "Unknown fault " << key << std::endl;
+                return false;
+            }
+            for (int direction = first; direction <= last; ++direction) {
+                rules->triggers[direction][fault] = trigger;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Bad value in fault spec entry " << entry
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * What passed through one direction of a Driver.
+ */
+struct Stats {
+    uint64_t packets;
+    uint64_t faults[NUM_FAULTS];
+    /// Packets identical to a recent packet in the same direction: the
+    /// retransmissions and repeated control packets of loss recovery (and,
+    /// on the receiving side, duplicates injected by the peer).
+    uint64_t repeats;
+
+    Stats()
+        : packets(0)
+        , faults()
+        , repeats(0)
+    {}
+};
+
+/**
+ * Homa::Driver decorator that applies Rules to the packets sent and
+ * received through the wrapped driver.  Create it in place of the real
+ * driver when handing a driver to Homa::Transport; it must outlive the
+ * transport.  Final, so that code templated on the driver type calls it
+ * directly.  Not thread-safe.
+ */
+class Driver final : public Homa::Driver {
+  public:
+    /**
+     * @param driver
+     *      Driver that actually moves the packets.
+     * @param rules
+     *      Faults to inject.
+     */
+    Driver(Homa::Driver* driver, const Rules& rules)
+        : driver(driver)
+        , rules(rules)
+        , delayCycles(Clock::fromSeconds(rules.delaySeconds))
+        , generator(rules.seed)
+        , counters()
+        , held()
+        , recent{RepeatDetector(REPEAT_SLOTS, REPEAT_HISTORY_BYTES),
+                 RepeatDetector(REPEAT_SLOTS, REPEAT_HISTORY_BYTES)}
+        , stats()
+    {}
+
+    ~Driver() override
+    {
+        for (int direction = TX; direction < NUM_DIRECTIONS; ++direction) {
+            for (Held& h : held[direction]) {
+                driver->releasePackets(&h.packet, 1);
+            }
+        }
+    }
+
+    Address getAddress(std::string const* const addressString) override
+    {
+        return driver->getAddress(addressString);
+    }
+
+    Address getAddress(WireFormatAddress const* const wireAddress) override
+    {
+        return driver->getAddress(wireAddress);
+    }
+
+    std::string addressToString(const Address address) override
+    {
+        return driver->addressToString(address);
+    }
+
+    void addressToWireFormat(const Address address,
+                             WireFormatAddress* wireAddress) override
+    {
+        driver->addressToWireFormat(address, wireAddress);
+    }
+
+    Packet* allocPacket() override
+    {
+        return driver->allocPacket();
+    }
+
+    /**
+     * The transport keeps ownership of packets it sends, so packets held
+     * back are copies.
+     */
+    void sendPacket(Packet* packet) override
+    {
+        uint64_t now = Clock::rdtsc();
+        releaseSends(now, false);
+        Fault fault = arrive(TX, packet);
+        if (fault == DROP) {
+            return;
+        }
+        if (fault == DUPLICATE) {
+            driver->sendPacket(packet);
+        } else if (fault == DELAY || fault == REORDER) {
+            hold(TX, copy(packet), now, true, fault == REORDER);
+            return;
+        }
+        driver->sendPacket(packet);
+        releaseSends(now, true);
+    }
+
+    void cork() override
+    {
+        driver->cork();
+    }
+
+    void uncork() override
+    {
+        driver->uncork();
+    }
+
+    /**
+     * Also sends delayed packets that are due; Homa::Transport::poll()
+     * receives on every call.
+     */
+    uint32_t receivePackets(uint32_t maxPackets,
+                            Packet* receivedPackets[]) override
+    {
+        uint64_t now = Clock::rdtsc();
+        releaseSends(now, false);
+
+        uint32_t numPackets = 0;
+        std::deque<Held>& rx = held[RX];
+        for (auto it = rx.begin(); it != rx.end() && numPackets < maxPackets;) {
+            if (it->releaseCycles <= now) {
+                receivedPackets[numPackets++] = it->packet;
+                it = rx.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        uint32_t received = driver->receivePackets(
+            maxPackets - numPackets, receivedPackets + numPackets);
+        uint32_t end = numPackets + received;
+        for (uint32_t i = numPackets; i < end; ++i) {
+            Packet* packet = receivedPackets[i];
+            Fault fault = arrive(RX, packet);
+            if (fault == DROP) {
+                driver->releasePackets(&packet, 1);
+                continue;
+            }
+            if (fault == DELAY || fault == REORDER) {
+                hold(RX, packet, now, true, fault == REORDER);
+                continue;
+            }
+            receivedPackets[numPackets++] = packet;
+            if (fault == DUPLICATE) {
+                // Delivered on the next call; the array may be full.
+                hold(RX, copy(packet), now, false, false);
+            }
+            // Packets passed by this one are due now.
+            for (Held& h : rx) {
+                if (h.reorder) {
+                    h.releaseCycles = 0;
+                }
+            }
+        }
+        return numPackets;
+    }
+
+    void releasePackets(Packet* packets[], uint16_t numPackets) override
+    {
+        driver->releasePackets(packets, numPackets);
+    }
+
+    int getHighestPacketPriority() override
+    {
+        return driver->getHighestPacketPriority();
+    }
+
+    uint32_t getMaxPayloadSize() override
+    {
+        return driver->getMaxPayloadSize();
+    }
+
+    uint32_t getBandwidth() override
+    {
+        return driver->getBandwidth();
+    }
+
+    Address getLocalAddress() override
+    {
+        return driver->getLocalAddress();
+    }
+
+    uint32_t getQueuedBytes() override
+    {
+        return driver->getQueuedBytes();
+    }
+
+    const Rules& getRules() const
+    {
+        return rules;
+    }
+
+    /// Change the faults injected from now on; the seed is not reapplied.
+    void setRules(const Rules& newRules)
+    {
+        rules = newRules;
+        delayCycles = Clock::fromSeconds(rules.delaySeconds);
+    }
+
+    const Stats& getStats(Direction direction) const
+    {
+        return stats[direction];
+    }
+
+    void resetStats()
+    {
+        for (Stats& s : stats) {
+            s = Stats();
+        }
+    }
+
+    /// Fraction of the packets in both directions that were dropped.
+    double lossRate() const
+    {
+        uint64_t packets = stats[TX].packets + stats[RX].packets;
+        return packets == 0 ? 0
+                            : static_cast<double>(stats[TX].faults[DROP] +
+                                                  stats[RX].faults[DROP]) /
+                                  packets;
+    }
+
+    /// Packets of loss recovery seen in either direction.
+    uint64_t recoveryPackets() const
+    {
+        return stats[TX].repeats + stats[RX].repeats;
+    }
+
+    /**
+     * Describe what was injected and the recovery traffic that resulted.
+     */
+    std::string summary() const
+    {
+        std::string text;
+        for (int direction = TX; direction < NUM_DIRECTIONS; ++direction) {
+            const Stats& s = stats[direction];
+            text += Output::format(
+                "%s%s %lu packets (%lu dropped, %lu delayed, %lu duplicated, "
+                "%lu reordered, %lu repeated)",
+                direction == TX ? "" : "; ", direction == TX ? "tx" : "rx",
+                s.packets, s.faults[DROP], s.faults[DELAY],
+                s.faults[DUPLICATE], s.faults[REORDER], s.repeats);
+        }
+        return text;
+    }
+
+  private:
+    /// Size of the RepeatDetector of each direction.
+    static const size_t REPEAT_SLOTS = 1 << 16;
+    static const size_t REPEAT_HISTORY_BYTES = 16 * 1024 * 1024;
+
+    /// A packet held back by a DELAY or REORDER fault.
+    struct Held {
+        Packet* packet;
+        uint64_t releaseCycles;
+        /// True if the packet is also released once a later packet in
+        /// the same direction has passed it.
+        bool reorder;
+    };
+
+    bool fires(Direction direction, Fault fault)
+    {
+        const Trigger& trigger = rules.triggers[direction][fault];
+        if (trigger.every > 0) {
+            return ++counters[direction][fault] % trigger.every == 0;
+        }
+        return trigger.probability > 0 &&
+               std::uniform_real_distribution<double>(0, 1)(generator) <
+                   trigger.probability;
+    }
+
+    /**
+     * Account for a packet entering one direction and pick the fault, if
+     * any, that hits it.
+     *
+     * @return
+     *      The fault to apply, or NUM_FAULTS for none; if several hit, the
+     *      first in Fault order wins.
+     */
+    Fault arrive(Direction direction, Packet* packet)
+    {
+        Stats& s = stats[direction];
+        s.packets++;
+        if (recent[direction].isRepeat(&packet->address,
+                                       sizeof(packet->address),
+                                       packet->payload, packet->length)) {
+            s.repeats++;
+        }
+        // Every trigger sees every packet, so that 1/N stays exact when
+        // several faults are configured.
+        Fault hit = NUM_FAULTS;
+        for (int fault = DROP; fault < NUM_FAULTS; ++fault) {
+            if (fires(direction, static_cast<Fault>(fault)) &&
+                hit == NUM_FAULTS) {
+                hit = static_cast<Fault>(fault);
+            }
+        }
+        if (hit != NUM_FAULTS) {
+            s.faults[hit]++;
+        }
+        return hit;
+    }
+
+    Packet* copy(const Packet* packet)
+    {
+        Packet* copy = driver->allocPacket();
+        std::memcpy(copy->payload, packet->payload, packet->length);
+        copy->length = packet->length;
+        copy->address = packet->address;
+        copy->priority = packet->priority;
+        return copy;
+    }
+
+    /**
+     * Hold back a packet.
+     *
+     * @param delay
+     *      If true, the packet is due delayCycles after now; otherwise it
+     *      is due at once (on the next call).
+     */
+    void hold(Direction direction, Packet* packet, uint64_t now, bool delay,
+              bool reorder)
+    {
+        uint64_t releaseCycles = delay ? now + delayCycles : now;
+        held[direction].push_back({packet, releaseCycles, reorder});
+    }
+
+    /**
+     * Send the held copies that are due.
+     *
+     * @param passed
+     *      True if a packet was just sent, which releases reordered ones.
+     */
+    void releaseSends(uint64_t now, bool passed)
+    {
+        std::deque<Held>& tx = held[TX];
+        for (auto it = tx.begin(); it != tx.end();) {
+            if (it->releaseCycles <= now || (passed && it->reorder)) {
+                driver->sendPacket(it->packet);
+                driver->releasePackets(&it->packet, 1);
+                it = tx.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    Homa::Driver* driver;
+    Rules rules;
+    /// Rules::delaySeconds in cycles.
+    uint64_t delayCycles;
+    std::mt19937_64 generator;
+    /// Packets seen per direction and fault, for Trigger::every.
+    uint64_t counters[NUM_DIRECTIONS][NUM_FAULTS];
+    /// Held packets per direction, oldest first.
+    std::deque<Held> held[NUM_DIRECTIONS];
+    /// Recent packets per direction, for Stats::repeats.
+    RepeatDetector recent[NUM_DIRECTIONS];
+    Stats stats[NUM_DIRECTIONS];
+};
+
+}  // namespace Faults
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_FAULTS_H
@@ -0,0 +1,343 @@
+#ifndef HOMARPCBENCH_FLIGHTRECORDER_H
+#define HOMARPCBENCH_FLIGHTRECORDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <PerfUtils/TimeTrace.h>
+
+#include "Clock.h"
+#include "Output.h"
+#include "Tracepoint.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Per-op tracepoints kept only for the ops worth looking at.
+ *
+ * A Recorder keeps the tracepoints of its most recent ops in a ring.  The
+ * client offers every finished op to an Exemplars set, which keeps the slow
+ * ones, and asks the servers in the op's chain to snapshot their records of
+ * the same op id before the ring overwrites them.  At the end only the kept
+ * ops are printed, so p999 outliers can be read directly instead of being
+ * searched for in a TimeTrace of every op.
+ */
+namespace FlightRecorder {
+
+/// Tracepoints recorded per op; later ones are counted but dropped.
+static constexpr uint32_t MAX_EVENTS = 32;
+
+struct Event {
+    uint64_t cycles;
+    /// Static string naming the tracepoint, as passed to TimeTrace.
+    const char* name;
+};
+
+/**
+ * Tracepoints of a single op.
+ */
+struct OpRecord {
+    /// Id carried in the op's requests; 0 for an unused record.
+    uint64_t opId;
+    uint32_t numEvents;
+    uint32_t droppedEvents;
+    Event events[MAX_EVENTS];
+};
+
+/**
+ * Ring of the records of the most recent ops handled by one thread.  Only
+ * one op is open at a time; tracepoints outside of an open op go to
+ * TimeTrace only.
+ */
+class Recorder {
+  public:
+    /**
+     * @param capacity
+     *      Number of recent ops whose records are kept.
+     */
+    explicit Recorder(size_t capacity)
+        : enabled(false)
+        , open(false)
+        , next(0)
+        , ring(capacity)
+    {}
+
+    /**
+     * Start or stop keeping records; either way all kept records are
+     * discarded.
+     */
+    void setEnabled(bool enable)
+    {
+        enabled = enable;
+        open = false;
+        next = 0;
+        for (OpRecord& record : ring) {
+            record.opId = 0;
+        }
+    }
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    /**
+     * Open the record of a new op, replacing the oldest one in the ring.
+     * Ops with id 0 are not recorded.
+     */
+    void begin(uint64_t opId)
+    {
+        if (!Tracepoint::COMPILED || !enabled || opId == 0) {
+            return;
+        }
+        OpRecord& record = ring[next];
+        record.opId = opId;
+        record.numEvents = 0;
+        record.droppedEvents = 0;
+        open = true;
+    }
+
+    /**
+     * Close the open op.
+     *
+     * @return
+     *      The record of the op, or nullptr if no op was open.
+     */
+    const OpRecord* end()
+    {
+        if (!open) {
+            return nullptr;
+        }
+        const OpRecord* record = &ring[next];
+        next = (next + 1) % ring.size();
+        open = false;
+        return record;
+    }
+
+    /**
+     * Record a tracepoint in TimeTrace if its category is enabled (see
+     * Tracepoint.h) and, if an op is open, in the op's record.
+     */
+    void trace(uint32_t category, uint64_t cycles, const char* name)
+    {
+        if (!Tracepoint::COMPILED) {
+            return;
+        }
+        Tracepoint::record(category, cycles, name);
+        if (!open) {
+            return;
+        }
+        OpRecord& record = ring[next];
+        if (record.numEvents < MAX_EVENTS) {
+            record.events[record.numEvents++] = {cycles, name};
+        } else {
+            record.droppedEvents++;
+        }
+    }
+
+    void trace(uint32_t category, const char* name)
+    {
+        // A single branch when neither TimeTrace nor the recorder wants it.
+        if (Tracepoint::COMPILED &&
+            __builtin_expect((Tracepoint::mask & category) | open, 0)) {
+            trace(category, Clock::rdtsc(), name);
+        }
+    }
+
+    /**
+     * Return the record of a recent op, or nullptr if it has already been
+     * overwritten (or was never recorded).
+     */
+    const OpRecord* find(uint64_t opId) const
+    {
+        if (opId == 0) {
+            return nullptr;
+        }
+        // Search from the newest record; a lookup usually follows the op
+        // closely.
+        for (size_t i = 1; i <= ring.size(); ++i) {
+            const OpRecord& record =
+                ring[(next + ring.size() - i) % ring.size()];
+            if (record.opId == opId) {
+                return &record;
+            }
+        }
+        return nullptr;
+    }
+
+  private:
+    bool enabled;
+    /// True between begin() and end(); the open op is ring[next].
+    bool open;
+    size_t next;
+    std::vector<OpRecord> ring;
+};
+
+/**
+ * A tracepoint whose name is owned, so that it can outlive the process (or
+ * machine) that recorded it.
+ */
+struct NamedEvent {
+    uint64_t cycles;
+    std::string name;
+};
+
+/**
+ * Copy the events of a record into a list of NamedEvents.
+ */
+inline std::vector<NamedEvent>
+toNamedEvents(const OpRecord& record)
+{
+    std::vector<NamedEvent> events;
+    for (uint32_t i = 0; i < record.numEvents; ++i) {
+        events.push_back({record.events[i].cycles, record.events[i].name});
+    }
+    return events;
+}
+
+/**
+ * Print a list of events, one per line, with their offset from startCycles
+ * and the time since the previous event.
+ */
+inline void
+printEvents(const std::vector<NamedEvent>& events, uint64_t startCycles,
+            double cyclesPerSecond, const char* indent)
+{
+    uint64_t previous = startCycles;
+    for (const NamedEvent& event : events) {
+        std::cout << indent
+                  << Output::format(
+                         "%s (+%s)  %s",
+                         Output::formatTime(Output::Latency(
+                                                (event.cycles - startCycles) /
+                                                cyclesPerSecond))
+                             .c_str(),
+                         Output::formatTime(Output::Latency(
+                                                (event.cycles - previous) /
+                                                cyclesPerSecond))
+                             .c_str(),
+                         event.name.c_str())
+                  << std::endl;
+        previous = event.cycles;
+    }
+}
+
+/**
+ * An op kept for printing, together with its tracepoints on the client.
+ */
+struct Exemplar {
+    OpRecord record;
+    uint64_t latencyCycles;
+    /// True if the op exceeded the latency threshold; otherwise it is kept
+    /// only while it is among the slowest ops.
+    bool slow;
+};
+
+/**
+ * Selects the ops worth keeping: those among the topN slowest and those
+ * slower than a latency threshold.
+ */
+class Exemplars {
+  public:
+    /// Ops kept for exceeding the threshold; later slow ops are counted but
+    /// not kept, so that a badly chosen threshold cannot exhaust memory.
+    static constexpr size_t MAX_SLOW = 1024;
+
+    /**
+     * @param topN
+     *      Number of slowest ops to keep.
+     * @param thresholdCycles
+     *      Ops that take longer are kept as well; 0 disables the threshold.
+     */
+    Exemplars(size_t topN, uint64_t thresholdCycles)
+        : topN(topN)
+        , thresholdCycles(thresholdCycles)
+        , numSlow(0)
+        , slowOps(0)
+        , slowest()
+        , kept()
+    {}
+
+    /**
+     * Offer a finished op.
+     *
+     * @return
+     *      True if the op was kept, in which case the servers should
+     *      snapshot their records of it.
+     */
+    bool offer(const OpRecord& record, uint64_t latencyCycles)
+    {
+        bool slow = thresholdCycles != 0 && latencyCycles > thresholdCycles;
+        if (slow) {
+            slowOps++;
+            slow = numSlow < MAX_SLOW;
+        }
+        bool top = topN > 0 && (slowest.size() < topN ||
+                                latencyCycles > slowest.top().first);
+        if (!slow && !top) {
+            return false;
+        }
+        kept[record.opId] = {record, latencyCycles, slow};
+        if (slow) {
+            numSlow++;
+        }
+        if (top) {
+            slowest.push({latencyCycles, record.opId});
+            if (slowest.size() > topN) {
+                uint64_t displaced = slowest.top().second;
+                slowest.pop();
+                auto it = kept.find(displaced);
+                if (it != kept.end() && !it->second.slow) {
+                    kept.erase(it);
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Return the kept ops, slowest first.
+     */
+    std::vector<const Exemplar*> sorted() const
+    {
+        std::vector<const Exemplar*> exemplars;
+        for (auto& entry : kept) {
+            exemplars.push_back(&entry.second);
+        }
+        std::sort(exemplars.begin(), exemplars.end(),
+                  [](const Exemplar* a, const Exemplar* b) {
+                      return a->latencyCycles > b->latencyCycles;
+                  });
+        return exemplars;
+    }
+
+    /// Number of ops that exceeded the threshold, kept or not.
+    uint64_t getSlowOps() const
+    {
+        return slowOps;
+    }
+
+  private:
+    size_t topN;
+    uint64_t thresholdCycles;
+    size_t numSlow;
+    uint64_t slowOps;
+    /// Latency and id of the topN slowest ops, fastest on top.
+    std::priority_queue<std::pair<uint64_t, uint64_t>,
+                        std::vector<std::pair<uint64_t, uint64_t>>,
+                        std::greater<std::pair<uint64_t, uint64_t>>>
+        slowest;
+    std::map<uint64_t, Exemplar> kept;
+};
+
+}  // namespace FlightRecorder
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_FLIGHTRECORDER_H
@@ -0,0 +1,252 @@
+#ifndef HOMARPCBENCH_HOPSTAMPS_H
+#define HOMARPCBENCH_HOPSTAMPS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Clock.h"
+#include "Output.h"
+#include "WireFormat.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Per-hop timestamps carried in echo responses (see
+ * WireFormat::EchoRpc::HOP_STAMPS).
+ *
+ * Each server stamps an op with its own cycle counter only, so no clock
+ * synchronization is needed: a residence time is the difference of two
+ * stamps of one server, and the time an op spent on the links between two
+ * servers is what remains of the caller's round trip once the callee's
+ * residence is subtracted.
+ */
+namespace HopStamps {
+
+/**
+ * Return the stamp of this server; unused stamps are 0.
+ */
+inline WireFormat::HopStamp
+make(uint64_t serverId, uint64_t receiveCycles, uint64_t forwardCycles,
+     uint64_t returnCycles, uint64_t replyCycles)
+{
+    WireFormat::HopStamp stamp;
+    stamp.serverId = serverId;
+    stamp.cyclesPerSecond = Clock::perSecond();
+    stamp.receiveCycles = receiveCycles;
+    stamp.forwardCycles = forwardCycles;
+    stamp.returnCycles = returnCycles;
+    stamp.replyCycles = replyCycles;
+    return stamp;
+}
+
+/**
+ * Append up to count stamps found at offset in one message to another, one
+ * at a time so that handlers need no buffer for them.
+ *
+ * @return
+ *      Number of stamps copied; fewer than count if the message ends early.
+ */
+template <typename From, typename To>
+uint32_t
+copy(const From* from, uint32_t offset, uint32_t count, To* to)
+{
+    WireFormat::HopStamp stamp;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (from->get(offset + i * sizeof(stamp), &stamp, sizeof(stamp)) !=
+            sizeof(stamp)) {
+            return i;
+        }
+        to->append(&stamp, sizeof(stamp));
+    }
+    return count;
+}
+
+/**
+ * Collects the stamps of the ops of one benchmark and prints the
+ * distribution of each hop's residence time and of the link latencies.
+ */
+class Breakdown {
+  public:
+    Breakdown()
+        : hops()
+        , ringLinks()
+        , stamps()
+        , incomplete(0)
+    {}
+
+    /**
+     * Add the stamps of a nested EchoRpc, which follow the response payload
+     * with the last hop first.
+     *
+     * @param response
+     *      Response of the op.
+     * @param offset
+     *      Offset of the first stamp in the response.
+     * @param count
+     *      Number of stamps, which is the response's hopCount.
+     * @param latencyCycles
+     *      Latency of the op as seen by the client.
+     */
+    template <typename Message>
+    void addNested(const Message* response, uint32_t offset, uint32_t count,
+                   uint64_t latencyCycles)
+    {
+        if (!read(response, offset, count)) {
+            return;
+        }
+        std::reverse(stamps.begin(), stamps.end());
+        // Time of the caller's nested round trip to the hop being added.
+        double callerRoundTrip = Clock::toSeconds(latencyCycles);
+        for (uint32_t i = 0; i < count; ++i) {
+            const WireFormat::HopStamp& stamp = stamps[i];
+            double total = seconds(stamp, stamp.receiveCycles,
+                                   stamp.replyCycles);
+            double nested = 0;
+            if (stamp.forwardCycles != 0) {
+                nested = seconds(stamp, stamp.forwardCycles,
+                                 stamp.returnCycles);
+            }
+            Hop& hop = hops[{i, stamp.serverId}];
+            hop.residence.emplace_back(total - nested);
+            hop.link.emplace_back(std::max(0.0, callerRoundTrip - total));
+            callerRoundTrip = nested;
+        }
+    }
+
+    /**
+     * Add the stamps of an EchoMultiLevelRpc, which follow the response
+     * payload with the first hop first.  Only the total time spent on the
+     * links is known, as each link is crossed one way.
+     *
+     * @param response
+     *      Response of the op.
+     * @param offset
+     *      Offset of the first stamp in the response.
+     * @param count
+     *      Number of stamps, which is the response's numHopStamps.
+     * @param latencyCycles
+     *      Latency of the op as seen by the client.
+     */
+    template <typename Message>
+    void addRing(const Message* response, uint32_t offset, uint32_t count,
+                 uint64_t latencyCycles)
+    {
+        if (!read(response, offset, count)) {
+            return;
+        }
+        double links = Clock::toSeconds(latencyCycles);
+        for (uint32_t i = 0; i < count; ++i) {
+            const WireFormat::HopStamp& stamp = stamps[i];
+            double residence = seconds(
+                stamp, stamp.receiveCycles,
+                stamp.forwardCycles != 0 ? stamp.forwardCycles
+                                         : stamp.replyCycles);
+            hops[{i, stamp.serverId}].residence.emplace_back(residence);
+            links -= residence;
+        }
+        ringLinks.emplace_back(std::max(0.0, links));
+    }
+
+    /**
+     * Print a line per hop and server, then one per link, under the main
+     * result line of the benchmark.
+     *
+     * @param resultKey
+     *      Key of the main result (see Output::record()); every line is
+     *      recorded under it.
+     */
+    void print(const std::string& resultKey)
+    {
+        for (auto& entry : hops) {
+            Hop& hop = entry.second;
+            std::string description =
+                Output::format("hop %u (server %lu) residence",
+                               entry.first.first + 1, entry.first.second);
+            Output::record(resultKey + " / " + description, hop.residence);
+            std::cout << Output::basic(hop.residence, "  " + description)
+                      << std::endl;
+        }
+        for (auto& entry : hops) {
+            Hop& hop = entry.second;
+            if (hop.link.empty()) {
+                continue;
+            }
+            std::string caller =
+                entry.first.first == 0
+                    ? std::string("client")
+                    : Output::format("hop %u", entry.first.first);
+            std::string description = Output::format(
+                "%s <-> hop %u (server %lu) links, round trip",
+                caller.c_str(), entry.first.first + 1, entry.first.second);
+            Output::record(resultKey + " / " + description, hop.link);
+            std::cout << Output::basic(hop.link, "  " + description)
+                      << std::endl;
+        }
+        if (!ringLinks.empty()) {
+            std::string description = "all links, client to client";
+            Output::record(resultKey + " / " + description, ringLinks);
+            std::cout << Output::basic(ringLinks, "  " + description)
+                      << std::endl;
+        }
+        if (incomplete > 0) {
+            std::cout << "  " << incomplete
+                      << " responses lacked hop stamps" << std::endl;
+        }
+    }
+
+  private:
+    /**
+     * Read count stamps into the stamps member.  Returns false, and counts
+     * the op as incomplete, if the response is too short.
+     */
+    template <typename Message>
+    bool read(const Message* response, uint32_t offset, uint32_t count)
+    {
+        stamps.resize(count);
+        uint32_t bytes = count * sizeof(WireFormat::HopStamp);
+        if (count == 0 ||
+            response->get(offset, stamps.data(), bytes) != bytes) {
+            incomplete++;
+            return false;
+        }
+        return true;
+    }
+
+    static double seconds(const WireFormat::HopStamp& stamp, uint64_t from,
+                          uint64_t to)
+    {
+        return double(to - from) / stamp.cyclesPerSecond;
+    }
+
+    /// What was seen of one hop of the op on one server.
+    struct Hop {
+        std::vector<Output::Latency> residence;
+        /// Round trip over the links from the caller to this hop, nested
+        /// EchoRpc only.
+        std::vector<Output::Latency> link;
+
+        Hop()
+            : residence()
+            , link()
+        {}
+    };
+
+    /// Hops by their index in the chain and the id of the server.
+    std::map<std::pair<uint32_t, uint64_t>, Hop> hops;
+    /// Time spent on all links of each ring op.
+    std::vector<Output::Latency> ringLinks;
+    /// Stamps of the op being added, in hop order; reused across ops.
+    std::vector<WireFormat::HopStamp> stamps;
+    /// Ops whose stamps could not be read.
+    uint64_t incomplete;
+};
+
+}  // namespace HopStamps
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_HOPSTAMPS_H
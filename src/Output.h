@@ -3,6 +3,8 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstdarg>
+#include <cstdio>
 #include <string>
 #include <vector>
 
@@ -18,7 +20,7 @@ struct TimeDist {
     Latency p999;  // 99.9th percentile time/op (seconds).
 };
 
-std::string
+inline std::string
 format(const std::string& format, ...)
 {
     va_list args;
@@ -32,7 +34,7 @@ format(const std::string& format, ...)
     return &vec[0];
 }
 
-std::string
+inline std::string
 formatTime(Latency seconds)
 {
     if (seconds < std::chrono::duration<double, std::micro>(1)) {
@@ -52,14 +54,59 @@ formatTime(Latency seconds)
     }
 }
 
-std::string
+/**
+ * When set, record() writes the raw samples of every result to this file,
+ * in the format read by the compare tool:
+ *
+ *     result <key>
+ *     throughput <ops/s>              (only if measured)
+ *     <count> <seconds> <seconds> ...
+ */
+inline FILE* resultsFile = nullptr;
+
+/**
+ * Write the samples of a result to resultsFile, if set.
+ *
+ * @param key
+ *      Identifies the result across runs: the benchmark and its configured
+ *      parameters only, never measured values, so that the compare tool
+ *      can match it against the same result of another run.
+ * @param times
+ *      Latency samples of the result.
+ * @param opsPerSecond
+ *      Throughput the benchmark achieved for this result; 0 if it does not
+ *      measure one.
+ */
+inline void
+record(const std::string& key, const std::vector<Latency>& times,
+       double opsPerSecond = 0)
+{
+    if (resultsFile == nullptr) {
+        return;
+    }
+    std::fprintf(resultsFile, "result %s\n", key.c_str());
+    if (opsPerSecond > 0) {
+        std::fprintf(resultsFile, "throughput %.9g\n", opsPerSecond);
+    }
+    std::fprintf(resultsFile, "%zu", times.size());
+    for (Latency time : times) {
+        std::fprintf(resultsFile, " %.9g", time.count());
+    }
+    std::fprintf(resultsFile, "\n");
+    std::fflush(resultsFile);
+}
+
+inline std::string
 basicHeader()
 {
     return "median       min       p90       p99      p999     description";
 }
 
-std::string
-basic(std::vector<Latency>& times, const std::string description)
+/**
+ * Sort a non-empty list of times and return its distribution.
+ */
+inline TimeDist
+distribution(std::vector<Latency>& times)
 {
     int count = times.size();
     std::sort(times.begin(), times.end());
@@ -91,6 +138,13 @@ basic(std::vector<Latency>& times, const std::string description)
     } else {
         dist.p999 = dist.p99;
     }
+    return dist;
+}
+
+inline std::string
+basic(std::vector<Latency>& times, const std::string description)
+{
+    TimeDist dist = distribution(times);
 
     std::string output = "";
     output += format("%9s", formatTime(dist.p50).c_str());
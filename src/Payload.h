@@ -0,0 +1,228 @@
+#ifndef HOMARPCBENCH_PAYLOAD_H
+#define HOMARPCBENCH_PAYLOAD_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#include "Clock.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Helpers to fill benchmark payloads with a reproducible pattern and to
+ * check them end-to-end with a CRC32C (Castagnoli) checksum.
+ */
+namespace Payload {
+
+/**
+ * Accumulated cost and outcome of payload verification.
+ */
+struct VerifyStats {
+    uint64_t bytes;     // Number of payload bytes checked.
+    uint64_t cycles;    // Cycles spent computing checksums of those bytes.
+    uint64_t failures;  // Number of payloads that did not match.
+
+    VerifyStats()
+        : bytes(0)
+        , cycles(0)
+        , failures(0)
+    {}
+
+    double cyclesPerByte() const
+    {
+        return bytes == 0 ? 0.0 : static_cast<double>(cycles) / bytes;
+    }
+};
+
+#if !defined(__SSE4_2__)
+/**
+ * Byte-at-a-time CRC32C lookup table; only used when the hardware crc32
+ * instruction is not available.
+ */
+inline const uint32_t*
+crc32cTable()
+{
+    static uint32_t table[256];
+    static bool initialized = false;
+    if (!initialized) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; ++j) {
+                crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+            }
+            table[i] = crc;
+        }
+        initialized = true;
+    }
+    return table;
+}
+#endif
+
+/**
+ * Compute the CRC32C of a buffer, continuing from a previous checksum.
+ *
+ * Uses the SSE4.2 crc32 instruction 8 bytes at a time when the target
+ * supports it (the DPDK build sets -march=native); otherwise falls back to a
+ * table-driven implementation.
+ *
+ * @param data
+ *      First byte to checksum.
+ * @param length
+ *      Number of bytes to checksum.
+ * @param crc
+ *      Checksum of any preceding bytes; 0 to start a new checksum.
+ */
+inline uint32_t
+crc32c(const void* data, size_t length, uint32_t crc = 0)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+#if defined(__SSE4_2__)
+    uint64_t crc64 = crc;
+    while (length >= 32) {
+        uint64_t words[4];
+        std::memcpy(words, p, sizeof(words));
+        crc64 = _mm_crc32_u64(crc64, words[0]);
+        crc64 = _mm_crc32_u64(crc64, words[1]);
+        crc64 = _mm_crc32_u64(crc64, words[2]);
+        crc64 = _mm_crc32_u64(crc64, words[3]);
+        p += sizeof(words);
+        length -= sizeof(words);
+    }
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += sizeof(word);
+        length -= sizeof(word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (length > 0) {
+        crc = _mm_crc32_u8(crc, *p);
+        ++p;
+        --length;
+    }
+#else
+    const uint32_t* table = crc32cTable();
+    while (length > 0) {
+        crc = table[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+        ++p;
+        --length;
+    }
+#endif
+    return ~crc;
+}
+
+/**
+ * Fill a buffer with a pseudo-random pattern that depends only on the seed,
+ * so that every hop can regenerate the same payload.
+ *
+ * @param buffer
+ *      Buffer to fill.
+ * @param length
+ *      Number of bytes to fill.
+ * @param seed
+ *      Selects the pattern.
+ */
+inline void
+fillPattern(char* buffer, size_t length, uint64_t seed)
+{
+    // splitmix64
+    uint64_t state = seed;
+    size_t offset = 0;
+    while (offset < length) {
+        state += 0x9E3779B97F4A7C15ull;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        size_t n = length - offset < sizeof(z) ? length - offset : sizeof(z);
+        std::memcpy(buffer + offset, &z, n);
+        offset += n;
+    }
+}
+
+/**
+ * Check a received payload against the checksum it carried, charging the
+ * cost to the given stats.
+ *
+ * @param data
+ *      Received payload.
+ * @param length
+ *      Number of bytes in the payload.
+ * @param expectedCrc
+ *      Checksum the sender computed over the payload.
+ * @param stats
+ *      Accumulates the verification cost and any failure.
+ * @return
+ *      True if the payload matches its checksum.
+ */
+inline bool
+verify(const void* data, size_t length, uint32_t expectedCrc,
+       VerifyStats* stats)
+{
+    uint64_t start = Clock::rdtsc();
+    uint32_t crc = crc32c(data, length);
+    stats->cycles += Clock::rdtsc() - start;
+    stats->bytes += length;
+    if (crc != expectedCrc) {
+        stats->failures++;
+        return false;
+    }
+    return true;
+}
+
+/// Number of bytes copied per get() call when reading a payload out of a
+/// message.
+const uint32_t READ_CHUNK_BYTES = 64 * 1024;
+
+/**
+ * Copy a payload out of a message, in chunks of READ_CHUNK_BYTES, after
+ * checking that it fits in the destination.
+ *
+ * @param message
+ *      Message holding the payload (e.g. the request of a Homa::ServerOp or
+ *      the response of a Homa::RemoteOp).
+ * @param offset
+ *      Offset of the payload within the message.
+ * @param destination
+ *      Buffer to copy the payload into.
+ * @param length
+ *      Number of payload bytes expected.
+ * @param capacity
+ *      Size of destination in bytes.
+ * @return
+ *      True if all length bytes were copied; false if the payload does not
+ *      fit in the destination or the message ends before the payload does.
+ */
+template <typename Message>
+bool
+read(const Message* message, uint32_t offset, char* destination,
+     uint32_t length, size_t capacity)
+{
+    if (length > capacity) {
+        return false;
+    }
+    uint32_t copied = 0;
+    while (copied < length) {
+        uint32_t chunk = std::min(length - copied, READ_CHUNK_BYTES);
+        uint32_t count =
+            message->get(offset + copied, destination + copied, chunk);
+        copied += count;
+        if (count < chunk) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace Payload
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_PAYLOAD_H
@@ -0,0 +1,321 @@
+#ifndef HOMARPCBENCH_PERFCOUNTERS_H
+#define HOMARPCBENCH_PERFCOUNTERS_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Output.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Hardware performance counters read through perf_event_open(2).
+ *
+ * Counters are opened as one group for the calling thread and count user
+ * space only, so they work with the default perf_event_paranoid setting of
+ * stock distributions.  Events the machine does not support (e.g. in a VM
+ * without a virtual PMU) are left out and reported as such.
+ */
+namespace PerfCounters {
+
+enum Counter {
+    CYCLES,
+    INSTRUCTIONS,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    DTLB_MISSES,
+    NUM_COUNTERS,
+};
+
+inline const char*
+counterName(int counter)
+{
+    static const char* names[NUM_COUNTERS] = {
+        "cycles", "instructions", "LLC-misses", "branch-misses", "dTLB-misses",
+    };
+    return names[counter];
+}
+
+/**
+ * A group of the counters listed in Counter, read together.
+ */
+class Group {
+  public:
+    Group()
+        : fds()
+        , slots()
+        , numOpen(0)
+    {
+        fds.fill(-1);
+        slots.fill(-1);
+    }
+
+    ~Group()
+    {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    Group(const Group&) = delete;
+    Group& operator=(const Group&) = delete;
+
+    /**
+     * Open and start the counters for the calling thread.
+     *
+     * @return
+     *      False if not even the cycle counter could be opened.
+     */
+    bool open()
+    {
+        static const std::array<std::pair<uint32_t, uint64_t>, NUM_COUNTERS>
+            events = {{
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+                {PERF_TYPE_HW_CACHE,
+                 PERF_COUNT_HW_CACHE_DTLB |
+                     (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            }};
+        for (int counter = 0; counter < NUM_COUNTERS; ++counter) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[counter].first;
+            attr.config = events[counter].second;
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.disabled = (counter == CYCLES);
+            int fd = syscall(__NR_perf_event_open, &attr, 0, -1,
+                             counter == CYCLES ? -1 : fds[CYCLES], 0);
+            if (fd < 0) {
+                if (counter == CYCLES) {
+                    return false;
+                }
+                continue;
+            }
+            fds[counter] = fd;
+            slots[counter] = numOpen++;
+        }
+        ioctl(fds[CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+    }
+
+    /// True if the given counter was opened.
+    bool has(int counter) const
+    {
+        return slots[counter] >= 0;
+    }
+
+    /**
+     * Read the current value of every counter; counters that could not be
+     * opened read as 0.
+     */
+    void read(uint64_t values[NUM_COUNTERS])
+    {
+        // Layout of a PERF_FORMAT_GROUP read: nr, then one value per event.
+        uint64_t buffer[1 + NUM_COUNTERS];
+        if (::read(fds[CYCLES], buffer, sizeof(buffer)) < 0) {
+            std::memset(buffer, 0, sizeof(buffer));
+        }
+        for (int counter = 0; counter < NUM_COUNTERS; ++counter) {
+            values[counter] = has(counter) ? buffer[1 + slots[counter]] : 0;
+        }
+    }
+
+  private:
+    std::array<int, NUM_COUNTERS> fds;
+    /// Position of each counter in a group read, or -1 if not open.
+    std::array<int, NUM_COUNTERS> slots;
+    int numOpen;
+};
+
+/**
+ * Attributes counter deltas to the phases of each op and reports their
+ * distributions.
+ *
+ * Means and maxima are exact.  Percentiles come from a reservoir sample of
+ * at most RESERVOIR_SIZE ops per phase, allocated by enable(), so that a
+ * long run neither grows memory nor reallocates inside the code being
+ * measured.
+ *
+ * Call begin() at the start of an op and mark() at the end of each phase.
+ * Both return at once unless enable() succeeded.  Each call costs one
+ * read(2) of the counter group, which shows up in the wall-clock latency of
+ * the op but not in the user-space counts of the phases.
+ */
+class PhaseProfiler {
+  public:
+    /// Most ops per phase kept for percentiles.
+    static const uint64_t RESERVOIR_SIZE = 10000;
+
+    explicit PhaseProfiler(std::vector<std::string> phaseNames)
+        : phaseNames(phaseNames)
+        , group()
+        , enabled(false)
+        , last()
+        , phases(phaseNames.size())
+        , randomState(0x9E3779B97F4A7C15ull)
+    {}
+
+    /**
+     * Open the counters; prints a notice and stays disabled if the machine
+     * or kernel does not allow it.
+     */
+    bool enable()
+    {
+        enabled = group.open();
+        if (!enabled) {
+            std::cerr << "perf_event_open failed; hardware counters disabled "
+                         "(check /proc/sys/kernel/perf_event_paranoid)"
+                      << std::endl;
+            return false;
+        }
+        for (Phase& phase : phases) {
+            phase.reservoir.resize(RESERVOIR_SIZE);
+        }
+        return true;
+    }
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    /// Mark the start of an op.
+    void begin()
+    {
+        if (enabled) {
+            group.read(last);
+        }
+    }
+
+    /// Mark the end of the given phase of the current op.
+    void mark(int phase)
+    {
+        if (!enabled) {
+            return;
+        }
+        uint64_t now[NUM_COUNTERS];
+        group.read(now);
+        Phase& p = phases[phase];
+        // Algorithm R: the n-th op replaces a random kept op with
+        // probability RESERVOIR_SIZE / n.
+        uint64_t slot = p.count;
+        if (slot >= RESERVOIR_SIZE) {
+            slot = nextRandom() % (p.count + 1);
+        }
+        p.count++;
+        for (int counter = 0; counter < NUM_COUNTERS; ++counter) {
+            uint64_t delta = now[counter] - last[counter];
+            p.sums[counter] += delta;
+            p.maxima[counter] = std::max(p.maxima[counter], delta);
+            if (slot < RESERVOIR_SIZE) {
+                p.reservoir[slot][counter] = delta;
+            }
+            last[counter] = now[counter];
+        }
+    }
+
+    /**
+     * Print per-op averages and percentiles of every counter in every phase.
+     */
+    void print(const std::string& title)
+    {
+        if (!enabled) {
+            return;
+        }
+        std::cout << title << std::endl;
+        std::cout << Output::format("%-14s %-14s %10s %10s %10s %10s %10s",
+                                    "phase", "counter", "mean", "p50", "p90",
+                                    "p99", "max")
+                  << std::endl;
+        for (size_t phase = 0; phase < phaseNames.size(); ++phase) {
+            Phase& p = phases[phase];
+            if (p.count == 0) {
+                continue;
+            }
+            size_t kept = std::min(p.count, RESERVOIR_SIZE);
+            for (int counter = 0; counter < NUM_COUNTERS; ++counter) {
+                if (!group.has(counter)) {
+                    std::cout << Output::format("%-14s %-14s %10s",
+                                                phaseNames[phase].c_str(),
+                                                counterName(counter), "n/a")
+                              << std::endl;
+                    continue;
+                }
+                std::vector<uint64_t> values;
+                values.reserve(kept);
+                for (size_t i = 0; i < kept; ++i) {
+                    values.push_back(p.reservoir[i][counter]);
+                }
+                std::sort(values.begin(), values.end());
+                std::cout << Output::format(
+                                 "%-14s %-14s %10.1f %10lu %10lu %10lu %10lu",
+                                 phaseNames[phase].c_str(),
+                                 counterName(counter),
+                                 static_cast<double>(p.sums[counter]) /
+                                     p.count,
+                                 values[kept / 2], values[kept * 9 / 10],
+                                 values[kept * 99 / 100], p.maxima[counter])
+                          << std::endl;
+            }
+        }
+    }
+
+  private:
+    /// Samples of one phase.
+    struct Phase {
+        Phase()
+            : count(0)
+            , sums()
+            , maxima()
+            , reservoir()
+        {}
+
+        /// Number of ops that marked this phase.
+        uint64_t count;
+        std::array<uint64_t, NUM_COUNTERS> sums;
+        std::array<uint64_t, NUM_COUNTERS> maxima;
+        /// Counter deltas of up to RESERVOIR_SIZE ops.
+        std::vector<std::array<uint64_t, NUM_COUNTERS>> reservoir;
+    };
+
+    /// xorshift64*; cheap enough to run inside the measured code.
+    uint64_t nextRandom()
+    {
+        randomState ^= randomState >> 12;
+        randomState ^= randomState << 25;
+        randomState ^= randomState >> 27;
+        return randomState * 0x2545F4914F6CDD1Dull;
+    }
+
+    std::vector<std::string> phaseNames;
+    Group group;
+    bool enabled;
+    /// Counter values at the previous begin() or mark().
+    uint64_t last[NUM_COUNTERS];
+    std::vector<Phase> phases;
+    uint64_t randomState;
+};
+
+}  // namespace PerfCounters
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_PERFCOUNTERS_H
@@ -0,0 +1,126 @@
+#ifndef HOMARPCBENCH_REPEATDETECTOR_H
+#define HOMARPCBENCH_REPEATDETECTOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Payload.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Spots packets identical to a recent packet: the retransmissions and
+ * repeated control packets of loss recovery.
+ *
+ * A packet is its key (e.g. the addresses it travels between) followed by
+ * its payload.  The bytes of recent packets are kept in a ring, and a slot
+ * table indexed by their CRC32C points at the last packet seen with each
+ * hash.  A packet only counts as a repeat if its bytes equal the ones
+ * recorded, so a hash collision is never a repeat.  A repeat whose
+ * original was pushed out of the ring, or whose slot was taken by a later
+ * packet, is missed; the count can only be an underestimate.  Not
+ * thread-safe.
+ */
+class RepeatDetector {
+  public:
+    /**
+     * @param slots
+     *      Size of the slot table; a power of two.
+     * @param historyBytes
+     *      Size of the ring of recent packet bytes; packets larger than
+     *      this are never repeats.
+     */
+    RepeatDetector(size_t slots, size_t historyBytes)
+        : slots(slots)
+        , history(historyBytes)
+        , written(0)
+    {}
+
+    /**
+     * Return true if the packet matches a recent one, and remember it.
+     */
+    bool isRepeat(const void* key, size_t keyBytes, const void* payload,
+                  size_t payloadBytes)
+    {
+        uint32_t crc = Payload::crc32c(key, keyBytes);
+        crc = Payload::crc32c(payload, payloadBytes, crc);
+        uint64_t bytes = keyBytes + payloadBytes;
+        Slot& slot = slots[crc & (slots.size() - 1)];
+        bool repeat = slot.bytes == bytes && slot.crc == crc &&
+                      written - slot.position <= history.size() &&
+                      matches(slot.position, key, keyBytes) &&
+                      matches(slot.position + keyBytes, payload,
+                              payloadBytes);
+        if (bytes > history.size()) {
+            slot = Slot();
+            return repeat;
+        }
+        slot.crc = crc;
+        slot.bytes = bytes;
+        slot.position = written;
+        store(key, keyBytes);
+        store(payload, payloadBytes);
+        return repeat;
+    }
+
+  private:
+    /// Last packet seen with one hash.
+    struct Slot {
+        uint32_t crc;
+        /// Size of key and payload; 0 if the slot is unused.
+        uint64_t bytes;
+        /// Stream offset in the ring (see written) of the packet's bytes.
+        uint64_t position;
+
+        Slot()
+            : crc(0)
+            , bytes(0)
+            , position(0)
+        {}
+    };
+
+    /**
+     * Return true if the ring holds the given bytes at a stream offset.
+     */
+    bool matches(uint64_t position, const void* data, size_t count) const
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while (count > 0) {
+            size_t offset = position % history.size();
+            size_t chunk = std::min(count, history.size() - offset);
+            if (std::memcmp(history.data() + offset, bytes, chunk) != 0) {
+                return false;
+            }
+            position += chunk;
+            bytes += chunk;
+            count -= chunk;
+        }
+        return true;
+    }
+
+    void store(const void* data, size_t count)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while (count > 0) {
+            size_t offset = written % history.size();
+            size_t chunk = std::min(count, history.size() - offset);
+            std::memcpy(history.data() + offset, bytes, chunk);
+            written += chunk;
+            bytes += chunk;
+            count -= chunk;
+        }
+    }
+
+    std::vector<Slot> slots;
+    /// Ring of the bytes of recent packets.
+    std::vector<char> history;
+    /// Bytes ever stored in the ring; the stream offset of the next byte.
+    uint64_t written;
+};
+
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_REPEATDETECTOR_H
@@ -4,14 +4,52 @@
 #include <cstdint>
 #include <iostream>
 #include <map>
+#include <string>
+#include <vector>
 
 #include <Homa/Homa.h>
 
+#include "FlightRecorder.h"
 #include "WireFormat.h"
 
 namespace HomaRpcBench {
 namespace Rpc {
 
+/**
+ * Send an RPC that carries only its request header and wait for the
+ * response header.
+ *
+ * @tparam RpcType
+ *      WireFormat RPC struct; sets the opcode of the request.
+ * @tparam RemoteOp
+ *      Op type of the transport (Homa or Socket).
+ * @param transport
+ *      Transport used to send the request.
+ * @param destination
+ *      Address of the target server.
+ * @param request
+ *      Request header; all fields other than the opcode must be filled in.
+ * @param[out] response
+ *      If not nullptr, filled with the response header.
+ */
+template <typename RpcType, typename RemoteOp = Homa::RemoteOp,
+          typename Transport, typename Address>
+void
+call(Transport* transport, Address destination,
+     typename RpcType::Request* request,
+     typename RpcType::Response* response = nullptr)
+{
+    request->common.opcode = RpcType::opcode;
+
+    RemoteOp op(transport);
+    op.request->append(request, sizeof(*request));
+    op.send(destination);
+    op.wait();
+    if (response != nullptr) {
+        op.response->get(0, response, sizeof(*response));
+    }
+}
+
 void
 getServerList(Homa::Transport* transport, Homa::Driver::Address coordinatorAddr,
               std::map<uint64_t, Homa::Driver::Address>* serverMap)
@@ -40,32 +78,100 @@ getServerList(Homa::Transport* transport, Homa::Driver::Address coordinatorAddr,
     }
 }
 
+/**
+ * Enlist the server that owns a transport with the coordinator, so that
+ * clients find it in the server list.
+ *
+ * @return
+ *      Id the coordinator assigned to the server.
+ */
+uint64_t
+enlistServer(Homa::Transport* transport, Homa::Driver::Address coordinatorAddr)
+{
+    WireFormat::EnlistServerRpc::Request request;
+    WireFormat::EnlistServerRpc::Response response;
+    transport->driver->addressToWireFormat(
+        transport->driver->getLocalAddress(), &request.address);
+    call<WireFormat::EnlistServerRpc>(transport, coordinatorAddr, &request,
+                                      &response);
+    return response.serverId;
+}
+
 void
 configServer(Homa::Transport* transport, Homa::Driver::Address server,
              bool forward,
              Homa::Driver::Address nextServer = Homa::Driver::Address(0))
 {
     WireFormat::ConfigServerRpc::Request request;
-    request.common.opcode = WireFormat::ConfigServerRpc::opcode;
     request.forward = forward;
     transport->driver->addressToWireFormat(nextServer, &request.nextAddress);
-
-    Homa::RemoteOp op(transport);
-    op.request->append(&request, sizeof(request));
-    op.send(server);
-    op.wait();
+    call<WireFormat::ConfigServerRpc>(transport, server, &request);
 }
 
 void
 dumpTimeTrace(Homa::Transport* transport, Homa::Driver::Address server)
 {
     WireFormat::DumpTimeTraceRpc::Request request;
-    request.common.opcode = WireFormat::DumpTimeTraceRpc::opcode;
+    call<WireFormat::DumpTimeTraceRpc>(transport, server, &request);
+}
+
+void
+getServerStats(Homa::Transport* transport, Homa::Driver::Address server,
+               bool reset, WireFormat::ServerStatsRpc::Response* response)
+{
+    WireFormat::ServerStatsRpc::Request request;
+    request.reset = reset;
+    call<WireFormat::ServerStatsRpc>(transport, server, &request, response);
+}
+
+void
+flightRecorder(Homa::Transport* transport, Homa::Driver::Address server,
+               WireFormat::FlightRecorderRpc::Action action, uint64_t opId = 0)
+{
+    WireFormat::FlightRecorderRpc::Request request;
+    request.action = action;
+    request.opId = opId;
+    call<WireFormat::FlightRecorderRpc>(transport, server, &request);
+}
+
+/**
+ * Fetch a server's snapshot of the tracepoints of an op.
+ *
+ * @param[out] cyclesPerSecond
+ *      Set to the rate of the server's cycle counter.
+ * @param[out] events
+ *      Set to the recorded events; empty if the server has no snapshot of
+ *      the op.
+ */
+void
+fetchFlightRecord(Homa::Transport* transport, Homa::Driver::Address server,
+                  uint64_t opId, double* cyclesPerSecond,
+                  std::vector<FlightRecorder::NamedEvent>* events)
+{
+    events->clear();
+    WireFormat::FlightRecorderRpc::Request request;
+    request.common.opcode = WireFormat::FlightRecorderRpc::opcode;
+    request.action = WireFormat::FlightRecorderRpc::FETCH;
+    request.opId = opId;
 
     Homa::RemoteOp op(transport);
     op.request->append(&request, sizeof(request));
     op.send(server);
     op.wait();
+
+    WireFormat::FlightRecorderRpc::Response response;
+    op.response->get(0, &response, sizeof(response));
+    *cyclesPerSecond = response.cyclesPerSecond;
+    uint32_t offset = sizeof(response);
+    for (uint32_t i = 0; i < response.numEvents; ++i) {
+        WireFormat::FlightRecorderRpc::Event event;
+        op.response->get(offset, &event, sizeof(event));
+        offset += sizeof(event);
+        std::string name(event.nameLength, '\0');
+        op.response->get(offset, &name[0], event.nameLength);
+        offset += event.nameLength;
+        events->push_back({event.cycles, name});
+    }
 }
 
 }  // namespace Rpc
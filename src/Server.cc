@@ -0,0 +1,665 @@
+#include "Server.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <optional>
+
+#include <PerfUtils/TimeTrace.h>
+
+#include "Clock.h"
+#include "HopStamps.h"
+#include "Output.h"
+#include "Tracepoint.h"
+
+namespace HomaRpcBench {
+
+Server::Server(Homa::Transport* transport)
+    : transport(transport)
+    , serverId(0)
+    , quiet(false)
+    , proxy(false)
+    , delegate()
+    , bufferPool()
+    , pattern()
+    , patternSeed(0)
+    , patternCrcLength(0)
+    , patternCrc(0)
+    , verifyStats()
+    , goodputMessages(0)
+    , goodputBytes(0)
+    , goodputFirstCycle(0)
+    , goodputLastCycle(0)
+    , goodputHandlerCycles(0)
+    , handlerAllocs()
+    , echoProfiler({"deserialize", "nested", "reply"})
+    , flightRecorder(1024)
+    , flightSnapshots()
+    , heldOps()
+{}
+
+void
+Server::enablePerfCounters()
+{
+    echoProfiler.enable();
+}
+
+void
+Server::printPerfCounters()
+{
+    echoProfiler.print("server EchoRpc hardware counters per op:");
+}
+
+void
+Server::setServerId(uint64_t id)
+{
+    serverId = id;
+}
+
+/**
+ * Stop logging each ConfigServerRpc, for runs with many servers.
+ */
+void
+Server::setQuiet(bool quiet)
+{
+    this->quiet = quiet;
+}
+
+const Payload::VerifyStats&
+Server::getVerifyStats() const
+{
+    return verifyStats;
+}
+
+/**
+ * Handle at most one request and make progress on the transport.
+ *
+ * @return
+ *      True if a request was handled.
+ */
+bool
+Server::poll()
+{
+    uint64_t poll_start =
+        Tracepoint::isEnabled(Tracepoint::POLL) ? Clock::rdtsc() : 0;
+    Homa::ServerOp op = transport->receiveServerOp();
+    bool handled = static_cast<bool>(op);
+    if (op) {
+        Tracepoint::record(Tracepoint::POLL, poll_start,
+                           "Benchmark: Server::poll : START");
+        Tracepoint::record(
+            Tracepoint::POLL,
+            "Benchmark: Server::poll : ServerOp Constructed/Received");
+        dispatch(&op);
+    }
+    transport->poll();
+    return handled;
+}
+
+void
+Server::dispatch(Homa::ServerOp* op)
+{
+    if (!AllocTracker::ENABLED) {
+        if (!Dispatcher::dispatch(this, op)) {
+            std::cerr << "Unknown opcode" << std::endl;
+        }
+        return;
+    }
+
+    WireFormat::Common common;
+    op->request->get(0, &common, sizeof(common));
+    AllocTracker::Counters before = AllocTracker::snapshot();
+    if (!Dispatcher::dispatch(this, op)) {
+        std::cerr << "Unknown opcode" << std::endl;
+        return;
+    }
+    handlerAllocs[common.opcode].add(AllocTracker::snapshot() - before);
+}
+
+/**
+ * Print the heap allocations made by each handler, if allocation tracking
+ * is compiled in.
+ */
+void
+Server::printAllocStats() const
+{
+    if (!AllocTracker::ENABLED) {
+        return;
+    }
+    std::cout << "Heap allocations per op by opcode:" << std::endl;
+    for (int opcode = 0; opcode < WireFormat::ILLEGAL_OPCODE; ++opcode) {
+        const AllocTracker::OpStats& stats = handlerAllocs[opcode];
+        if (stats.ops == 0) {
+            continue;
+        }
+        std::cout << Output::format(
+                         "  opcode %d: %lu ops, %.2f allocs/op (max %lu), "
+                         "%.2f frees/op, %.1f bytes/op, %.1f cycles/op",
+                         opcode, stats.ops,
+                         double(stats.total.allocations) / stats.ops,
+                         stats.maxAllocations,
+                         double(stats.total.frees) / stats.ops,
+                         double(stats.total.bytes) / stats.ops,
+                         double(stats.total.cycles) / stats.ops)
+                  << std::endl;
+    }
+}
+
+void
+Server::handleConfigServerRpc(
+    Homa::ServerOp* op, const WireFormat::ConfigServerRpc::Request& request)
+{
+    WireFormat::ConfigServerRpc::Response response;
+    proxy = request.forward;
+    if (proxy) {
+        delegate = transport->driver->getAddress(&request.nextAddress);
+    }
+
+    response.common.opcode = WireFormat::ConfigServerRpc::opcode;
+    op->response->append(&response, sizeof(response));
+    op->reply();
+    if (quiet) {
+        return;
+    }
+    if (proxy) {
+        std::cout << "Server configured as proxy to "
+                  << transport->driver->addressToString(delegate) << std::endl;
+    } else {
+        std::cout << "Server configured" << std::endl;
+    }
+}
+
+void
+Server::handleDumpTimeTraceRpc(
+    Homa::ServerOp* op, const WireFormat::DumpTimeTraceRpc::Request& request)
+{
+    PerfUtils::TimeTrace::print();
+    op->reply();
+}
+
+void
+Server::handleEchoRpc(Homa::ServerOp* op,
+                      const WireFormat::EchoRpc::Request& request)
+{
+    bool stampHops = request.flags & WireFormat::EchoRpc::HOP_STAMPS;
+    uint64_t receiveCycles = stampHops ? Clock::rdtsc() : 0;
+    flightRecorder.begin(request.opId);
+    flightRecorder.trace(Tracepoint::ECHO,
+                         "Benchmark: Server::handleEchoRpc : START");
+    echoProfiler.begin();
+    WireFormat::EchoRpc::Response response;
+    response.common.opcode = WireFormat::EchoRpc::opcode;
+    response.hopCount = 1;
+    response.responseBytes = request.responseBytes;
+    response.payloadCrc = 0;
+    if (request.sentBytes > BufferPool::MAX_BUFFER_BYTES ||
+        request.responseBytes > BufferPool::MAX_BUFFER_BYTES) {
+        std::cerr << "Echo request of " << request.sentBytes
+                  << " bytes with a " << request.responseBytes
+                  << " byte response exceeds the "
+                  << BufferPool::MAX_BUFFER_BYTES << " byte limit"
+                  << std::endl;
+        response.responseBytes = 0;
+        op->response->append(&response, sizeof(response));
+        op->reply();
+        flightRecorder.end();
+        return;
+    }
+    BufferPool::Buffer buffer = bufferPool.acquire(
+        std::max(request.sentBytes, request.responseBytes));
+    if (!Payload::read(op->request, sizeof(request), buffer.get(),
+                       request.sentBytes, buffer.capacity())) {
+        std::cerr << "Echo request is shorter than its " << request.sentBytes
+                  << " byte payload" << std::endl;
+    }
+    flightRecorder.trace(
+        Tracepoint::ECHO,
+        "Benchmark: Server::handleEchoRpc : Request deserialized");
+
+    bool verify = request.flags & WireFormat::EchoRpc::VERIFY_PAYLOAD;
+    if (verify) {
+        if (!Payload::verify(buffer.get(), request.sentBytes,
+                             request.payloadCrc, &verifyStats)) {
+            std::cerr << "Request payload failed CRC32C verification"
+                      << std::endl;
+        }
+        flightRecorder.trace(
+            Tracepoint::ECHO,
+            "Benchmark: Server::handleEchoRpc : Request verified");
+    }
+    echoProfiler.mark(ECHO_DESERIALIZE);
+
+    const char* responsePayload = buffer.get();
+
+    // A hop limit lets one chain configuration serve ops of any length.
+    bool forward = proxy && request.hopLimit != 1;
+    // Outlives the nested round trip until its hop stamps are copied.
+    std::optional<Homa::RemoteOp> proxyOp;
+    uint64_t forwardCycles = 0;
+    uint64_t returnCycles = 0;
+    uint32_t nestedHopCount = 0;
+    if (forward) {
+        WireFormat::EchoRpc::Request nestedRequest = request;
+        if (nestedRequest.hopLimit > 1) {
+            nestedRequest.hopLimit--;
+        }
+        flightRecorder.trace(
+            Tracepoint::NESTED,
+            "Benchmark: Server::handleEchoRpc : Nested : START");
+        proxyOp.emplace(transport);
+        flightRecorder.trace(
+            Tracepoint::NESTED,
+            "Benchmark: Server::handleEchoRpc : Nested : RemoteOp constructed");
+        proxyOp->request->append(&nestedRequest, sizeof(nestedRequest));
+        proxyOp->request->append(buffer.get(), request.sentBytes);
+        flightRecorder.trace(
+            Tracepoint::NESTED,
+            "Benchmark: Server::handleEchoRpc : Nested : Request serialized");
+
+        if (stampHops) {
+            forwardCycles = Clock::rdtsc();
+        }
+        proxyOp->send(delegate);
+        flightRecorder.trace(
+            Tracepoint::NESTED,
+            "Benchmark: Server::handleEchoRpc : Nested : Request sent");
+        proxyOp->wait();
+        if (stampHops) {
+            returnCycles = Clock::rdtsc();
+        }
+        flightRecorder.trace(
+            Tracepoint::NESTED,
+            "Benchmark: Server::handleEchoRpc : Nested : Response received");
+
+        WireFormat::EchoRpc::Response proxyResponse;
+        proxyOp->response->get(0, &proxyResponse, sizeof(proxyResponse));
+        if (proxyResponse.responseBytes != request.responseBytes) {
+            std::cerr << "Expected " << request.responseBytes
+                      << " bytes but only got " << proxyResponse.responseBytes
+                      << " bytes." << std::endl;
+        }
+        if (!Payload::read(proxyOp->response, sizeof(proxyResponse),
+                           buffer.get(), proxyResponse.responseBytes,
+                           buffer.capacity())) {
+            std::cerr << "Nested response payload of "
+                      << proxyResponse.responseBytes
+                      << " bytes is truncated or too large" << std::endl;
+            proxyResponse.responseBytes = 0;
+        }
+        response.responseBytes = proxyResponse.responseBytes;
+        response.hopCount += proxyResponse.hopCount;
+        nestedHopCount = proxyResponse.hopCount;
+        flightRecorder.trace(
+            Tracepoint::NESTED,
+            "Benchmark: Server::handleEchoRpc : Nested : "
+            "Response deserialized");
+        if (verify) {
+            if (!Payload::verify(buffer.get(), proxyResponse.responseBytes,
+                                 proxyResponse.payloadCrc, &verifyStats)) {
+                std::cerr << "Nested response payload failed CRC32C "
+                             "verification"
+                          << std::endl;
+            }
+            response.payloadCrc = proxyResponse.payloadCrc;
+            flightRecorder.trace(
+                Tracepoint::NESTED,
+                "Benchmark: Server::handleEchoRpc : Nested : "
+                "Response verified");
+        }
+    } else if (verify) {
+        // Response is packed; getPattern() needs an aligned uint32_t.
+        uint32_t crc;
+        responsePayload =
+            getPattern(request.patternSeed, response.responseBytes, &crc);
+        response.payloadCrc = crc;
+    }
+    if (forward) {
+        echoProfiler.mark(ECHO_NESTED);
+    }
+
+    op->response->append(&response, sizeof(response));
+    op->response->append(responsePayload, response.responseBytes);
+    if (stampHops) {
+        // Downstream stamps first, so that this hop's reply stamp is taken
+        // as late as possible.
+        if (forward) {
+            HopStamps::copy(proxyOp->response,
+                            sizeof(WireFormat::EchoRpc::Response) +
+                                response.responseBytes,
+                            nestedHopCount, op->response);
+        }
+        WireFormat::HopStamp stamp =
+            HopStamps::make(serverId, receiveCycles, forwardCycles,
+                            returnCycles, Clock::rdtsc());
+        op->response->append(&stamp, sizeof(stamp));
+    }
+    proxyOp.reset();
+    flightRecorder.trace(
+        Tracepoint::ECHO,
+        "Benchmark: Server::handleEchoRpc : Response serialized");
+    op->reply();
+    flightRecorder.trace(
+        Tracepoint::ECHO,
+        "Benchmark: Server::handleEchoRpc : Response sent (reply)");
+    echoProfiler.mark(ECHO_REPLY);
+    flightRecorder.end();
+}
+
+void
+Server::handleEchoMultiLevelRpc(
+    Homa::ServerOp* op, const WireFormat::EchoMultiLevelRpc::Request& request)
+{
+    bool stampHops = request.flags & WireFormat::EchoRpc::HOP_STAMPS;
+    uint64_t receiveCycles = stampHops ? Clock::rdtsc() : 0;
+    flightRecorder.begin(request.opId);
+    flightRecorder.trace(Tracepoint::ECHO,
+                         "Benchmark: Server::handleEchoMultiLevelRpc : START");
+    WireFormat::EchoMultiLevelRpc::Response response;
+    response.common.opcode = WireFormat::EchoMultiLevelRpc::opcode;
+    response.numHopStamps = 0;
+    response.responseBytes = request.responseBytes;
+    if (request.sentBytes > BufferPool::MAX_BUFFER_BYTES ||
+        request.responseBytes > BufferPool::MAX_BUFFER_BYTES) {
+        std::cerr << "Echo request of " << request.sentBytes
+                  << " bytes with a " << request.responseBytes
+                  << " byte response exceeds the "
+                  << BufferPool::MAX_BUFFER_BYTES << " byte limit"
+                  << std::endl;
+        response.responseBytes = 0;
+        op->response->append(&response, sizeof(response));
+        op->reply();
+        flightRecorder.end();
+        return;
+    }
+    BufferPool::Buffer buffer = bufferPool.acquire(
+        std::max(request.sentBytes, request.responseBytes));
+    if (!Payload::read(op->request, sizeof(request), buffer.get(),
+                       request.sentBytes, buffer.capacity())) {
+        std::cerr << "Echo request is shorter than its " << request.sentBytes
+                  << " byte payload" << std::endl;
+    }
+    flightRecorder.trace(
+        Tracepoint::ECHO,
+        "Benchmark: Server::handleEchoMultiLevelRpc : Request deserialized");
+
+    // Stamps of the hops that delegated the op so far follow the payload.
+    uint32_t stampsOffset = sizeof(request) + request.sentBytes;
+    if (proxy) {
+        WireFormat::EchoMultiLevelRpc::Request delegatedRequest = request;
+        if (stampHops) {
+            delegatedRequest.numHopStamps++;
+        }
+        op->response->append(&delegatedRequest, sizeof(delegatedRequest));
+        op->response->append(buffer.get(), request.sentBytes);
+        if (stampHops) {
+            HopStamps::copy(op->request, stampsOffset, request.numHopStamps,
+                            op->response);
+            WireFormat::HopStamp stamp = HopStamps::make(
+                serverId, receiveCycles, Clock::rdtsc(), 0, 0);
+            op->response->append(&stamp, sizeof(stamp));
+        }
+        op->delegate(delegate);
+        flightRecorder.trace(
+            Tracepoint::ECHO,
+            "Benchmark: Server::handleEchoMultiLevelRpc : Request delegated");
+    } else {
+        if (stampHops) {
+            response.numHopStamps = request.numHopStamps + 1;
+        }
+        op->response->append(&response, sizeof(response));
+        op->response->append(buffer.get(), response.responseBytes);
+        if (stampHops) {
+            HopStamps::copy(op->request, stampsOffset, request.numHopStamps,
+                            op->response);
+            WireFormat::HopStamp stamp = HopStamps::make(
+                serverId, receiveCycles, 0, 0, Clock::rdtsc());
+            op->response->append(&stamp, sizeof(stamp));
+        }
+        op->reply();
+        flightRecorder.trace(
+            Tracepoint::ECHO,
+            "Benchmark: Server::handleEchoMultiLevelRpc : Response sent");
+    }
+    flightRecorder.end();
+}
+
+void
+Server::handleEchoBatchRpc(Homa::ServerOp* op,
+                           const WireFormat::EchoBatchRpc::Request& request)
+{
+    WireFormat::EchoBatchRpc::Response response;
+    response.common.opcode = WireFormat::EchoBatchRpc::opcode;
+    // Every sub-request takes at least sizeof(SubRequest) bytes, which
+    // bounds the sub-responses a bad header can make this op build.
+    uint32_t numOps = std::min<uint64_t>(
+        request.numOps, (op->request->length() - sizeof(request)) /
+                            sizeof(WireFormat::EchoBatchRpc::SubRequest));
+    if (numOps < request.numOps) {
+        std::cerr << "Echo batch of " << op->request->length()
+                  << " bytes cannot hold " << request.numOps
+                  << " sub-requests" << std::endl;
+    }
+    response.numOps = numOps;
+    op->response->append(&response, sizeof(response));
+    // Every sub-request gets a sub-response, so that the client can match
+    // them up; those after a malformed one are empty.
+    uint32_t offset = sizeof(request);
+    bool malformed = false;
+    for (uint32_t i = 0; i < numOps; ++i) {
+        WireFormat::EchoBatchRpc::SubRequest subRequest;
+        WireFormat::EchoBatchRpc::SubResponse subResponse;
+        subResponse.responseBytes = 0;
+        if (!malformed &&
+            op->request->get(offset, &subRequest, sizeof(subRequest)) !=
+                sizeof(subRequest)) {
+            std::cerr << "Echo batch ends after " << i << " of its "
+                      << request.numOps << " sub-requests" << std::endl;
+            malformed = true;
+        }
+        if (!malformed &&
+            (subRequest.sentBytes > BufferPool::MAX_BUFFER_BYTES ||
+             subRequest.responseBytes > BufferPool::MAX_BUFFER_BYTES)) {
+            std::cerr << "Echo sub-request of " << subRequest.sentBytes
+                      << " bytes with a " << subRequest.responseBytes
+                      << " byte response exceeds the "
+                      << BufferPool::MAX_BUFFER_BYTES << " byte limit"
+                      << std::endl;
+            malformed = true;
+        }
+        if (malformed) {
+            op->response->append(&subResponse, sizeof(subResponse));
+            continue;
+        }
+        offset += sizeof(subRequest);
+        BufferPool::Buffer buffer = bufferPool.acquire(
+            std::max(subRequest.sentBytes, subRequest.responseBytes));
+        if (!Payload::read(op->request, offset, buffer.get(),
+                           subRequest.sentBytes, buffer.capacity())) {
+            std::cerr << "Echo sub-request is shorter than its "
+                      << subRequest.sentBytes << " byte payload"
+                      << std::endl;
+            malformed = true;
+            op->response->append(&subResponse, sizeof(subResponse));
+            continue;
+        }
+        offset += subRequest.sentBytes;
+        subResponse.responseBytes = subRequest.responseBytes;
+        op->response->append(&subResponse, sizeof(subResponse));
+        op->response->append(buffer.get(), subResponse.responseBytes);
+    }
+    op->reply();
+}
+
+void
+Server::handleHoldRpc(Homa::ServerOp* op,
+                      const WireFormat::HoldRpc::Request& request)
+{
+    if (!request.release) {
+        heldOps.push_back(std::move(*op));
+        return;
+    }
+    WireFormat::HoldRpc::Response response;
+    response.common.opcode = WireFormat::HoldRpc::opcode;
+    response.heldOps = 0;
+    for (Homa::ServerOp& held : heldOps) {
+        held.response->append(&response, sizeof(response));
+        held.reply();
+    }
+    response.heldOps = heldOps.size();
+    heldOps.clear();
+    op->response->append(&response, sizeof(response));
+    op->reply();
+}
+
+void
+Server::handleGoodputRpc(Homa::ServerOp* op,
+                         const WireFormat::GoodputRpc::Request& request)
+{
+    uint64_t start = Clock::rdtsc();
+    if (goodputFirstCycle == 0) {
+        goodputFirstCycle = start;
+    }
+    if (request.sentBytes > BufferPool::MAX_BUFFER_BYTES) {
+        std::cerr << "Goodput message of " << request.sentBytes
+                  << " bytes exceeds the " << BufferPool::MAX_BUFFER_BYTES
+                  << " byte limit" << std::endl;
+    } else {
+        // Consume the payload as a real receiver would.
+        BufferPool::Buffer buffer = bufferPool.acquire(request.sentBytes);
+        if (!Payload::read(op->request, sizeof(request), buffer.get(),
+                           request.sentBytes, buffer.capacity())) {
+            std::cerr << "Goodput message is shorter than its "
+                      << request.sentBytes << " byte payload" << std::endl;
+        }
+        goodputMessages++;
+        goodputBytes += request.sentBytes;
+    }
+
+    WireFormat::GoodputRpc::Response response;
+    response.common.opcode = WireFormat::GoodputRpc::opcode;
+    op->response->append(&response, sizeof(response));
+    op->reply();
+    goodputLastCycle = Clock::rdtsc();
+    goodputHandlerCycles += goodputLastCycle - start;
+}
+
+void
+Server::handleServerStatsRpc(
+    Homa::ServerOp* op, const WireFormat::ServerStatsRpc::Request& request)
+{
+    WireFormat::ServerStatsRpc::Response response;
+    response.common.opcode = WireFormat::ServerStatsRpc::opcode;
+    response.cyclesPerSecond = Clock::perSecond();
+    response.goodputMessages = goodputMessages;
+    response.goodputBytes = goodputBytes;
+    response.goodputActiveCycles =
+        goodputFirstCycle == 0 ? 0 : goodputLastCycle - goodputFirstCycle;
+    response.goodputHandlerCycles = goodputHandlerCycles;
+    AllocTracker::OpStats benchmarkAllocs;
+    for (WireFormat::Opcode opcode :
+         {WireFormat::ECHO, WireFormat::ECHO_MULTILEVEL, WireFormat::ECHO_BATCH,
+          WireFormat::GOODPUT}) {
+        benchmarkAllocs.ops += handlerAllocs[opcode].ops;
+        benchmarkAllocs.total += handlerAllocs[opcode].total;
+    }
+    response.handlerOps = benchmarkAllocs.ops;
+    response.handlerAllocations = benchmarkAllocs.total.allocations;
+    response.handlerFrees = benchmarkAllocs.total.frees;
+    response.handlerAllocatedBytes = benchmarkAllocs.total.bytes;
+    response.handlerAllocatorCycles = benchmarkAllocs.total.cycles;
+    op->response->append(&response, sizeof(response));
+    op->reply();
+
+    if (request.reset) {
+        goodputMessages = 0;
+        goodputBytes = 0;
+        goodputFirstCycle = 0;
+        goodputLastCycle = 0;
+        goodputHandlerCycles = 0;
+        for (AllocTracker::OpStats& stats : handlerAllocs) {
+            stats = AllocTracker::OpStats();
+        }
+    }
+}
+
+void
+Server::handleFlightRecorderRpc(
+    Homa::ServerOp* op, const WireFormat::FlightRecorderRpc::Request& request)
+{
+    WireFormat::FlightRecorderRpc::Response response;
+    response.common.opcode = WireFormat::FlightRecorderRpc::opcode;
+    response.cyclesPerSecond = Clock::perSecond();
+    response.numEvents = 0;
+
+    switch (request.action) {
+        case WireFormat::FlightRecorderRpc::ENABLE:
+        case WireFormat::FlightRecorderRpc::DISABLE:
+            flightRecorder.setEnabled(request.action ==
+                                      WireFormat::FlightRecorderRpc::ENABLE);
+            flightSnapshots.clear();
+            break;
+        case WireFormat::FlightRecorderRpc::SNAPSHOT: {
+            const FlightRecorder::OpRecord* record =
+                flightRecorder.find(request.opId);
+            if (record != nullptr) {
+                flightSnapshots[request.opId] = *record;
+            }
+            break;
+        }
+        case WireFormat::FlightRecorderRpc::FETCH: {
+            auto it = flightSnapshots.find(request.opId);
+            if (it == flightSnapshots.end()) {
+                break;
+            }
+            const FlightRecorder::OpRecord& record = it->second;
+            response.numEvents = record.numEvents;
+            op->response->append(&response, sizeof(response));
+            for (uint32_t i = 0; i < record.numEvents; ++i) {
+                WireFormat::FlightRecorderRpc::Event event;
+                event.cycles = record.events[i].cycles;
+                event.nameLength = strlen(record.events[i].name);
+                op->response->append(&event, sizeof(event));
+                op->response->append(record.events[i].name, event.nameLength);
+            }
+            flightSnapshots.erase(it);
+            op->reply();
+            return;
+        }
+        default:
+            std::cerr << "Unknown flight recorder action "
+                      << int(request.action) << std::endl;
+            break;
+    }
+    op->response->append(&response, sizeof(response));
+    op->reply();
+}
+
+/**
+ * Return the verification pattern for the given seed, regenerating the
+ * cached copy only when the seed changes or a longer payload is needed.
+ *
+ * @param seed
+ *      Pattern seed carried in the request.
+ * @param length
+ *      Number of pattern bytes needed.
+ * @param[out] crc
+ *      Set to the CRC32C of the first length bytes of the pattern.
+ */
+const char*
+Server::getPattern(uint32_t seed, uint32_t length, uint32_t* crc)
+{
+    if (seed != patternSeed || length > pattern.size()) {
+        pattern.resize(std::max<size_t>(length, pattern.size()));
+        Payload::fillPattern(pattern.data(), pattern.size(), seed);
+        patternSeed = seed;
+        patternCrcLength = length;
+        patternCrc = Payload::crc32c(pattern.data(), length);
+    } else if (length != patternCrcLength) {
+        patternCrcLength = length;
+        patternCrc = Payload::crc32c(pattern.data(), length);
+    }
+    *crc = patternCrc;
+    return pattern.data();
+}
+
+}  // namespace HomaRpcBench
@@ -0,0 +1,133 @@
+#ifndef HOMARPCBENCH_SERVER_H
+#define HOMARPCBENCH_SERVER_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <Homa/Homa.h>
+
+#include "AllocTracker.h"
+#include "BufferPool.h"
+#include "Dispatch.h"
+#include "FlightRecorder.h"
+#include "Payload.h"
+#include "PerfCounters.h"
+#include "WireFormat.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Implements the server-side benchmark functionality.
+ */
+class Server {
+  public:
+    explicit Server(Homa::Transport* transport);
+
+    bool poll();
+    const Payload::VerifyStats& getVerifyStats() const;
+    void printAllocStats() const;
+    void enablePerfCounters();
+    void printPerfCounters();
+    void setServerId(uint64_t id);
+    void setQuiet(bool quiet);
+
+  private:
+    void dispatch(Homa::ServerOp* op);
+    void handleConfigServerRpc(
+        Homa::ServerOp* op,
+        const WireFormat::ConfigServerRpc::Request& request);
+    void handleDumpTimeTraceRpc(
+        Homa::ServerOp* op,
+        const WireFormat::DumpTimeTraceRpc::Request& request);
+    void handleEchoRpc(Homa::ServerOp* op,
+                       const WireFormat::EchoRpc::Request& request);
+    void handleEchoMultiLevelRpc(
+        Homa::ServerOp* op,
+        const WireFormat::EchoMultiLevelRpc::Request& request);
+    void handleEchoBatchRpc(Homa::ServerOp* op,
+                            const WireFormat::EchoBatchRpc::Request& request);
+    void handleHoldRpc(Homa::ServerOp* op,
+                       const WireFormat::HoldRpc::Request& request);
+    void handleGoodputRpc(Homa::ServerOp* op,
+                          const WireFormat::GoodputRpc::Request& request);
+    void handleServerStatsRpc(
+        Homa::ServerOp* op, const WireFormat::ServerStatsRpc::Request& request);
+    void handleFlightRecorderRpc(
+        Homa::ServerOp* op,
+        const WireFormat::FlightRecorderRpc::Request& request);
+
+    /// dispatch_bench times a copy of this table; keep the two in step.
+    using Dispatcher = Dispatch::Table<
+        Server, Homa::ServerOp,
+        Dispatch::Route<WireFormat::ConfigServerRpc,
+                        &Server::handleConfigServerRpc>,
+        Dispatch::Route<WireFormat::DumpTimeTraceRpc,
+                        &Server::handleDumpTimeTraceRpc>,
+        Dispatch::Route<WireFormat::EchoRpc, &Server::handleEchoRpc>,
+        Dispatch::Route<WireFormat::EchoMultiLevelRpc,
+                        &Server::handleEchoMultiLevelRpc>,
+        Dispatch::Route<WireFormat::EchoBatchRpc, &Server::handleEchoBatchRpc>,
+        Dispatch::Route<WireFormat::HoldRpc, &Server::handleHoldRpc>,
+        Dispatch::Route<WireFormat::GoodputRpc, &Server::handleGoodputRpc>,
+        Dispatch::Route<WireFormat::ServerStatsRpc,
+                        &Server::handleServerStatsRpc>,
+        Dispatch::Route<WireFormat::FlightRecorderRpc,
+                        &Server::handleFlightRecorderRpc>>;
+
+    const char* getPattern(uint32_t seed, uint32_t length, uint32_t* crc);
+
+    /// Phases of handleEchoRpc in which hardware counters are sampled.
+    enum EchoPhase {
+        ECHO_DESERIALIZE,
+        ECHO_NESTED,
+        ECHO_REPLY,
+    };
+
+    Homa::Transport* transport;
+    /// Id assigned by the coordinator, carried in hop stamps; 0 until set.
+    uint64_t serverId;
+    /// If set, configuration changes are not logged.
+    bool quiet;
+    bool proxy;
+    Homa::Driver::Address delegate;
+    /// Source of the payload buffers used while handling each op.
+    BufferPool bufferPool;
+
+    /// Cached payload pattern used to generate verifiable responses; see
+    /// getPattern().
+    std::vector<char> pattern;
+    uint32_t patternSeed;
+    uint32_t patternCrcLength;
+    uint32_t patternCrc;
+    /// Cost and outcome of payload verification done by this server.
+    Payload::VerifyStats verifyStats;
+
+    /// Counters reported by ServerStatsRpc; see its Response.
+    uint64_t goodputMessages;
+    uint64_t goodputBytes;
+    /// Cycle time of the first goodput message since the last reset, or 0.
+    uint64_t goodputFirstCycle;
+    /// Cycle time at which the last goodput reply was sent.
+    uint64_t goodputLastCycle;
+    uint64_t goodputHandlerCycles;
+
+    /// Heap allocations made while handling each opcode since the last
+    /// reset; only maintained when AllocTracker::ENABLED.
+    AllocTracker::OpStats handlerAllocs[WireFormat::ILLEGAL_OPCODE];
+
+    /// Hardware counters per EchoPhase; idle unless enablePerfCounters().
+    PerfCounters::PhaseProfiler echoProfiler;
+
+    /// Tracepoints of recent echo ops; idle until a client enables it with
+    /// FlightRecorderRpc.
+    FlightRecorder::Recorder flightRecorder;
+    /// Records of the ops a client asked to keep, by op id.
+    std::map<uint64_t, FlightRecorder::OpRecord> flightSnapshots;
+    /// Ops kept open by HoldRpc until a release.
+    std::vector<Homa::ServerOp> heldOps;
+};
+
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_SERVER_H
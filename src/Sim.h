@@ -0,0 +1,776 @@
+#ifndef HOMARPCBENCH_SIM_H
+#define HOMARPCBENCH_SIM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Homa/Driver.h>
+
+#include "Clock.h"
+#include "Output.h"
+#include "RepeatDetector.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Discrete-event simulation of a cluster of Homa hosts, so that the
+ * coordinator, the client and the servers run in one process on a laptop
+ * and a run can be repeated (see below for when it can be).
+ *
+ * Every host has a Sim::Driver in place of a real driver.  A host sends
+ * through its uplink (one FIFO at the link rate) to a single output-queued
+ * switch, whose port to each host has one strict priority queue per packet
+ * priority; each link adds a propagation delay.  Time is the virtual time
+ * of Clock, which only the network moves: a host that polls its driver and
+ * finds nothing to receive lets the network take one step, either running
+ * another host that has work, or processing the next event (a packet
+ * reaching the switch, leaving a switch port, or reaching a host), or, if
+ * nothing is due within pollNs, letting pollNs pass.  Hosts that have a
+ * poller (the servers and the coordinator) only run from such steps; the
+ * client runs on top and drives the network by polling.  A host that blocks
+ * in its own poll loop (a server waiting for a nested op) steps the network
+ * from there, so blocking handlers work unchanged; a host is never
+ * re-entered while its code is on the stack.
+ *
+ * The network is described by a spec: a comma separated list of
+ * <key>=<value> where key is one of
+ *      servers     Number of simulated servers [default: 4].
+ *      gbps        Rate of every link [default: 100].
+ *      delayNs     Propagation delay of each link [default: 250].
+ *      jitterNs    Extra delay of each packet on the uplink, uniform in
+ *                  [0, jitterNs] and drawn from the seed [default: 0].
+ *      priorities  Number of priority queues per switch port [default: 8].
+ *      queueKB     Capacity of each switch port; packets that do not fit
+ *                  are dropped; 0 for no limit [default: 0].
+ *      mtu         Largest packet payload in bytes [default: 1500].
+ *      pollNs      Virtual time an idle poll takes [default: 100].
+ * e.g. "servers=200,gbps=25,jitterNs=50,queueKB=500".
+ *
+ * The network itself is deterministic, but a run is only reproducible if
+ * the Homa library's timers never fire: libHoma inlines its reads of the
+ * real cycle counter (PerfUtils::Cycles::rdtsc()), which virtual time does
+ * not drive, so whether a resend, ping or busy packet is sent depends on
+ * how fast the simulation runs.  That happens after a drop (queueKB, or
+ * Faults), and also without one if the run is slow enough in real time.
+ * A timer that fires almost always makes some packet repeat an earlier one
+ * between the same hosts (the resent data, a repeated resend or ping, or a
+ * grant sent again), so the network counts such packets (Stats::repeats)
+ * and isReproducible() is false once there has been one; the client then
+ * fails the run.  Not thread-safe; everything runs on the calling thread.
+ * Only compiles in the simulation build, where Clock is virtual.
+ */
+namespace Sim {
+
+/// Ethernet header, FCS, preamble and inter-packet gap of every packet.
+static const uint32_t PACKET_OVERHEAD_BYTES = 42;
+/// Largest mtu accepted; the size of every packet buffer.
+static const uint32_t MAX_PAYLOAD_BYTES = 9000;
+/// Largest number of priorities accepted.
+static const int MAX_PRIORITIES = 8;
+
+struct Config {
+    uint32_t servers;
+    double gbps;
+    uint64_t delayNs;
+    uint64_t jitterNs;
+    int priorities;
+    uint64_t queueBytes;
+    uint32_t mtu;
+    uint64_t pollNs;
+    /// Seed of the jitter; set from --seed, so that one seed reproduces the
+    /// workload and the network.
+    uint64_t seed;
+
+    Config()
+        : servers(4)
+        , gbps(100)
+        , delayNs(250)
+        , jitterNs(0)
+        , priorities(MAX_PRIORITIES)
+        , queueBytes(0)
+        , mtu(1500)
+        , pollNs(100)
+        , seed(1)
+    {}
+};
+
+/**
+ * Parse a network spec (see above).  Returns false and prints a message if
+ * the spec is malformed.
+ */
+inline bool
+parseConfig(const std::string& spec, Config* config)
+{
+    *config = Config();
+    std::stringstream entries(spec);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        if (entry.empty()) {
+            continue;
+        }
+        size_t equals = entry.find('=');
+        if (equals == std::string::npos) {
+            std::cerr << "Simulation spec entry " << entry << " has no value"
+                      << std::endl;
+            return false;
+        }
+        std::string key = entry.substr(0, equals);
+        std::string value = entry.substr(equals + 1);
+        try {
+            if (key == "servers") {
+                config->servers = std::stoul(value);
+            } else if (key == "gbps") {
+                config->gbps = std::stod(value);
+            } else if (key == "delayNs") {
+                config->delayNs = std::stoull(value);
+            } else if (key == "jitterNs") {
+                config->jitterNs = std::stoull(value);
+            } else if (key == "priorities") {
+                config->priorities = std::stoi(value);
+            } else if (key == "queueKB") {
+                config->queueBytes = std::stoull(value) * 1000;
+            } else if (key == "mtu") {
+                config->mtu = std::stoul(value);
+            } else if (key == "pollNs") {
+                config->pollNs = std::stoull(value);
+            } else {
+                std::cerr << "Unknown simulation parameter " << key
+                          << std::endl;
+                return false;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Bad value in simulation spec entry " << entry
+                      << std::endl;
+            return false;
+        }
+    }
+    if (config->servers == 0 || config->gbps <= 0 ||
+        config->priorities < 1 || config->priorities > MAX_PRIORITIES ||
+        config->mtu == 0 || config->mtu > MAX_PAYLOAD_BYTES ||
+        config->pollNs == 0) {
+        std::cerr << "Simulation needs servers, gbps and pollNs above 0, "
+                  << "priorities in [1, " << MAX_PRIORITIES
+                  << "] and mtu in [1, " << MAX_PAYLOAD_BYTES << "]"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Packet of the simulated network; the payload lives in the packet.
+ */
+class Packet : public Homa::Driver::Packet {
+  public:
+    Packet()
+        : Homa::Driver::Packet(buffer)
+        , source(0)
+        , destination(0)
+        , buffer()
+    {}
+
+    /// Hosts, by index, that sent the packet and that it is going to.
+    uint32_t source;
+    uint32_t destination;
+
+  private:
+    char buffer[MAX_PAYLOAD_BYTES];
+};
+
+class Network;
+
+/**
+ * Homa::Driver of one simulated host; see Network::addHost().  Addresses
+ * are the index of the host plus one, written "sim:<index>".
+ */
+class Driver final : public Homa::Driver {
+  public:
+    Driver(Network* network, uint32_t host)
+        : network(network)
+        , host(host)
+    {}
+
+    Address getAddress(std::string const* const addressString) override
+    {
+        size_t colon = addressString->find(':');
+        return std::stoull(addressString->substr(colon + 1)) + 1;
+    }
+
+    Address getAddress(WireFormatAddress const* const wireAddress) override
+    {
+        Address address;
+        std::memcpy(&address, wireAddress->bytes, sizeof(address));
+        return address;
+    }
+
+    std::string addressToString(const Address address) override
+    {
+        return "sim:" + std::to_string(address - 1);
+    }
+
+    void addressToWireFormat(const Address address,
+                             WireFormatAddress* wireAddress) override
+    {
+        std::memset(wireAddress, 0, sizeof(*wireAddress));
+        std::memcpy(wireAddress->bytes, &address, sizeof(address));
+    }
+
+    Homa::Driver::Packet* allocPacket() override;
+    void sendPacket(Homa::Driver::Packet* packet) override;
+    uint32_t receivePackets(uint32_t maxPackets,
+                            Homa::Driver::Packet* receivedPackets[]) override;
+    void releasePackets(Homa::Driver::Packet* packets[],
+                        uint16_t numPackets) override;
+    int getHighestPacketPriority() override;
+    uint32_t getMaxPayloadSize() override;
+    uint32_t getBandwidth() override;
+    uint32_t getQueuedBytes() override;
+
+    Address getLocalAddress() override
+    {
+        return host + 1;
+    }
+
+  private:
+    Network* network;
+    uint32_t host;
+};
+
+/**
+ * What went through the simulated network.
+ */
+struct Stats {
+    uint64_t packets;
+    uint64_t bytes;
+    /// Packets dropped at a full switch port or sent to no host.
+    uint64_t drops;
+    /// Most bytes queued at any switch port.
+    uint64_t maxQueueBytes;
+    uint64_t events;
+    /// Times a host with a poller was polled.
+    uint64_t hostPolls;
+    /// Packets identical to a recent packet between the same two hosts;
+    /// the traffic of Homa's real-clock timers (see Network).
+    uint64_t repeats;
+
+    Stats()
+        : packets(0)
+        , bytes(0)
+        , drops(0)
+        , maxQueueBytes(0)
+        , events(0)
+        , hostPolls(0)
+        , repeats(0)
+    {}
+};
+
+/**
+ * The simulated switch, links and hosts, and the scheduler that moves them
+ * in virtual time.
+ */
+class Network {
+  public:
+    explicit Network(const Config& config)
+        : config(config)
+        , bitsPerNs(config.gbps)
+        , generator(config.seed)
+        , hosts()
+        , ports()
+        , events()
+        , nextSequence(0)
+        , runnable()
+        , freePackets()
+        , recent(REPEAT_SLOTS, REPEAT_HISTORY_BYTES)
+        , stats()
+    {
+        Clock::virtualNanoseconds = 0;
+    }
+
+    ~Network()
+    {
+        while (!events.empty()) {
+            if (events.top().packet != nullptr) {
+                release(events.top().packet);
+            }
+            events.pop();
+        }
+        for (auto& port : ports) {
+            for (std::deque<Packet*>& queue : port.queues) {
+                for (Packet* packet : queue) {
+                    release(packet);
+                }
+            }
+            if (port.sending != nullptr) {
+                release(port.sending);
+            }
+        }
+        for (auto& host : hosts) {
+            for (Packet* packet : host->received) {
+                release(packet);
+            }
+        }
+    }
+
+    Network(const Network&) = delete;
+    Network& operator=(const Network&) = delete;
+
+    /**
+     * Attach a host to the switch.
+     *
+     * @return
+     *      The host's driver, owned by the network.
+     */
+    Driver* addHost()
+    {
+        uint32_t index = hosts.size();
+        hosts.emplace_back(new Host(this, index));
+        ports.emplace_back();
+        return &hosts.back()->driver;
+    }
+
+    /**
+     * Have the network run a host whenever it has work: packets to
+     * receive, room on its uplink after sending, or requests left over.
+     *
+     * @param driver
+     *      Driver of the host, from addHost().
+     * @param poller
+     *      Polls the host once; returns true if it handled a request, in
+     *      which case it is polled again.
+     */
+    void setPoller(Driver* driver, std::function<bool()> poller)
+    {
+        hosts[driver->getLocalAddress() - 1]->poller = std::move(poller);
+    }
+
+    const Config& getConfig() const
+    {
+        return config;
+    }
+
+    const Stats& getStats() const
+    {
+        return stats;
+    }
+
+    /**
+     * Return false if Homa's timers have fired (see above), in which case
+     * the same seed need not give the same results.
+     */
+    bool isReproducible() const
+    {
+        return stats.repeats == 0;
+    }
+
+    /**
+     * Describe what went through the network and the virtual time taken.
+     */
+    std::string summary() const
+    {
+        return Output::format(
+            "%zu hosts, %lu packets, %lu bytes, %lu dropped, %lu repeated, "
+            "max port queue %lu bytes, %lu events, %lu host polls, %.6f "
+            "virtual seconds",
+            hosts.size(), stats.packets, stats.bytes, stats.drops,
+            stats.repeats, stats.maxQueueBytes, stats.events,
+            stats.hostPolls, Clock::toSeconds(Clock::virtualNanoseconds));
+    }
+
+  private:
+    friend class Driver;
+
+    /// Size of the RepeatDetector of the network.
+    static const size_t REPEAT_SLOTS = 1 << 16;
+    static const size_t REPEAT_HISTORY_BYTES = 16 * 1024 * 1024;
+
+    /// State of one host.
+    struct Host {
+        Host(Network* network, uint32_t index)
+            : driver(network, index)
+            , poller()
+            , received()
+            , uplinkFreeNs(0)
+            , uplinkLastArrivalNs(0)
+            , wakePending(false)
+            , active(false)
+            , isRunnable(false)
+        {}
+
+        Driver driver;
+        std::function<bool()> poller;
+        /// Packets delivered to the host and not yet received by it.
+        std::deque<Packet*> received;
+        /// Virtual time at which the uplink has sent all queued packets.
+        uint64_t uplinkFreeNs;
+        /// Time the last packet sent reaches the switch; jitter never
+        /// reorders a link.
+        uint64_t uplinkLastArrivalNs;
+        /// True while a WAKE event for the host is scheduled.
+        bool wakePending;
+        /// True while the host's code is on the stack.
+        bool active;
+        /// True while the host is in the runnable queue.
+        bool isRunnable;
+    };
+
+    /// Switch port towards one host.
+    struct Port {
+        /// Packets waiting, one queue per priority.
+        std::deque<Packet*> queues[MAX_PRIORITIES];
+        uint64_t queuedBytes;
+        /// Packet being sent, or nullptr if the port is idle.
+        Packet* sending;
+
+        Port()
+            : queues()
+            , queuedBytes(0)
+            , sending(nullptr)
+        {}
+    };
+
+    enum EventKind {
+        /// A packet reaches the switch.
+        AT_SWITCH,
+        /// A switch port has sent its packet.
+        PORT_DONE,
+        /// A packet reaches its host.
+        AT_HOST,
+        /// A host's uplink has drained, so its transport may send more.
+        WAKE,
+    };
+
+    struct Event {
+        uint64_t timeNs;
+        /// Order of scheduling; breaks ties so that the order of events is
+        /// the same in every run.
+        uint64_t sequence;
+        EventKind kind;
+        uint32_t host;
+        Packet* packet;
+
+        bool operator>(const Event& other) const
+        {
+            return timeNs != other.timeNs ? timeNs > other.timeNs
+                                          : sequence > other.sequence;
+        }
+    };
+
+    static uint64_t now()
+    {
+        return Clock::virtualNanoseconds;
+    }
+
+    uint64_t wireBytes(const Packet* packet) const
+    {
+        return packet->length + PACKET_OVERHEAD_BYTES;
+    }
+
+    uint64_t serializeNs(const Packet* packet) const
+    {
+        return static_cast<uint64_t>(
+            std::ceil(static_cast<double>(wireBytes(packet)) * 8 / bitsPerNs));
+    }
+
+    void schedule(uint64_t timeNs, EventKind kind, uint32_t host,
+                  Packet* packet)
+    {
+        events.push({timeNs, nextSequence++, kind, host, packet});
+    }
+
+    Packet* alloc()
+    {
+        if (freePackets.empty()) {
+            return new Packet;
+        }
+        Packet* packet = freePackets.back().release();
+        freePackets.pop_back();
+        return packet;
+    }
+
+    void release(Packet* packet)
+    {
+        freePackets.emplace_back(packet);
+    }
+
+    /**
+     * Put a copy of the packet on the sender's uplink; the transport keeps
+     * the packet it passed in.
+     */
+    void send(uint32_t source, const Homa::Driver::Packet* packet)
+    {
+        Host& host = *hosts[source];
+        Packet* copy = alloc();
+        std::memcpy(copy->payload, packet->payload, packet->length);
+        copy->length = packet->length;
+        copy->priority =
+            std::min(std::max(packet->priority, 0), config.priorities - 1);
+        copy->source = source;
+        copy->destination = static_cast<uint32_t>(packet->address - 1);
+        // Received packets carry the address of their sender.
+        copy->address = source + 1;
+        stats.packets++;
+        stats.bytes += copy->length;
+        // Between the same two hosts.
+        uint32_t hosts[2] = {copy->source, copy->destination};
+        if (recent.isRepeat(hosts, sizeof(hosts), copy->payload,
+                            copy->length)) {
+            stats.repeats++;
+        }
+
+        host.uplinkFreeNs =
+            std::max(now(), host.uplinkFreeNs) + serializeNs(copy);
+        uint64_t arrivalNs = host.uplinkFreeNs + config.delayNs;
+        if (config.jitterNs > 0) {
+            arrivalNs += std::uniform_int_distribution<uint64_t>(
+                0, config.jitterNs)(generator);
+        }
+        arrivalNs = std::max(arrivalNs, host.uplinkLastArrivalNs);
+        host.uplinkLastArrivalNs = arrivalNs;
+        schedule(arrivalNs, AT_SWITCH, copy->destination, copy);
+        if (host.poller && !host.wakePending) {
+            host.wakePending = true;
+            schedule(host.uplinkFreeNs, WAKE, source, nullptr);
+        }
+    }
+
+    /**
+     * Hand the caller the packets delivered to it, letting the network take
+     * a step first if there are none.
+     */
+    uint32_t receive(uint32_t caller, uint32_t maxPackets,
+                     Homa::Driver::Packet* receivedPackets[])
+    {
+        Host& host = *hosts[caller];
+        if (host.received.empty()) {
+            bool wasActive = host.active;
+            host.active = true;
+            step();
+            host.active = wasActive;
+        }
+        uint32_t numPackets = 0;
+        while (numPackets < maxPackets && !host.received.empty()) {
+            receivedPackets[numPackets++] = host.received.front();
+            host.received.pop_front();
+        }
+        return numPackets;
+    }
+
+    /**
+     * Run one runnable host, or process the next event if it is due within
+     * pollNs, or else let pollNs pass.
+     */
+    void step()
+    {
+        while (!runnable.empty()) {
+            Host& host = *hosts[runnable.front()];
+            runnable.pop_front();
+            host.isRunnable = false;
+            if (host.active) {
+                // Its own poll loop, further up the stack, receives.
+                continue;
+            }
+            uint64_t packetsBefore = stats.packets;
+            host.active = true;
+            stats.hostPolls++;
+            bool handled = host.poller();
+            host.active = false;
+            if (handled || !host.received.empty() ||
+                stats.packets != packetsBefore) {
+                makeRunnable(host);
+            }
+            return;
+        }
+        if (events.empty() || events.top().timeNs > now() + config.pollNs) {
+            Clock::virtualNanoseconds += config.pollNs;
+            return;
+        }
+        Event event = events.top();
+        events.pop();
+        stats.events++;
+        Clock::virtualNanoseconds = std::max(now(), event.timeNs);
+        process(event);
+    }
+
+    void process(const Event& event)
+    {
+        switch (event.kind) {
+            case AT_SWITCH:
+                enqueue(event.packet);
+                break;
+            case PORT_DONE: {
+                Port& port = ports[event.host];
+                Packet* packet = port.sending;
+                port.sending = nullptr;
+                port.queuedBytes -= wireBytes(packet);
+                schedule(now() + config.delayNs, AT_HOST, event.host, packet);
+                startPort(event.host);
+                break;
+            }
+            case AT_HOST:
+                hosts[event.host]->received.push_back(event.packet);
+                makeRunnable(*hosts[event.host]);
+                break;
+            case WAKE: {
+                // One pending wake-up per host; it follows the uplink as
+                // more packets are queued behind it.
+                Host& host = *hosts[event.host];
+                if (host.uplinkFreeNs > now()) {
+                    schedule(host.uplinkFreeNs, WAKE, event.host, nullptr);
+                } else {
+                    host.wakePending = false;
+                    makeRunnable(host);
+                }
+                break;
+            }
+        }
+    }
+
+    /**
+     * Queue a packet that reached the switch at the port to its host.
+     */
+    void enqueue(Packet* packet)
+    {
+        if (packet->destination >= ports.size()) {
+            stats.drops++;
+            release(packet);
+            return;
+        }
+        Port& port = ports[packet->destination];
+        uint64_t bytes = wireBytes(packet);
+        if (config.queueBytes > 0 &&
+            port.queuedBytes + bytes > config.queueBytes) {
+            stats.drops++;
+            release(packet);
+            return;
+        }
+        port.queues[packet->priority].push_back(packet);
+        port.queuedBytes += bytes;
+        stats.maxQueueBytes = std::max(stats.maxQueueBytes, port.queuedBytes);
+        if (port.sending == nullptr) {
+            startPort(packet->destination);
+        }
+    }
+
+    /**
+     * Start sending the highest priority packet waiting at a port.
+     */
+    void startPort(uint32_t destination)
+    {
+        Port& port = ports[destination];
+        for (int priority = config.priorities - 1; priority >= 0; --priority) {
+            std::deque<Packet*>& queue = port.queues[priority];
+            if (!queue.empty()) {
+                port.sending = queue.front();
+                queue.pop_front();
+                schedule(now() + serializeNs(port.sending), PORT_DONE,
+                         destination, nullptr);
+                return;
+            }
+        }
+    }
+
+    void makeRunnable(Host& host)
+    {
+        if (host.poller && !host.isRunnable) {
+            host.isRunnable = true;
+            runnable.push_back(host.driver.getLocalAddress() - 1);
+        }
+    }
+
+    Config config;
+    /// Link rate; a gigabit per second is a bit per nanosecond.
+    double bitsPerNs;
+    std::mt19937_64 generator;
+    std::vector<std::unique_ptr<Host>> hosts;
+    /// Switch ports, by the index of the host they lead to.
+    std::vector<Port> ports;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>>
+        events;
+    uint64_t nextSequence;
+    /// Hosts with work, in the order they got it.
+    std::deque<uint32_t> runnable;
+    std::vector<std::unique_ptr<Packet>> freePackets;
+    /// Recent packets, for Stats::repeats.
+    RepeatDetector recent;
+    Stats stats;
+};
+
+inline Homa::Driver::Packet*
+Driver::allocPacket()
+{
+    Packet* packet = network->alloc();
+    packet->length = 0;
+    packet->priority = 0;
+    return packet;
+}
+
+inline void
+Driver::sendPacket(Homa::Driver::Packet* packet)
+{
+    network->send(host, packet);
+}
+
+inline uint32_t
+Driver::receivePackets(uint32_t maxPackets,
+                       Homa::Driver::Packet* receivedPackets[])
+{
+    return network->receive(host, maxPackets, receivedPackets);
+}
+
+inline void
+Driver::releasePackets(Homa::Driver::Packet* packets[], uint16_t numPackets)
+{
+    for (uint16_t i = 0; i < numPackets; ++i) {
+        network->release(static_cast<Sim::Packet*>(packets[i]));
+    }
+}
+
+inline int
+Driver::getHighestPacketPriority()
+{
+    return network->config.priorities - 1;
+}
+
+inline uint32_t
+Driver::getMaxPayloadSize()
+{
+    return network->config.mtu;
+}
+
+/// In Mbps, as for the real drivers.
+inline uint32_t
+Driver::getBandwidth()
+{
+    return static_cast<uint32_t>(network->config.gbps * 1000);
+}
+
+/**
+ * Bytes on the host's uplink that have not been sent yet.
+ */
+inline uint32_t
+Driver::getQueuedBytes()
+{
+    const Network::Host& state = *network->hosts[host];
+    uint64_t now = Network::now();
+    if (state.uplinkFreeNs <= now) {
+        return 0;
+    }
+    return static_cast<uint32_t>((state.uplinkFreeNs - now) *
+                                 network->bitsPerNs / 8);
+}
+
+}  // namespace Sim
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_SIM_H
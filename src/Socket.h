@@ -0,0 +1,909 @@
+#ifndef HOMARPCBENCH_SOCKET_H
+#define HOMARPCBENCH_SOCKET_H
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Homa/Driver.h>
+
+#include "Rpc.h"
+#include "WireFormat.h"
+
+namespace HomaRpcBench {
+
+/**
+ * Kernel TCP and UDP transport with the same RemoteOp/ServerOp interface as
+ * Homa::Transport, so that benchmarks and the socket_server can exchange the
+ * WireFormat messages used with Homa over plain sockets.
+ *
+ * Every message travels as one frame: a FrameHeader followed by the message
+ * body.  A request carries the address of the transport that sent it so
+ * that a delegated op (see ServerOp::delegate) can be answered directly by
+ * the last server, as with Homa.  There is no loss recovery; UDP is meant
+ * for loopback or otherwise lossless paths.  Not thread-safe.
+ */
+namespace Socket {
+
+enum class Protocol {
+    TCP,
+    UDP,
+};
+
+/**
+ * IPv4 address and port of a Socket::Transport, both in network byte order.
+ */
+struct Address {
+    uint32_t ip;
+    uint16_t port;
+
+    bool operator<(const Address& other) const
+    {
+        return ip != other.ip ? ip < other.ip : port < other.port;
+    }
+};
+
+/// Value of WireFormatAddress::type for socket addresses.
+static constexpr uint8_t WIRE_FORMAT_TYPE = 0x53;
+
+inline sockaddr_in
+toSockaddr(Address address)
+{
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = address.ip;
+    addr.sin_port = address.port;
+    return addr;
+}
+
+inline Address
+fromSockaddr(const sockaddr_in& addr)
+{
+    return {addr.sin_addr.s_addr, addr.sin_port};
+}
+
+inline std::string
+toString(Address address)
+{
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &address.ip, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(address.port));
+}
+
+/**
+ * Parse a "host:port" string.  Returns false and prints a message if the
+ * host cannot be resolved.
+ */
+inline bool
+parseAddress(const std::string& text, Address* address)
+{
+    size_t split = text.rfind(':');
+    if (split == std::string::npos) {
+        std::cerr << "Expected host:port but got " << text << std::endl;
+        return false;
+    }
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    addrinfo* result;
+    std::string host = text.substr(0, split);
+    std::string port = text.substr(split + 1);
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+        std::cerr << "Cannot resolve " << text << std::endl;
+        return false;
+    }
+    *address = fromSockaddr(*reinterpret_cast<sockaddr_in*>(result->ai_addr));
+    freeaddrinfo(result);
+    return true;
+}
+
+/**
+ * Return the local IP address the kernel would use to reach the given
+ * address, with port 0.
+ */
+inline Address
+localAddressFor(Address remote)
+{
+    Address local = {htonl(INADDR_ANY), 0};
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = toSockaddr(remote);
+    if (fd >= 0 &&
+        connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+        socklen_t length = sizeof(addr);
+        getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length);
+        local.ip = addr.sin_addr.s_addr;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return local;
+}
+
+inline void
+toWireFormat(Address address, Homa::Driver::WireFormatAddress* wireAddress)
+{
+    std::memset(wireAddress, 0, sizeof(*wireAddress));
+    wireAddress->type = WIRE_FORMAT_TYPE;
+    std::memcpy(wireAddress->bytes, &address.ip, sizeof(address.ip));
+    std::memcpy(wireAddress->bytes + sizeof(address.ip), &address.port,
+                sizeof(address.port));
+}
+
+inline Address
+fromWireFormat(const Homa::Driver::WireFormatAddress& wireAddress)
+{
+    Address address;
+    std::memcpy(&address.ip, wireAddress.bytes, sizeof(address.ip));
+    std::memcpy(&address.port, wireAddress.bytes + sizeof(address.ip),
+                sizeof(address.port));
+    return address;
+}
+
+enum FrameKind : uint8_t {
+    REQUEST = 1,
+    RESPONSE = 2,
+};
+
+enum FrameFlags : uint8_t {
+    /// The request was delegated by another server; its response goes to
+    /// the reply address rather than back to the sender.
+    DELEGATED = 1,
+};
+
+struct FrameHeader {
+    /// Number of body bytes following the header.
+    uint32_t length;
+    uint8_t kind;
+    uint8_t flags;
+    /// Chosen by the transport that sent the request; echoed in the
+    /// response.
+    uint64_t opId;
+    /// Address of the transport that sent the request.
+    uint32_t replyIp;
+    uint16_t replyPort;
+} __attribute__((packed));
+
+/**
+ * Body of a request or response.  Space for the FrameHeader is kept in front
+ * of the body so that a message is sent without another copy.
+ */
+class Message {
+  public:
+    Message()
+        : bytes(sizeof(FrameHeader))
+    {}
+
+    void append(const void* source, uint32_t count)
+    {
+        const char* data = static_cast<const char*>(source);
+        bytes.insert(bytes.end(), data, data + count);
+    }
+
+    uint32_t get(uint32_t offset, void* destination, uint32_t count) const
+    {
+        size_t start = sizeof(FrameHeader) + size_t(offset);
+        if (start >= bytes.size()) {
+            return 0;
+        }
+        count = std::min<size_t>(count, bytes.size() - start);
+        std::memcpy(destination, bytes.data() + start, count);
+        return count;
+    }
+
+    uint32_t length() const
+    {
+        return bytes.size() - sizeof(FrameHeader);
+    }
+
+  private:
+    friend class Transport;
+    friend class RemoteOp;
+    friend class ServerOp;
+
+    /// A FrameHeader followed by the body.
+    std::vector<char> bytes;
+};
+
+class RemoteOp;
+class ServerOp;
+
+/**
+ * One TCP or UDP endpoint; sends requests for RemoteOps, collects their
+ * responses, and queues incoming requests for receiveServerOp().
+ */
+class Transport {
+  public:
+    /// Largest UDP frame; the UDP/IPv4 payload limit.
+    static constexpr size_t MAX_DATAGRAM_BYTES = 65507;
+    /// Largest TCP message body: a 1 GB payload (see
+    /// BufferPool::MAX_BUFFER_BYTES) with room for headers and hop stamps.
+    /// Bounds what a peer's frame header can make a connection buffer.
+    static constexpr size_t MAX_STREAM_MESSAGE_BYTES = (1 << 30) + (1 << 20);
+
+    /**
+     * Create a transport bound to the given address (port 0 picks a free
+     * port).
+     *
+     * @param busyPoll
+     *      If true, poll() spins on the sockets; otherwise, when it has
+     *      nothing queued to send or to hand out, it sleeps in epoll_wait
+     *      (for up to 1 ms) until one is readable.
+     * @throw std::runtime_error
+     *      The sockets could not be set up.
+     */
+    Transport(Protocol protocol, Address bindAddress, bool busyPoll)
+        : protocol(protocol)
+        , busyPoll(busyPoll)
+        , localAddress(bindAddress)
+        , socketFd(-1)
+        , epollFd(-1)
+        , nextOpId(1)
+        , nextConnectionId(LISTEN_ID + 1)
+        , pending()
+        , incoming()
+        , connections()
+        , outgoing()
+        , datagram(MAX_DATAGRAM_BYTES)
+    {
+        epollFd = epoll_create1(0);
+        int type = protocol == Protocol::TCP ? SOCK_STREAM : SOCK_DGRAM;
+        socketFd = socket(AF_INET, type | SOCK_NONBLOCK, 0);
+        if (epollFd < 0 || socketFd < 0) {
+            throw std::runtime_error("cannot create socket");
+        }
+        int one = 1;
+        setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (protocol == Protocol::UDP) {
+            int bufferBytes = 4 * 1024 * 1024;
+            setsockopt(socketFd, SOL_SOCKET, SO_RCVBUF, &bufferBytes,
+                       sizeof(bufferBytes));
+            setsockopt(socketFd, SOL_SOCKET, SO_SNDBUF, &bufferBytes,
+                       sizeof(bufferBytes));
+        }
+        sockaddr_in addr = toSockaddr(bindAddress);
+        if (bind(socketFd, reinterpret_cast<sockaddr*>(&addr),
+                 sizeof(addr)) != 0 ||
+            (protocol == Protocol::TCP && listen(socketFd, 128) != 0)) {
+            throw std::runtime_error("cannot bind to " +
+                                     toString(bindAddress) + ": " +
+                                     strerror(errno));
+        }
+        socklen_t length = sizeof(addr);
+        getsockname(socketFd, reinterpret_cast<sockaddr*>(&addr), &length);
+        localAddress = fromSockaddr(addr);
+        watch(socketFd, LISTEN_ID);
+    }
+
+    ~Transport()
+    {
+        for (auto& entry : connections) {
+            close(entry.second->fd);
+        }
+        close(socketFd);
+        close(epollFd);
+    }
+
+    Transport(const Transport&) = delete;
+    Transport& operator=(const Transport&) = delete;
+
+    Protocol getProtocol() const
+    {
+        return protocol;
+    }
+
+    Address getLocalAddress() const
+    {
+        return localAddress;
+    }
+
+    /// Largest message body this transport can carry.
+    size_t getMaxMessageBytes() const
+    {
+        return protocol == Protocol::UDP
+                   ? MAX_DATAGRAM_BYTES - sizeof(FrameHeader)
+                   : MAX_STREAM_MESSAGE_BYTES;
+    }
+
+    /**
+     * Make progress: send queued output and process incoming frames.
+     */
+    void poll()
+    {
+        bool writing = flush();
+        epoll_event events[64];
+        // Requests already queued for receiveServerOp() are work to do now.
+        int timeoutMs = busyPoll || writing || !incoming.empty() ? 0 : 1;
+        int count = epoll_wait(epollFd, events, 64, timeoutMs);
+        for (int i = 0; i < count; ++i) {
+            uint64_t id = events[i].data.u64;
+            if (id != LISTEN_ID) {
+                readConnection(id);
+            } else if (protocol == Protocol::TCP) {
+                acceptConnections();
+            } else {
+                readDatagrams();
+            }
+        }
+    }
+
+    /**
+     * Return the next incoming request, or an empty ServerOp if there is
+     * none.
+     */
+    ServerOp receiveServerOp();
+
+  private:
+    friend class RemoteOp;
+    friend class ServerOp;
+
+    /// epoll data of the listening (TCP) or only (UDP) socket.
+    static constexpr uint64_t LISTEN_ID = 0;
+
+    /**
+     * Where a received frame came from, so that a response can be sent
+     * back the same way.
+     */
+    struct Origin {
+        /// TCP connection the frame arrived on.
+        uint64_t connectionId;
+        /// Sender of a UDP frame.
+        Address source;
+    };
+
+    /**
+     * A received request waiting to be handled by a ServerOp.
+     */
+    struct Inbound {
+        Message request;
+        Message response;
+        Origin origin;
+    };
+
+    struct Connection {
+        int fd;
+        /// Received bytes; the first inBytes are valid.
+        std::vector<char> in;
+        size_t inBytes;
+        /// Frames waiting to be written, and how much of the first is done.
+        std::deque<std::vector<char>> out;
+        size_t outOffset;
+    };
+
+    void watch(int fd, uint64_t id)
+    {
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    uint64_t addConnection(int fd)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        uint64_t id = nextConnectionId++;
+        connections[id].reset(new Connection{fd, {}, 0, {}, 0});
+        watch(fd, id);
+        return id;
+    }
+
+    void closeConnection(uint64_t id)
+    {
+        auto it = connections.find(id);
+        if (it == connections.end()) {
+            return;
+        }
+        close(it->second->fd);
+        connections.erase(it);
+        for (auto out = outgoing.begin(); out != outgoing.end(); ++out) {
+            if (out->second == id) {
+                outgoing.erase(out);
+                break;
+            }
+        }
+    }
+
+    /**
+     * Say why a connection this transport opened could not be written to;
+     * its pending RemoteOps will get no response.
+     */
+    void reportFailure(uint64_t id)
+    {
+        int error = errno;
+        for (auto& entry : outgoing) {
+            if (entry.second == id) {
+                std::cerr << "Connection to " << toString(entry.first)
+                          << " failed: " << strerror(error) << std::endl;
+                return;
+            }
+        }
+    }
+
+    /**
+     * Return the TCP connection to the given address, connecting if needed.
+     * The connect does not block: frames queued before it completes are
+     * written by later calls to poll().
+     *
+     * @throw std::runtime_error
+     *      The connect failed at once.
+     */
+    uint64_t connectTo(Address destination)
+    {
+        auto it = outgoing.find(destination);
+        if (it != outgoing.end()) {
+            return it->second;
+        }
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        sockaddr_in addr = toSockaddr(destination);
+        if (fd < 0 || (connect(fd, reinterpret_cast<sockaddr*>(&addr),
+                               sizeof(addr)) != 0 &&
+                       errno != EINPROGRESS)) {
+            std::string error = strerror(errno);
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("cannot connect to " +
+                                     toString(destination) + ": " + error);
+        }
+        uint64_t id = addConnection(fd);
+        outgoing[destination] = id;
+        return id;
+    }
+
+    /**
+     * Fill in the header of a message and send it.
+     *
+     * @param message
+     *      Message to send; its bytes may be taken over by the transport.
+     * @param destination
+     *      Where to send the frame when origin is nullptr.
+     * @param origin
+     *      If not nullptr, send the frame back the way this request came.
+     */
+    void send(FrameKind kind, uint8_t flags, uint64_t opId, Address replyTo,
+              Message* message, Address destination, const Origin* origin)
+    {
+        FrameHeader header;
+        header.length = message->length();
+        header.kind = kind;
+        header.flags = flags;
+        header.opId = opId;
+        header.replyIp = replyTo.ip;
+        header.replyPort = replyTo.port;
+        std::memcpy(message->bytes.data(), &header, sizeof(header));
+
+        if (protocol == Protocol::UDP) {
+            if (message->bytes.size() > MAX_DATAGRAM_BYTES) {
+                throw std::length_error("message of " +
+                                        std::to_string(header.length) +
+                                        " bytes does not fit a datagram");
+            }
+            sockaddr_in addr =
+                toSockaddr(origin != nullptr ? origin->source : destination);
+            while (sendto(socketFd, message->bytes.data(),
+                          message->bytes.size(), 0,
+                          reinterpret_cast<sockaddr*>(&addr),
+                          sizeof(addr)) < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    std::cerr << "sendto " << toString(fromSockaddr(addr))
+                              << " failed: " << strerror(errno) << std::endl;
+                    return;
+                }
+            }
+            return;
+        }
+
+        uint64_t id = origin != nullptr ? origin->connectionId
+                                        : connectTo(destination);
+        auto it = connections.find(id);
+        if (it == connections.end()) {
+            // The requester hung up; nobody is waiting for the response.
+            return;
+        }
+        Connection* connection = it->second.get();
+        connection->out.push_back(std::move(message->bytes));
+        message->bytes.assign(sizeof(FrameHeader), 0);
+        flushConnection(id, connection);
+    }
+
+    /**
+     * Write as much queued output as the socket accepts.  Returns false if
+     * the connection was closed.
+     */
+    bool flushConnection(uint64_t id, Connection* connection)
+    {
+        while (!connection->out.empty()) {
+            std::vector<char>& frame = connection->out.front();
+            ssize_t written =
+                ::send(connection->fd, frame.data() + connection->outOffset,
+                       frame.size() - connection->outOffset, MSG_NOSIGNAL);
+            if (written < 0) {
+                // Also the case while a connect is still in progress.
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                reportFailure(id);
+                closeConnection(id);
+                return false;
+            }
+            connection->outOffset += written;
+            if (connection->outOffset == frame.size()) {
+                connection->out.pop_front();
+                connection->outOffset = 0;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Flush every connection with queued output.  Returns true if some
+     * output is still queued.
+     */
+    bool flush()
+    {
+        bool writing = false;
+        for (auto it = connections.begin(); it != connections.end();) {
+            uint64_t id = it->first;
+            Connection* connection = it->second.get();
+            ++it;
+            if (!connection->out.empty() &&
+                flushConnection(id, connection)) {
+                writing |= !connection->out.empty();
+            }
+        }
+        return writing;
+    }
+
+    void acceptConnections()
+    {
+        while (true) {
+            int fd = accept(socketFd, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            addConnection(fd);
+        }
+    }
+
+    void readConnection(uint64_t id)
+    {
+        auto it = connections.find(id);
+        if (it == connections.end()) {
+            return;
+        }
+        Connection* connection = it->second.get();
+        while (true) {
+            if (connection->in.size() - connection->inBytes < READ_BYTES) {
+                connection->in.resize(std::max(connection->in.size() * 2,
+                                               connection->inBytes +
+                                                   READ_BYTES));
+            }
+            ssize_t count =
+                recv(connection->fd, connection->in.data() +
+                                         connection->inBytes,
+                     connection->in.size() - connection->inBytes, 0);
+            if (count == 0 ||
+                (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                if (count < 0) {
+                    reportFailure(id);
+                }
+                closeConnection(id);
+                return;
+            }
+            if (count < 0) {
+                break;
+            }
+            connection->inBytes += count;
+        }
+
+        size_t offset = 0;
+        while (connection->inBytes - offset >= sizeof(FrameHeader)) {
+            FrameHeader header;
+            std::memcpy(&header, connection->in.data() + offset,
+                        sizeof(header));
+            if (header.length > MAX_STREAM_MESSAGE_BYTES) {
+                std::cerr << "Closing a connection that sent a "
+                          << header.length << " byte message" << std::endl;
+                closeConnection(id);
+                return;
+            }
+            size_t frameBytes = sizeof(header) + size_t(header.length);
+            if (connection->inBytes - offset < frameBytes) {
+                break;
+            }
+            Origin origin = {id, {0, 0}};
+            receiveFrame(header, connection->in.data() + offset, frameBytes,
+                         origin);
+            offset += frameBytes;
+        }
+        if (offset > 0) {
+            std::memmove(connection->in.data(),
+                         connection->in.data() + offset,
+                         connection->inBytes - offset);
+            connection->inBytes -= offset;
+        }
+    }
+
+    void readDatagrams()
+    {
+        while (true) {
+            sockaddr_in source;
+            socklen_t length = sizeof(source);
+            ssize_t count =
+                recvfrom(socketFd, datagram.data(), datagram.size(), 0,
+                         reinterpret_cast<sockaddr*>(&source), &length);
+            if (count < 0) {
+                return;
+            }
+            FrameHeader header;
+            if (size_t(count) < sizeof(header)) {
+                continue;
+            }
+            std::memcpy(&header, datagram.data(), sizeof(header));
+            if (sizeof(header) + size_t(header.length) != size_t(count)) {
+                continue;
+            }
+            Origin origin = {0, fromSockaddr(source)};
+            receiveFrame(header, datagram.data(), count, origin);
+        }
+    }
+
+    void receiveFrame(const FrameHeader& header, const char* frame,
+                      size_t frameBytes, const Origin& origin);
+
+    /// Minimum free space offered to each recv() on a connection.
+    static constexpr size_t READ_BYTES = 64 * 1024;
+
+    Protocol protocol;
+    bool busyPoll;
+    Address localAddress;
+    /// TCP listening socket or the UDP socket.
+    int socketFd;
+    int epollFd;
+    uint64_t nextOpId;
+    uint64_t nextConnectionId;
+    /// RemoteOps waiting for their response, by op id.
+    std::unordered_map<uint64_t, RemoteOp*> pending;
+    /// Received requests not yet returned by receiveServerOp().
+    std::deque<std::unique_ptr<Inbound>> incoming;
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+    /// Connections this transport opened, by destination.
+    std::map<Address, uint64_t> outgoing;
+    /// Receive buffer for UDP frames.
+    std::vector<char> datagram;
+};
+
+/**
+ * Client side of one request/response exchange; see Homa::RemoteOp.
+ */
+class RemoteOp {
+  public:
+    explicit RemoteOp(Transport* transport)
+        : request(&requestMessage)
+        , response(&responseMessage)
+        , transport(transport)
+        , requestMessage()
+        , responseMessage()
+        , opId(0)
+        , ready(false)
+    {}
+
+    ~RemoteOp()
+    {
+        if (opId != 0 && !ready) {
+            transport->pending.erase(opId);
+        }
+    }
+
+    RemoteOp(const RemoteOp&) = delete;
+    RemoteOp& operator=(const RemoteOp&) = delete;
+
+    /**
+     * Send the request to the given server.  The request message is
+     * consumed.
+     */
+    void send(Address destination)
+    {
+        opId = transport->nextOpId++;
+        transport->pending[opId] = this;
+        transport->send(REQUEST, 0, opId, transport->localAddress,
+                        &requestMessage, destination, nullptr);
+    }
+
+    bool isReady() const
+    {
+        return ready;
+    }
+
+    void wait()
+    {
+        while (!ready) {
+            transport->poll();
+        }
+    }
+
+    Message* const request;
+    const Message* const response;
+
+  private:
+    friend class Transport;
+
+    Transport* transport;
+    Message requestMessage;
+    Message responseMessage;
+    uint64_t opId;
+    bool ready;
+};
+
+/**
+ * Server side of a request; see Homa::ServerOp.
+ */
+class ServerOp {
+  public:
+    ServerOp()
+        : request(nullptr)
+        , response(nullptr)
+        , transport(nullptr)
+        , inbound()
+    {}
+
+    ServerOp(ServerOp&& other)
+        : request(other.request)
+        , response(other.response)
+        , transport(other.transport)
+        , inbound(std::move(other.inbound))
+    {
+        other.request = nullptr;
+        other.response = nullptr;
+    }
+
+    ServerOp& operator=(ServerOp&& other)
+    {
+        request = other.request;
+        response = other.response;
+        transport = other.transport;
+        inbound = std::move(other.inbound);
+        other.request = nullptr;
+        other.response = nullptr;
+        return *this;
+    }
+
+    explicit operator bool() const
+    {
+        return inbound != nullptr;
+    }
+
+    /// Send the response to whoever issued the op.
+    void reply()
+    {
+        FrameHeader header = getHeader();
+        if (header.flags & DELEGATED) {
+            transport->send(RESPONSE, 0, header.opId, {0, 0}, response,
+                            {header.replyIp, header.replyPort}, nullptr);
+        } else {
+            transport->send(RESPONSE, 0, header.opId, {0, 0}, response,
+                            {0, 0}, &inbound->origin);
+        }
+    }
+
+    /**
+     * Pass the op on to another server: the response message is sent to it
+     * as the request, and its response goes straight to the issuer.
+     */
+    void delegate(Address destination)
+    {
+        FrameHeader header = getHeader();
+        transport->send(REQUEST, DELEGATED, header.opId,
+                        {header.replyIp, header.replyPort}, response,
+                        destination, nullptr);
+    }
+
+    const Message* request;
+    Message* response;
+
+  private:
+    friend class Transport;
+
+    ServerOp(Transport* transport, std::unique_ptr<Transport::Inbound> in)
+        : request(&in->request)
+        , response(&in->response)
+        , transport(transport)
+        , inbound(std::move(in))
+    {}
+
+    FrameHeader getHeader() const
+    {
+        FrameHeader header;
+        std::memcpy(&header, inbound->request.bytes.data(), sizeof(header));
+        return header;
+    }
+
+    Transport* transport;
+    std::unique_ptr<Transport::Inbound> inbound;
+};
+
+inline ServerOp
+Transport::receiveServerOp()
+{
+    if (incoming.empty()) {
+        return ServerOp();
+    }
+    std::unique_ptr<Inbound> in = std::move(incoming.front());
+    incoming.pop_front();
+    return ServerOp(this, std::move(in));
+}
+
+inline void
+Transport::receiveFrame(const FrameHeader& header, const char* frame,
+                        size_t frameBytes, const Origin& origin)
+{
+    if (header.kind == RESPONSE) {
+        auto it = pending.find(header.opId);
+        if (it == pending.end()) {
+            return;
+        }
+        RemoteOp* op = it->second;
+        op->responseMessage.bytes.assign(frame, frame + frameBytes);
+        op->ready = true;
+        pending.erase(it);
+    } else if (header.kind == REQUEST) {
+        std::unique_ptr<Inbound> in(new Inbound);
+        in->request.bytes.assign(frame, frame + frameBytes);
+        in->origin = origin;
+        incoming.push_back(std::move(in));
+    }
+}
+
+/**
+ * Configure a socket_server to forward echo requests to the next server of
+ * a chain, or to answer them itself; see Rpc::configServer.
+ */
+inline void
+configServer(Transport* transport, Address server, bool forward,
+             Address nextServer = Address())
+{
+    WireFormat::ConfigServerRpc::Request request;
+    request.forward = forward;
+    toWireFormat(nextServer, &request.nextAddress);
+    Rpc::call<WireFormat::ConfigServerRpc, RemoteOp>(transport, server,
+                                                     &request);
+}
+
+/**
+ * Read (and optionally reset) a socket_server's goodput counters; see
+ * Rpc::getServerStats.
+ */
+inline void
+getServerStats(Transport* transport, Address server, bool reset,
+               WireFormat::ServerStatsRpc::Response* response)
+{
+    WireFormat::ServerStatsRpc::Request request;
+    request.reset = reset;
+    Rpc::call<WireFormat::ServerStatsRpc, RemoteOp>(transport, server,
+                                                    &request, response);
+}
+
+}  // namespace Socket
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_SOCKET_H
@@ -0,0 +1,569 @@
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include <signal.h>
+
+#include <PerfUtils/Cycles.h>
+#include <docopt.h>
+
+#include "BufferPool.h"
+#include "Dispatch.h"
+#include "HopStamps.h"
+#include "Payload.h"
+#include "Socket.h"
+#include "WireFormat.h"
+
+static const char USAGE[] = R"(HomaRpcBench Socket Server.
+
+    Serves the echo benchmarks over kernel TCP or UDP sockets, as a baseline
+    for the Homa server.  Point the client at it with --servers.
+
+    Usage:
+        socket_server [options] <address>
+
+    Options:
+        -h --help           Show this screen.
+        --version           Show version.
+        --protocol=<p>      Socket protocol, tcp or udp [default: tcp].
+        --busyPoll          Spin on the sockets instead of sleeping in
+                            epoll_wait.
+)";
+
+namespace HomaRpcBench {
+
+/**
+ * Socket counterpart of HomaRpcBench::Server for the echo benchmarks; it
+ * handles the same WireFormat requests, including nested and delegated
+ * chains.
+ */
+class SocketServer {
+  public:
+    explicit SocketServer(Socket::Transport* transport);
+
+    void poll();
+    void setServerId(uint64_t id);
+
+  private:
+    void handleConfigServerRpc(
+        Socket::ServerOp* op,
+        const WireFormat::ConfigServerRpc::Request& request);
+    void handleDumpTimeTraceRpc(
+        Socket::ServerOp* op,
+        const WireFormat::DumpTimeTraceRpc::Request& request);
+    void handleEchoRpc(Socket::ServerOp* op,
+                       const WireFormat::EchoRpc::Request& request);
+    void handleEchoMultiLevelRpc(
+        Socket::ServerOp* op,
+        const WireFormat::EchoMultiLevelRpc::Request& request);
+    void handleEchoBatchRpc(Socket::ServerOp* op,
+                            const WireFormat::EchoBatchRpc::Request& request);
+    void handleHoldRpc(Socket::ServerOp* op,
+                       const WireFormat::HoldRpc::Request& request);
+    void handleGoodputRpc(Socket::ServerOp* op,
+                          const WireFormat::GoodputRpc::Request& request);
+    void handleServerStatsRpc(
+        Socket::ServerOp* op,
+        const WireFormat::ServerStatsRpc::Request& request);
+    template <typename Response>
+    bool fitResponse(Socket::ServerOp* op, const Response& header);
+
+    using Dispatcher = Dispatch::Table<
+        SocketServer, Socket::ServerOp,
+        Dispatch::Route<WireFormat::ConfigServerRpc,
+                        &SocketServer::handleConfigServerRpc>,
+        Dispatch::Route<WireFormat::DumpTimeTraceRpc,
+                        &SocketServer::handleDumpTimeTraceRpc>,
+        Dispatch::Route<WireFormat::EchoRpc, &SocketServer::handleEchoRpc>,
+        Dispatch::Route<WireFormat::EchoMultiLevelRpc,
+                        &SocketServer::handleEchoMultiLevelRpc>,
+        Dispatch::Route<WireFormat::EchoBatchRpc,
+                        &SocketServer::handleEchoBatchRpc>,
+        Dispatch::Route<WireFormat::HoldRpc, &SocketServer::handleHoldRpc>,
+        Dispatch::Route<WireFormat::GoodputRpc,
+                        &SocketServer::handleGoodputRpc>,
+        Dispatch::Route<WireFormat::ServerStatsRpc,
+                        &SocketServer::handleServerStatsRpc>>;
+
+    Socket::Transport* transport;
+    /// Carried in hop stamps; see Server::serverId.
+    uint64_t serverId;
+    bool proxy;
+    Socket::Address delegate;
+    BufferPool bufferPool;
+    /// Verification pattern of the last seed seen; see Server::getPattern.
+    std::vector<char> pattern;
+    uint32_t patternSeed;
+    Payload::VerifyStats verifyStats;
+    /// Ops kept open by HoldRpc until a release.
+    std::vector<Socket::ServerOp> heldOps;
+    /// Counters reported by ServerStatsRpc; see Server::goodputMessages.
+    uint64_t goodputMessages;
+    uint64_t goodputBytes;
+    uint64_t goodputFirstCycle;
+    uint64_t goodputLastCycle;
+    uint64_t goodputHandlerCycles;
+};
+
+SocketServer::SocketServer(Socket::Transport* transport)
+    : transport(transport)
+    , serverId(0)
+    , proxy(false)
+    , delegate()
+    , bufferPool()
+    , pattern()
+    , patternSeed(0)
+    , verifyStats()
+    , heldOps()
+    , goodputMessages(0)
+    , goodputBytes(0)
+    , goodputFirstCycle(0)
+    , goodputLastCycle(0)
+    , goodputHandlerCycles(0)
+{}
+
+void
+SocketServer::poll()
+{
+    Socket::ServerOp op = transport->receiveServerOp();
+    if (op) {
+        if (!Dispatcher::dispatch(this, &op)) {
+            std::cerr << "Unknown opcode" << std::endl;
+        }
+    }
+    transport->poll();
+}
+
+void
+SocketServer::setServerId(uint64_t id)
+{
+    serverId = id;
+}
+
+/**
+ * Check that the message built in an op's response fits the transport (a
+ * UDP datagram holds less than a response may ask for).  If not, report
+ * it and leave just the given header in the response.
+ *
+ * @return
+ *      True if the message fits and was left alone.
+ */
+template <typename Response>
+bool
+SocketServer::fitResponse(Socket::ServerOp* op, const Response& header)
+{
+    if (op->response->length() <= transport->getMaxMessageBytes()) {
+        return true;
+    }
+    std::cerr << "A " << op->response->length() << " byte message exceeds the "
+              << transport->getMaxMessageBytes()
+              << " byte limit of the transport" << std::endl;
+    *op->response = Socket::Message();
+    op->response->append(&header, sizeof(header));
+    return false;
+}
+
+void
+SocketServer::handleConfigServerRpc(
+    Socket::ServerOp* op, const WireFormat::ConfigServerRpc::Request& request)
+{
+    proxy = request.forward;
+    if (proxy) {
+        delegate = Socket::fromWireFormat(request.nextAddress);
+    }
+    WireFormat::ConfigServerRpc::Response response;
+    response.common.opcode = WireFormat::ConfigServerRpc::opcode;
+    op->response->append(&response, sizeof(response));
+    op->reply();
+    if (proxy) {
+        std::cout << "Server configured as proxy to "
+                  << Socket::toString(delegate) << std::endl;
+    } else {
+        std::cout << "Server configured" << std::endl;
+    }
+}
+
+void
+SocketServer::handleDumpTimeTraceRpc(
+    Socket::ServerOp* op, const WireFormat::DumpTimeTraceRpc::Request& request)
+{
+    // Socket servers record no time traces; just acknowledge.
+    WireFormat::DumpTimeTraceRpc::Response response;
+    response.common.opcode = WireFormat::DumpTimeTraceRpc::opcode;
+    op->response->append(&response, sizeof(response));
+    op->reply();
+}
+
+void
+SocketServer::handleEchoRpc(Socket::ServerOp* op,
+                            const WireFormat::EchoRpc::Request& request)
+{
+    bool stampHops = request.flags & WireFormat::EchoRpc::HOP_STAMPS;
+    uint64_t receiveCycles = stampHops ? PerfUtils::Cycles::rdtsc() : 0;
+    WireFormat::EchoRpc::Response response;
+    response.common.opcode = WireFormat::EchoRpc::opcode;
+    response.hopCount = 1;
+    response.responseBytes = request.responseBytes;
+    response.payloadCrc = 0;
+    if (request.sentBytes > BufferPool::MAX_BUFFER_BYTES ||
+        request.responseBytes > BufferPool::MAX_BUFFER_BYTES) {
+        response.responseBytes = 0;
+        op->response->append(&response, sizeof(response));
+        op->reply();
+        return;
+    }
+    BufferPool::Buffer buffer = bufferPool.acquire(
+        std::max(request.sentBytes, request.responseBytes));
+    if (!Payload::read(op->request, sizeof(request), buffer.get(),
+                       request.sentBytes, buffer.capacity())) {
+        std::cerr << "Echo request is shorter than its " << request.sentBytes
+                  << " byte payload" << std::endl;
+    }
+    bool verify = request.flags & WireFormat::EchoRpc::VERIFY_PAYLOAD;
+    if (verify && !Payload::verify(buffer.get(), request.sentBytes,
+                                   request.payloadCrc, &verifyStats)) {
+        std::cerr << "Request payload failed CRC32C verification"
+                  << std::endl;
+    }
+
+    const char* responsePayload = buffer.get();
+    bool forward = proxy && request.hopLimit != 1;
+    // Outlives the nested round trip until its hop stamps are copied.
+    std::optional<Socket::RemoteOp> proxyOp;
+    uint64_t forwardCycles = 0;
+    uint64_t returnCycles = 0;
+    uint32_t nestedHopCount = 0;
+    if (forward) {
+        WireFormat::EchoRpc::Request nestedRequest = request;
+        if (nestedRequest.hopLimit > 1) {
+            nestedRequest.hopLimit--;
+        }
+        proxyOp.emplace(transport);
+        proxyOp->request->append(&nestedRequest, sizeof(nestedRequest));
+        proxyOp->request->append(buffer.get(), request.sentBytes);
+        if (stampHops) {
+            forwardCycles = PerfUtils::Cycles::rdtsc();
+        }
+        proxyOp->send(delegate);
+        proxyOp->wait();
+        if (stampHops) {
+            returnCycles = PerfUtils::Cycles::rdtsc();
+        }
+
+        WireFormat::EchoRpc::Response proxyResponse;
+        proxyOp->response->get(0, &proxyResponse, sizeof(proxyResponse));
+        if (!Payload::read(proxyOp->response, sizeof(proxyResponse),
+                           buffer.get(), proxyResponse.responseBytes,
+                           buffer.capacity())) {
+            std::cerr << "Nested response payload of "
+                      << proxyResponse.responseBytes
+                      << " bytes is truncated or too large" << std::endl;
+            proxyResponse.responseBytes = 0;
+        }
+        response.responseBytes = proxyResponse.responseBytes;
+        response.hopCount += proxyResponse.hopCount;
+        response.payloadCrc = proxyResponse.payloadCrc;
+        nestedHopCount = proxyResponse.hopCount;
+    } else if (verify) {
+        if (request.patternSeed != patternSeed ||
+            request.responseBytes > pattern.size()) {
+            pattern.resize(
+                std::max<size_t>(request.responseBytes, pattern.size()));
+            Payload::fillPattern(pattern.data(), pattern.size(),
+                                 request.patternSeed);
+            patternSeed = request.patternSeed;
+        }
+        responsePayload = pattern.data();
+        response.payloadCrc =
+            Payload::crc32c(pattern.data(), response.responseBytes);
+    }
+
+    op->response->append(&response, sizeof(response));
+    op->response->append(responsePayload, response.responseBytes);
+    if (stampHops) {
+        if (forward) {
+            HopStamps::copy(proxyOp->response,
+                            sizeof(WireFormat::EchoRpc::Response) +
+                                response.responseBytes,
+                            nestedHopCount, op->response);
+        }
+        WireFormat::HopStamp stamp =
+            HopStamps::make(serverId, receiveCycles, forwardCycles,
+                            returnCycles, PerfUtils::Cycles::rdtsc());
+        op->response->append(&stamp, sizeof(stamp));
+    }
+    proxyOp.reset();
+    // All that is sent if the message is too large.
+    response.hopCount = 1;
+    response.responseBytes = 0;
+    fitResponse(op, response);
+    op->reply();
+}
+
+void
+SocketServer::handleEchoMultiLevelRpc(
+    Socket::ServerOp* op, const WireFormat::EchoMultiLevelRpc::Request& request)
+{
+    bool stampHops = request.flags & WireFormat::EchoRpc::HOP_STAMPS;
+    uint64_t receiveCycles = stampHops ? PerfUtils::Cycles::rdtsc() : 0;
+    WireFormat::EchoMultiLevelRpc::Response response;
+    response.common.opcode = WireFormat::EchoMultiLevelRpc::opcode;
+    response.numHopStamps = 0;
+    response.responseBytes = request.responseBytes;
+    if (request.sentBytes > BufferPool::MAX_BUFFER_BYTES ||
+        request.responseBytes > BufferPool::MAX_BUFFER_BYTES) {
+        response.responseBytes = 0;
+        op->response->append(&response, sizeof(response));
+        op->reply();
+        return;
+    }
+    BufferPool::Buffer buffer = bufferPool.acquire(
+        std::max(request.sentBytes, request.responseBytes));
+    if (!Payload::read(op->request, sizeof(request), buffer.get(),
+                       request.sentBytes, buffer.capacity())) {
+        std::cerr << "Echo request is shorter than its " << request.sentBytes
+                  << " byte payload" << std::endl;
+    }
+
+    uint32_t stampsOffset = sizeof(request) + request.sentBytes;
+    if (proxy) {
+        WireFormat::EchoMultiLevelRpc::Request delegatedRequest = request;
+        if (stampHops) {
+            delegatedRequest.numHopStamps++;
+        }
+        op->response->append(&delegatedRequest, sizeof(delegatedRequest));
+        op->response->append(buffer.get(), request.sentBytes);
+        if (stampHops) {
+            HopStamps::copy(op->request, stampsOffset, request.numHopStamps,
+                            op->response);
+            WireFormat::HopStamp stamp = HopStamps::make(
+                serverId, receiveCycles, PerfUtils::Cycles::rdtsc(), 0, 0);
+            op->response->append(&stamp, sizeof(stamp));
+        }
+        // All that is sent if the message is too large.
+        response.responseBytes = 0;
+        if (fitResponse(op, response)) {
+            op->delegate(delegate);
+        } else {
+            op->reply();
+        }
+    } else {
+        if (stampHops) {
+            response.numHopStamps = request.numHopStamps + 1;
+        }
+        op->response->append(&response, sizeof(response));
+        op->response->append(buffer.get(), response.responseBytes);
+        if (stampHops) {
+            HopStamps::copy(op->request, stampsOffset, request.numHopStamps,
+                            op->response);
+            WireFormat::HopStamp stamp = HopStamps::make(
+                serverId, receiveCycles, 0, 0, PerfUtils::Cycles::rdtsc());
+            op->response->append(&stamp, sizeof(stamp));
+        }
+        // All that is sent if the message is too large.
+        response.numHopStamps = 0;
+        response.responseBytes = 0;
+        fitResponse(op, response);
+        op->reply();
+    }
+}
+
+void
+SocketServer::handleEchoBatchRpc(
+    Socket::ServerOp* op, const WireFormat::EchoBatchRpc::Request& request)
+{
+    WireFormat::EchoBatchRpc::Response response;
+    response.common.opcode = WireFormat::EchoBatchRpc::opcode;
+    // Every sub-request takes at least sizeof(SubRequest) bytes, which
+    // bounds the sub-responses a bad header can make this op build.
+    uint32_t numOps = std::min<uint64_t>(
+        request.numOps, (op->request->length() - sizeof(request)) /
+                            sizeof(WireFormat::EchoBatchRpc::SubRequest));
+    if (numOps < request.numOps) {
+        std::cerr << "Echo batch of " << op->request->length()
+                  << " bytes cannot hold " << request.numOps
+                  << " sub-requests" << std::endl;
+    }
+    response.numOps = numOps;
+    op->response->append(&response, sizeof(response));
+    // Every sub-request gets a sub-response, so that the client can match
+    // them up; those after a malformed one are empty.
+    uint32_t offset = sizeof(request);
+    bool malformed = false;
+    for (uint32_t i = 0; i < numOps; ++i) {
+        WireFormat::EchoBatchRpc::SubRequest subRequest;
+        WireFormat::EchoBatchRpc::SubResponse subResponse;
+        subResponse.responseBytes = 0;
+        if (!malformed &&
+            op->request->get(offset, &subRequest, sizeof(subRequest)) !=
+                sizeof(subRequest)) {
+            std::cerr << "Echo batch ends after " << i << " of its "
+                      << request.numOps << " sub-requests" << std::endl;
+            malformed = true;
+        }
+        if (!malformed &&
+            (subRequest.sentBytes > BufferPool::MAX_BUFFER_BYTES ||
+             subRequest.responseBytes > BufferPool::MAX_BUFFER_BYTES)) {
+            std::cerr << "Echo sub-request of " << subRequest.sentBytes
+                      << " bytes with a " << subRequest.responseBytes
+                      << " byte response exceeds the "
+                      << BufferPool::MAX_BUFFER_BYTES << " byte limit"
+                      << std::endl;
+            malformed = true;
+        }
+        if (malformed) {
+            op->response->append(&subResponse, sizeof(subResponse));
+            continue;
+        }
+        offset += sizeof(subRequest);
+        BufferPool::Buffer buffer = bufferPool.acquire(
+            std::max(subRequest.sentBytes, subRequest.responseBytes));
+        if (!Payload::read(op->request, offset, buffer.get(),
+                           subRequest.sentBytes, buffer.capacity())) {
+            std::cerr << "Echo sub-request is shorter than its "
+                      << subRequest.sentBytes << " byte payload"
+                      << std::endl;
+            malformed = true;
+            op->response->append(&subResponse, sizeof(subResponse));
+            continue;
+        }
+        offset += subRequest.sentBytes;
+        subResponse.responseBytes = subRequest.responseBytes;
+        op->response->append(&subResponse, sizeof(subResponse));
+        op->response->append(buffer.get(), subResponse.responseBytes);
+    }
+    // All that is sent if the message is too large.
+    response.numOps = 0;
+    fitResponse(op, response);
+    op->reply();
+}
+
+void
+SocketServer::handleHoldRpc(Socket::ServerOp* op,
+                            const WireFormat::HoldRpc::Request& request)
+{
+    if (!request.release) {
+        heldOps.push_back(std::move(*op));
+        return;
+    }
+    WireFormat::HoldRpc::Response response;
+    response.common.opcode = WireFormat::HoldRpc::opcode;
+    response.heldOps = 0;
+    for (Socket::ServerOp& held : heldOps) {
+        held.response->append(&response, sizeof(response));
+        held.reply();
+    }
+    response.heldOps = heldOps.size();
+    heldOps.clear();
+    op->response->append(&response, sizeof(response));
+    op->reply();
+}
+
+void
+SocketServer::handleGoodputRpc(Socket::ServerOp* op,
+                               const WireFormat::GoodputRpc::Request& request)
+{
+    uint64_t start = PerfUtils::Cycles::rdtsc();
+    if (goodputFirstCycle == 0) {
+        goodputFirstCycle = start;
+    }
+    if (request.sentBytes > BufferPool::MAX_BUFFER_BYTES) {
+        std::cerr << "Goodput message of " << request.sentBytes
+                  << " bytes exceeds the " << BufferPool::MAX_BUFFER_BYTES
+                  << " byte limit" << std::endl;
+    } else {
+        // Consume the payload as a real receiver would.
+        BufferPool::Buffer buffer = bufferPool.acquire(request.sentBytes);
+        if (!Payload::read(op->request, sizeof(request), buffer.get(),
+                           request.sentBytes, buffer.capacity())) {
+            std::cerr << "Goodput message is shorter than its "
+                      << request.sentBytes << " byte payload" << std::endl;
+        }
+        goodputMessages++;
+        goodputBytes += request.sentBytes;
+    }
+
+    WireFormat::GoodputRpc::Response response;
+    response.common.opcode = WireFormat::GoodputRpc::opcode;
+    op->response->append(&response, sizeof(response));
+    op->reply();
+    goodputLastCycle = PerfUtils::Cycles::rdtsc();
+    goodputHandlerCycles += goodputLastCycle - start;
+}
+
+void
+SocketServer::handleServerStatsRpc(
+    Socket::ServerOp* op, const WireFormat::ServerStatsRpc::Request& request)
+{
+    WireFormat::ServerStatsRpc::Response response;
+    response.common.opcode = WireFormat::ServerStatsRpc::opcode;
+    response.cyclesPerSecond = PerfUtils::Cycles::perSecond();
+    response.goodputMessages = goodputMessages;
+    response.goodputBytes = goodputBytes;
+    response.goodputActiveCycles =
+        goodputFirstCycle == 0 ? 0 : goodputLastCycle - goodputFirstCycle;
+    response.goodputHandlerCycles = goodputHandlerCycles;
+    // Socket servers are not built with allocation tracking.
+    response.handlerOps = 0;
+    response.handlerAllocations = 0;
+    response.handlerFrees = 0;
+    response.handlerAllocatedBytes = 0;
+    response.handlerAllocatorCycles = 0;
+    op->response->append(&response, sizeof(response));
+    op->reply();
+
+    if (request.reset) {
+        goodputMessages = 0;
+        goodputBytes = 0;
+        goodputFirstCycle = 0;
+        goodputLastCycle = 0;
+        goodputHandlerCycles = 0;
+    }
+}
+
+}  // namespace HomaRpcBench
+
+volatile sig_atomic_t INTERRUPT_FLAG = 0;
+void
+sig_int_handler(int sig)
+{
+    INTERRUPT_FLAG = 1;
+}
+
+int
+main(int argc, char* argv[])
+{
+    std::map<std::string, docopt::value> args =
+        docopt::docopt(USAGE, {argv + 1, argv + argc},
+                       true,                           // show help if requested
+                       "HomaRpcBench Socket Server");  // version string
+    HomaRpcBench::Socket::Address address;
+    if (!HomaRpcBench::Socket::parseAddress(args["<address>"].asString(),
+                                            &address)) {
+        return 1;
+    }
+    std::string protocol = args["--protocol"].asString();
+    if (protocol != "tcp" && protocol != "udp") {
+        std::cerr << "Unknown protocol " << protocol << std::endl;
+        return 1;
+    }
+
+    HomaRpcBench::Socket::Transport transport(
+        protocol == "tcp" ? HomaRpcBench::Socket::Protocol::TCP
+                          : HomaRpcBench::Socket::Protocol::UDP,
+        address, args["--busyPoll"].asBool());
+    HomaRpcBench::SocketServer server(&transport);
+    // Socket servers do not enlist; their port identifies them in hop
+    // stamps.
+    server.setServerId(ntohs(transport.getLocalAddress().port));
+    std::cout << "Listening on "
+              << HomaRpcBench::Socket::toString(transport.getLocalAddress())
+              << " (" << protocol << ")" << std::endl;
+
+    signal(SIGINT, sig_int_handler);
+    while (!INTERRUPT_FLAG) {
+        server.poll();
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+#ifndef HOMARPCBENCH_TRACE_H
+#define HOMARPCBENCH_TRACE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace HomaRpcBench {
+
+/**
+ * Compact binary traces of recorded RPC traffic, replayed by the client's
+ * replay benchmark and written by trace_convert.
+ *
+ * A trace file is a Header followed by Header::numRecords Records sorted by
+ * offsetNs.  All fields are little-endian.
+ */
+namespace Trace {
+
+/// Value of Header::magic ("HRBTRACE" read as a little-endian integer).
+static constexpr uint64_t MAGIC = 0x4543415254425248ul;
+static constexpr uint32_t VERSION = 1;
+
+struct Header {
+    uint64_t magic;
+    uint32_t version;
+    /// sizeof(Record) of the writer; lets readers reject foreign layouts.
+    uint32_t recordBytes;
+    uint64_t numRecords;
+} __attribute__((packed));
+
+struct Record {
+    /// Time at which the op was issued, relative to the start of the trace.
+    uint64_t offsetNs;
+    uint32_t requestBytes;
+    uint32_t responseBytes;
+    /// Index of the destination server in the order the servers enlisted.
+    uint16_t server;
+    /// Number of servers that handle the op; 0 is treated as 1.
+    uint8_t hops;
+    /// Application-defined class used to group latencies in reports.
+    uint8_t recordClass;
+} __attribute__((packed));
+
+/**
+ * Read-only view of a trace file mapped into memory.
+ *
+ * The file is never copied: records are read straight from the mapping and
+ * pages that have been consumed are given back with release(), so traces
+ * much larger than memory can be replayed.
+ */
+class Reader {
+  public:
+    Reader()
+        : fd(-1)
+        , mapping(nullptr)
+        , mappingBytes(0)
+        , records(nullptr)
+        , numRecords(0)
+        , releasedBytes(0)
+    {}
+
+    ~Reader()
+    {
+        if (mapping != nullptr) {
+            munmap(mapping, mappingBytes);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    /**
+     * Map the given trace file.  Returns false and prints a message if the
+     * file cannot be read or is not a valid trace.
+     */
+    bool open(const std::string& path)
+    {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Cannot open trace " << path << ": "
+                      << strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+            std::cerr << "Trace " << path << " is too short" << std::endl;
+            return false;
+        }
+        mappingBytes = st.st_size;
+        mapping = mmap(nullptr, mappingBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            std::cerr << "Cannot map trace " << path << ": "
+                      << strerror(errno) << std::endl;
+            return false;
+        }
+        madvise(mapping, mappingBytes, MADV_SEQUENTIAL);
+
+        Header header;
+        std::memcpy(&header, mapping, sizeof(header));
+        if (header.magic != MAGIC || header.version != VERSION ||
+            header.recordBytes != sizeof(Record)) {
+            std::cerr << "Trace " << path << " has an unknown format"
+                      << std::endl;
+            return false;
+        }
+        if (header.numRecords >
+            (mappingBytes - sizeof(Header)) / sizeof(Record)) {
+            std::cerr << "Trace " << path << " is truncated" << std::endl;
+            return false;
+        }
+        records = static_cast<const char*>(mapping) + sizeof(Header);
+        numRecords = header.numRecords;
+        return true;
+    }
+
+    uint64_t size() const
+    {
+        return numRecords;
+    }
+
+    /// Return the record at the given index (< size()).
+    Record get(uint64_t index) const
+    {
+        Record record;
+        std::memcpy(&record, records + index * sizeof(Record),
+                    sizeof(record));
+        return record;
+    }
+
+    /**
+     * Tell the kernel that records before the given index will not be read
+     * again, so their pages can be dropped.  Cheap to call often: it only
+     * acts once a whole RELEASE_BYTES window has been consumed.
+     */
+    void release(uint64_t index)
+    {
+        size_t consumed = sizeof(Header) + index * sizeof(Record);
+        if (consumed - releasedBytes < RELEASE_BYTES) {
+            return;
+        }
+        size_t bytes = (consumed - releasedBytes) / RELEASE_BYTES *
+                       RELEASE_BYTES;
+        madvise(static_cast<char*>(mapping) + releasedBytes, bytes,
+                MADV_DONTNEED);
+        releasedBytes += bytes;
+    }
+
+  private:
+    /// Granularity at which consumed pages are released; a multiple of the
+    /// page size.
+    static constexpr size_t RELEASE_BYTES = 64ul * 1024 * 1024;
+
+    int fd;
+    void* mapping;
+    size_t mappingBytes;
+    const char* records;
+    uint64_t numRecords;
+    /// Bytes at the start of the mapping already released.
+    size_t releasedBytes;
+};
+
+}  // namespace Trace
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_TRACE_H
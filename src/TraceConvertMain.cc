@@ -0,0 +1,120 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <docopt.h>
+
+#include "Trace.h"
+
+static const char USAGE[] = R"(HomaRpcBench trace_convert.
+
+    Converts a text trace into the binary format read by the client's replay
+    benchmark (see src/Trace.h).  Each input line holds comma separated
+    fields:
+
+        offset_ns,request_bytes,response_bytes,server[,hops[,class]]
+
+    Empty lines and lines starting with '#' are ignored; records must be
+    sorted by offset_ns.
+
+    Usage:
+        trace_convert [options] <input> <output>
+
+    Options:
+        -h --help           Show this screen.
+        --version           Show version.
+)";
+
+int
+main(int argc, char* argv[])
+{
+    using HomaRpcBench::Trace::Header;
+    using HomaRpcBench::Trace::Record;
+
+    std::map<std::string, docopt::value> args =
+        docopt::docopt(USAGE, {argv + 1, argv + argc},
+                       true,                           // show help if requested
+                       "HomaRpcBench trace_convert");  // version string
+    std::string inputPath = args["<input>"].asString();
+    std::string outputPath = args["<output>"].asString();
+
+    std::ifstream input(inputPath);
+    if (!input) {
+        std::cerr << "Cannot open " << inputPath << std::endl;
+        return 1;
+    }
+    std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+    if (!output) {
+        std::cerr << "Cannot create " << outputPath << std::endl;
+        return 1;
+    }
+
+    Header header;
+    header.magic = HomaRpcBench::Trace::MAGIC;
+    header.version = HomaRpcBench::Trace::VERSION;
+    header.recordBytes = sizeof(Record);
+    header.numRecords = 0;
+    // Written again with the final count once all records are known.
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::string line;
+    uint64_t lineNumber = 0;
+    uint64_t lastOffset = 0;
+    while (std::getline(input, line)) {
+        ++lineNumber;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::vector<uint64_t> fields;
+        std::stringstream stream(line);
+        std::string field;
+        try {
+            while (std::getline(stream, field, ',')) {
+                fields.push_back(std::stoull(field));
+            }
+        } catch (const std::exception&) {
+            fields.clear();
+        }
+        if (fields.size() < 4 || fields.size() > 6) {
+            std::cerr << inputPath << ":" << lineNumber
+                      << ": expected 4 to 6 numeric fields" << std::endl;
+            return 1;
+        }
+        Record record;
+        record.offsetNs = fields[0];
+        record.requestBytes = fields[1];
+        record.responseBytes = fields[2];
+        record.server = fields[3];
+        record.hops = fields.size() > 4 ? fields[4] : 0;
+        record.recordClass = fields.size() > 5 ? fields[5] : 0;
+        if (record.requestBytes != fields[1] ||
+            record.responseBytes != fields[2] || record.server != fields[3] ||
+            (fields.size() > 4 && record.hops != fields[4]) ||
+            (fields.size() > 5 && record.recordClass != fields[5])) {
+            std::cerr << inputPath << ":" << lineNumber
+                      << ": field out of range" << std::endl;
+            return 1;
+        }
+        if (record.offsetNs < lastOffset) {
+            std::cerr << inputPath << ":" << lineNumber
+                      << ": records are not sorted by offset" << std::endl;
+            return 1;
+        }
+        lastOffset = record.offsetNs;
+        output.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        header.numRecords++;
+    }
+
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.close();
+    if (!output) {
+        std::cerr << "Failed to write " << outputPath << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << header.numRecords << " records to " << outputPath
+              << std::endl;
+    return 0;
+}
@@ -0,0 +1,114 @@
+#ifndef HOMARPCBENCH_TRACEPOINT_H
+#define HOMARPCBENCH_TRACEPOINT_H
+
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <PerfUtils/TimeTrace.h>
+
+namespace HomaRpcBench {
+
+/**
+ * TimeTrace tracepoints on the benchmark hot paths, gated so that published
+ * latencies do not pay for tracing nobody asked for.
+ *
+ * Tracepoints are compiled in unless HOMARPCBENCH_NO_TRACEPOINTS is defined
+ * (configure with -DTRACEPOINTS=OFF), in which case they compile to nothing.
+ * When compiled in, each one belongs to a Category and records only if its
+ * category is set in the runtime mask, which is empty unless --timetrace
+ * was given; a disabled tracepoint costs one load and one predictable
+ * branch.
+ */
+namespace Tracepoint {
+
+enum Category : uint32_t {
+    /// Phases of each client op in nestedRpc and ringRpc.
+    CLIENT = 1 << 0,
+    /// Server::poll receiving a ServerOp.
+    POLL = 1 << 1,
+    /// Steps of the server's echo handlers.
+    ECHO = 1 << 2,
+    /// Steps of the nested op a proxying server sends down the chain.
+    NESTED = 1 << 3,
+    ALL = CLIENT | POLL | ECHO | NESTED,
+};
+
+#ifdef HOMARPCBENCH_NO_TRACEPOINTS
+inline constexpr bool COMPILED = false;
+#else
+inline constexpr bool COMPILED = true;
+#endif
+
+/// Categories that currently record; see setMask().
+inline uint32_t mask = 0;
+
+inline void
+setMask(uint32_t categories)
+{
+    mask = categories;
+}
+
+inline bool
+isEnabled(uint32_t category)
+{
+    return COMPILED && __builtin_expect((mask & category) != 0, 0);
+}
+
+/**
+ * Record a tracepoint in TimeTrace if its category is enabled.
+ */
+inline void
+record(uint32_t category, const char* name)
+{
+    if (isEnabled(category)) {
+        PerfUtils::TimeTrace::record(name);
+    }
+}
+
+/**
+ * Record a tracepoint with a timestamp taken earlier by the caller.
+ */
+inline void
+record(uint32_t category, uint64_t cycles, const char* name)
+{
+    if (isEnabled(category)) {
+        PerfUtils::TimeTrace::record(cycles, name);
+    }
+}
+
+/**
+ * Parse a comma separated list of category names (client, poll, echo,
+ * nested, all or none) into a mask.  Returns false and prints a message if
+ * a name is unknown.
+ */
+inline bool
+parseMask(const std::string& spec, uint32_t* categories)
+{
+    *categories = 0;
+    std::stringstream names(spec);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        if (name == "client") {
+            *categories |= CLIENT;
+        } else if (name == "poll") {
+            *categories |= POLL;
+        } else if (name == "echo") {
+            *categories |= ECHO;
+        } else if (name == "nested") {
+            *categories |= NESTED;
+        } else if (name == "all") {
+            *categories |= ALL;
+        } else if (name != "none" && !name.empty()) {
+            std::cerr << "Unknown tracepoint category " << name << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace Tracepoint
+}  // namespace HomaRpcBench
+
+#endif  // HOMARPCBENCH_TRACEPOINT_H
@@ -0,0 +1,154 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <PerfUtils/Cycles.h>
+#include <docopt.h>
+
+#include "FlightRecorder.h"
+#include "Output.h"
+#include "Tracepoint.h"
+
+static const char USAGE[] = R"(HomaRpcBench tracepoint_bench.
+
+    Measures what the tracepoints of an op cost in each mode: compiled out
+    (as with -DTRACEPOINTS=OFF), compiled in but disabled, enabled, and
+    recorded by the flight recorder.  Each op runs as many tracepoints as a
+    client op of nestedRpc, separated by compiler barriers that stand in for
+    the calls into the transport between them.
+
+    Usage:
+        tracepoint_bench [options]
+
+    Options:
+        -h --help           Show this screen.
+        --version           Show version.
+        --count=<n>         Ops per sample [default: 1000].
+        --samples=<n>       Number of samples to take [default: 1000].
+)";
+
+namespace HomaRpcBench {
+namespace TracepointBench {
+
+/// Tracepoints per op, as in the client loop of nestedRpc.
+static const int TRACEPOINTS_PER_OP = 6;
+
+/// Keeps the mask (and the recorder's state) from being read once per loop,
+/// as real transport calls between tracepoints would.
+inline void
+barrier()
+{
+    asm volatile("" ::: "memory");
+}
+
+/**
+ * Time count ops of TRACEPOINTS_PER_OP tracepoints each and print the
+ * per-op distribution.
+ *
+ * @param baselineCycles
+ *      Cycles per op without tracepoints, to report the overhead against;
+ *      negative for the baseline itself.
+ * @param opFn
+ *      Runs one op; called with a distinct op id per op.
+ * @return
+ *      Mean cycles per op.
+ */
+template <typename OpFn>
+double
+run(int count, int samples, const std::string& description,
+    double baselineCycles, OpFn opFn)
+{
+    std::vector<Output::Latency> times;
+    uint64_t totalCycles = 0;
+    for (int i = 0; i < samples; ++i) {
+        uint64_t start = PerfUtils::Cycles::rdtsc();
+        for (int j = 0; j < count; ++j) {
+            opFn(j + 1);
+        }
+        uint64_t cycles = PerfUtils::Cycles::rdtsc() - start;
+        totalCycles += cycles;
+        times.emplace_back(PerfUtils::Cycles::toSeconds(cycles) / count);
+    }
+    double cyclesPerOp = static_cast<double>(totalCycles) /
+                         (static_cast<double>(count) * samples);
+    std::string overhead;
+    if (baselineCycles >= 0) {
+        overhead = Output::format(", %+.1f cycles/tracepoint",
+                                  (cyclesPerOp - baselineCycles) /
+                                      TRACEPOINTS_PER_OP);
+    }
+    std::cout << Output::basic(times,
+                               Output::format("%s (%.1f cycles/op%s)",
+                                              description.c_str(),
+                                              cyclesPerOp, overhead.c_str()))
+              << std::endl;
+    return cyclesPerOp;
+}
+
+}  // namespace TracepointBench
+}  // namespace HomaRpcBench
+
+int
+main(int argc, char* argv[])
+{
+    using namespace HomaRpcBench;
+    using namespace HomaRpcBench::TracepointBench;
+
+    std::map<std::string, docopt::value> args =
+        docopt::docopt(USAGE, {argv + 1, argv + argc},
+                       true,  // show help if requested
+                       "HomaRpcBench tracepoint_bench");  // version string
+    int count = args["--count"].asLong();
+    int samples = args["--samples"].asLong();
+
+    auto untraced = [](uint64_t opId) {
+        for (int i = 0; i < TRACEPOINTS_PER_OP; ++i) {
+            barrier();
+        }
+    };
+    auto traced = [](uint64_t opId) {
+        for (int i = 0; i < TRACEPOINTS_PER_OP; ++i) {
+            barrier();
+            Tracepoint::record(Tracepoint::CLIENT, "Benchmark: tracepoint");
+        }
+    };
+    FlightRecorder::Recorder recorder(1);
+    auto recorded = [&recorder](uint64_t opId) {
+        recorder.begin(opId);
+        for (int i = 0; i < TRACEPOINTS_PER_OP; ++i) {
+            barrier();
+            recorder.trace(Tracepoint::CLIENT, "Benchmark: tracepoint");
+        }
+        recorder.end();
+    };
+
+    if (!Tracepoint::COMPILED) {
+        std::cout << "Tracepoints are compiled out; every mode below runs "
+                     "the same code as the baseline."
+                  << std::endl;
+    }
+    std::cout << Output::basicHeader() << std::endl;
+    double baseline =
+        run(count, samples, "no tracepoints (compiled out)", -1, untraced);
+
+    Tracepoint::setMask(0);
+    run(count, samples, "compiled in, all categories disabled", baseline,
+        traced);
+    Tracepoint::setMask(Tracepoint::ALL & ~Tracepoint::CLIENT);
+    run(count, samples, "compiled in, other categories enabled", baseline,
+        traced);
+    Tracepoint::setMask(Tracepoint::CLIENT);
+    run(count, samples, "enabled, recorded in TimeTrace", baseline, traced);
+
+    Tracepoint::setMask(0);
+    run(count, samples, "flight recorder idle, TimeTrace disabled", baseline,
+        recorded);
+    recorder.setEnabled(true);
+    run(count, samples, "flight recorder recording, TimeTrace disabled",
+        baseline, recorded);
+    Tracepoint::setMask(Tracepoint::CLIENT);
+    run(count, samples, "flight recorder recording, TimeTrace enabled",
+        baseline, recorded);
+
+    return 0;
+}
@@ -19,6 +19,11 @@ enum Opcode {
     DUMP_TIMETRACE,
     ECHO,
     ECHO_MULTILEVEL,
+    GOODPUT,
+    SERVER_STATS,
+    FLIGHT_RECORDER,
+    ECHO_BATCH,
+    HOLD,
     ILLEGAL_OPCODE,
 };
 
@@ -101,22 +106,66 @@ struct DumpTimeTraceRpc {
     } __attribute__((packed));
 };
 
+/**
+ * When and where one server handled an echo op, in the server's own cycle
+ * counter; servers append one per hop when HOP_STAMPS is set (see
+ * HopStamps.h).
+ */
+struct HopStamp {
+    /// Id the server enlisted with; socket servers use their port.
+    uint64_t serverId;
+    /// Rate of the server's cycle counter, so stamps can be converted to
+    /// time.
+    double cyclesPerSecond;
+    /// Handler entered.
+    uint64_t receiveCycles;
+    /// Nested request sent or op delegated; 0 if the server replied.
+    uint64_t forwardCycles;
+    /// Nested response received; 0 unless a nested request was sent.
+    uint64_t returnCycles;
+    /// Response about to be sent; 0 if the op was delegated.
+    uint64_t replyCycles;
+} __attribute__((packed));
+
 /**
  * The configurable benchmark RPC
  */
 struct EchoRpc {
     static const Opcode opcode = ECHO;
 
+    enum Flags : uint8_t {
+        /// Payloads are filled with the pattern selected by patternSeed and
+        /// every hop checks them against the carried payloadCrc.
+        VERIFY_PAYLOAD = 1,
+        /// Every hop appends a HopStamp after the response payload, so
+        /// that hopCount stamps follow it, the last hop's first.  Also used
+        /// in EchoMultiLevelRpc::Request::flags.
+        HOP_STAMPS = 2,
+    };
+
     struct Request {
         Common common;
         uint32_t sentBytes;
         uint32_t responseBytes;
+        uint8_t flags;
+        /// Selects the payload pattern when VERIFY_PAYLOAD is set.
+        uint32_t patternSeed;
+        /// CRC32C of the request payload when VERIFY_PAYLOAD is set.
+        uint32_t payloadCrc;
+        /// Number of servers, including the receiving one, that may still
+        /// handle the op; 0 follows the configured chain to its end.
+        uint8_t hopLimit;
+        /// Identifies the op to the servers' flight recorders; 0 if the op
+        /// is not recorded.
+        uint64_t opId;
     } __attribute__((packed));
 
     struct Response {
         Common common;
         uint32_t hopCount;
         uint32_t responseBytes;
+        /// CRC32C of the response payload when VERIFY_PAYLOAD is set.
+        uint32_t payloadCrc;
     } __attribute__((packed));
 };
 
@@ -130,15 +179,171 @@ struct EchoMultiLevelRpc {
         Common common;
         uint32_t sentBytes;
         uint32_t responseBytes;
+        /// Identifies the op to the servers' flight recorders; 0 if the op
+        /// is not recorded.
+        uint64_t opId;
+        /// EchoRpc::Flags; only HOP_STAMPS applies.
+        uint8_t flags;
+        /// Number of HopStamps after the payload, appended by the servers
+        /// that delegated the op so far, the first hop's first.
+        uint8_t numHopStamps;
+    } __attribute__((packed));
+
+    struct Response {
+        Common common;
+        /// Number of HopStamps after the payload, the first hop's first;
+        /// 0 unless HOP_STAMPS was set.
+        uint32_t numHopStamps;
+        uint32_t responseBytes;
+    } __attribute__((packed));
+};
+
+/**
+ * Several independent echo ops packed into one message by an AutoBatcher.
+ * The request header is followed by numOps SubRequests, each followed by
+ * its payload; the response header is followed by a SubResponse and
+ * payload per sub-request, in the same order.
+ */
+struct EchoBatchRpc {
+    static const Opcode opcode = ECHO_BATCH;
+
+    struct Request {
+        Common common;
+        uint32_t numOps;
+    } __attribute__((packed));
+
+    struct SubRequest {
+        uint32_t sentBytes;
+        uint32_t responseBytes;
     } __attribute__((packed));
 
     struct Response {
         Common common;
-        uint32_t _pad_;
+        uint32_t numOps;
+    } __attribute__((packed));
+
+    struct SubResponse {
+        /// 0 if the sub-request was malformed or too large.
         uint32_t responseBytes;
     } __attribute__((packed));
 };
 
+/**
+ * Kept open by the server without blocking it until a release request
+ * arrives; used to keep many ops outstanding at once.
+ */
+struct HoldRpc {
+    static const Opcode opcode = HOLD;
+
+    struct Request {
+        Common common;
+        /// If true, reply to every held op, and then to this one, instead
+        /// of holding it.
+        bool release;
+    } __attribute__((packed));
+
+    struct Response {
+        Common common;
+        /// Number of ops the release replied to; 0 in held ops' responses.
+        uint64_t heldOps;
+    } __attribute__((packed));
+};
+
+/**
+ * One-way bulk message used by the goodput benchmark; the server consumes
+ * the payload and replies with only a header.
+ */
+struct GoodputRpc {
+    static const Opcode opcode = GOODPUT;
+
+    struct Request {
+        Common common;
+        uint32_t sentBytes;
+    } __attribute__((packed));
+
+    struct Response {
+        Common common;
+    } __attribute__((packed));
+};
+
+/**
+ * Used to read (and optionally reset) a Server's resource usage counters.
+ */
+struct ServerStatsRpc {
+    static const Opcode opcode = SERVER_STATS;
+
+    struct Request {
+        Common common;
+        /// True, if the counters should be cleared after being read.
+        bool reset;
+    } __attribute__((packed));
+
+    struct Response {
+        Common common;
+        /// Rate of the server's cycle counter, so cycle counts can be
+        /// converted to time.
+        double cyclesPerSecond;
+        /// Number of goodput messages consumed since the last reset.
+        uint64_t goodputMessages;
+        /// Number of goodput payload bytes consumed since the last reset.
+        uint64_t goodputBytes;
+        /// Cycles between the first goodput message after the last reset and
+        /// the last reply; the server's polling thread is busy throughout.
+        uint64_t goodputActiveCycles;
+        /// Cycles spent inside the goodput handler.
+        uint64_t goodputHandlerCycles;
+        /// Heap allocation counts of the benchmark RPC handlers (echo and
+        /// goodput) since the last reset; all zero unless the server was
+        /// built with allocation tracking.
+        uint64_t handlerOps;
+        uint64_t handlerAllocations;
+        uint64_t handlerFrees;
+        uint64_t handlerAllocatedBytes;
+        uint64_t handlerAllocatorCycles;
+    } __attribute__((packed));
+};
+
+/**
+ * Used to drive a Server's flight recorder (see FlightRecorder.h).
+ */
+struct FlightRecorderRpc {
+    static const Opcode opcode = FLIGHT_RECORDER;
+
+    enum Action : uint8_t {
+        /// Start recording the echo ops that carry an opId, discarding
+        /// anything recorded before.
+        ENABLE,
+        /// Keep the record of opId until it is fetched.
+        SNAPSHOT,
+        /// Return (and forget) the snapshot of opId.
+        FETCH,
+        /// Stop recording and discard all records and snapshots.
+        DISABLE,
+    };
+
+    struct Request {
+        Common common;
+        uint8_t action;
+        uint64_t opId;
+    } __attribute__((packed));
+
+    /// Follows the Response of a FETCH once per event, followed in turn by
+    /// nameLength bytes of the tracepoint name.
+    struct Event {
+        uint64_t cycles;
+        uint16_t nameLength;
+    } __attribute__((packed));
+
+    struct Response {
+        Common common;
+        /// Rate of the server's cycle counter, so event times can be
+        /// converted to time.
+        double cyclesPerSecond;
+        /// Number of Events that follow; 0 if opId has no snapshot.
+        uint32_t numEvents;
+    } __attribute__((packed));
+};
+
 }  // namespace WireFormat
 }  // namespace HomaRpcBench
 